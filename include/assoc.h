@@ -0,0 +1,189 @@
+/*
+ *  assoc.h
+ *  Association kernels between a set of features and the rows of an expression matrix
+ *
+ */
+
+#ifndef ASSOC_H
+#define ASSOC_H
+
+#define CORRELATE_BLOCK_NUM 4		//features correlated per pass over the expression rows. CorrelateBlock is unrolled for 4
+
+//Expression rows prepared for Kendall tau: the values replaced by integer ranks, and the tied pairs of each row
+typedef struct
+{
+	int *ranks;
+	double *tiedPairs;
+	int rowNum;
+	int dim;
+}KENDALL_ROWS_STRUCT;
+
+#define MI_MAX_BIN_NUM 16			//equal-frequency bins of mutual information, at most
+
+//Expression rows prepared for mutual information: one bin code per value, and the entropy of each row
+typedef struct
+{
+	unsigned char *codes;
+	double *entropies;
+	double *countLogCount;		//c*log(c) for c = 0..dim
+	int rowNum;
+	int dim;
+	int binNum;
+}MI_ROWS_STRUCT;
+
+#define BIT_WORD_SIZE 64			//samples packed in one word of a binary row
+
+//Rows of 0/1 values packed into 64-bit words: value k of row i is bit k%BIT_WORD_SIZE of bits[i*wordNum+k/BIT_WORD_SIZE]
+typedef struct
+{
+	unsigned long long *bits;
+	int rowNum;
+	int dim;
+	int wordNum;
+}BIT_ROWS_STRUCT;
+
+#define CATEGORY_MAX_NUM 16			//distinct values of a categorical row, at most
+
+//Rows of few distinct values stored as uint8 codes: value k of row i is levels[i*CATEGORY_MAX_NUM+codes[i*dim+k]].
+//The levels of a row are sorted ascending, and its unused levels are 0
+typedef struct
+{
+	unsigned char *codes;
+	double *levels;
+	int rowNum;
+	int dim;
+}CATEGORY_ROWS_STRUCT;
+
+//Rows quantized per row to 8 or 16 bit codes, value = offset+scale*code with the codes within +-127 or +-32767. Pearson
+//correlations do not depend on the offset and the scale, so only the codes, their sums and their centered norms are kept.
+//16 bit codes are in codes16 and 8 bit codes in codes8, the other being NULL
+typedef struct
+{
+	short *codes16;
+	signed char *codes8;
+	double *sums;
+	double *norms;
+	int rowNum;
+	int dim;
+	int bits;
+}QUANT_ROWS_STRUCT;
+
+//Replace every row of a rowNum*dim matrix by its ranks, tied values sharing their average rank. Return 1 if success, -1 if failure
+int RankMatrixRows(double *matrix, int rowNum, int dim);
+
+//Center every row of a rowNum*dim matrix and scale it to unit norm, so the Pearson correlation of two rows is their dot product.
+//Constant rows become 0
+void StandardizeMatrixRows(double *matrix, int rowNum, int dim);
+
+//Replace every row of a rowNum*dim matrix by its biweight midcorrelation form: (x-med)*w with Tukey weights
+//w = (1-u^2)^2 for |u|<1, u = (x-med)/(9*MAD), scaled to unit norm. The dot product of two such rows is their bicor.
+//Rows with a zero MAD fall back to the Pearson form of StandardizeMatrixRows. Return 1 if success, -1 if failure
+int BiweightMatrixRows(double *matrix, int rowNum, int dim);
+
+//Correlations of featureNum standardized features with rowNum standardized rows, corr[f*rowNum+r]. The features are taken
+//CORRELATE_BLOCK_NUM at a time, so each row is read once per block
+void CorrelateBlock(double *corr, double *features, int featureNum, double *rows, int rowNum, int dim);
+
+//Prepare the rows of a rowNum*dim matrix for KendallBlock. Return 1 if success, -1 if failure
+int PrepareKendallRows(KENDALL_ROWS_STRUCT *rows, double *matrix, int rowNum, int dim);
+
+//Free the prepared rows
+void FreeKendallRows(KENDALL_ROWS_STRUCT *rows);
+
+//Kendall tau-b of featureNum features with all prepared rows, corr[f*rowNum+r], by Knight's O(dim*log(dim)) algorithm.
+//Each feature is sorted once and its order reused for all rows. threadNum threads share the features. Return 1 if success, -1 if failure
+int KendallBlock(double *corr, double *features, int featureNum, KENDALL_ROWS_STRUCT *rows, int threadNum);
+
+//Number of equal-frequency bins used for mutual information of dim samples: the cube root of dim, within 2..MI_MAX_BIN_NUM
+int MutualInfoBinNum(int dim);
+
+//Replace every value of a rowNum*dim matrix by its equal-frequency bin code 0..binNum-1, from its average rank.
+//Tied values share a bin. Return 1 if success, -1 if failure
+int DiscretizeMatrixRows(double *matrix, int rowNum, int dim, int binNum);
+
+//Prepare the rows of a rowNum*dim matrix for MutualInfoBlock: bin codes in unsigned char and row entropies. Return 1 if success, -1 if failure
+int PrepareMutualInfoRows(MI_ROWS_STRUCT *rows, double *matrix, int rowNum, int dim, int binNum);
+
+//Free the prepared rows
+void FreeMutualInfoRows(MI_ROWS_STRUCT *rows);
+
+//Mutual information (in nats) of featureNum features, given as bin codes by DiscretizeMatrixRows, with all prepared rows,
+//corr[f*rowNum+r]. Each row is histogrammed against CORRELATE_BLOCK_NUM features while its codes are in cache. Return 1 if success, -1 if failure
+int MutualInfoBlock(double *corr, double *features, int featureNum, MI_ROWS_STRUCT *rows);
+
+//Return 1 if every value of a rowNum*dim matrix is 0 or 1, otherwise 0
+int IsBinaryMatrixRows(double *matrix, int rowNum, int dim);
+
+//Pack a 0/1 row of dim values into (dim+BIT_WORD_SIZE-1)/BIT_WORD_SIZE words. Nonzero values are set bits
+void PackBinaryRow(unsigned long long *bits, double *row, int dim);
+
+//Unpack a packed row into dim 0/1 values
+void UnpackBinaryRow(double *row, unsigned long long *bits, int dim);
+
+//Pack the rows of a 0/1 rowNum*dim matrix. Return 1 if success, -1 if failure
+int PackBinaryRows(BIT_ROWS_STRUCT *rows, double *matrix, int rowNum, int dim);
+
+//Free the packed rows
+void FreeBinaryRows(BIT_ROWS_STRUCT *rows);
+
+//Point-biserial (Pearson) correlations of featureNum packed 0/1 features with rowNum standardized rows, corr[f*rowNum+r].
+//A centered unit-norm row correlates with a feature of m set bits as the sum of its values at the set bits times
+//sqrt(dim/(m*(dim-m))), so only the smaller of the two groups is summed and no multiply is done per sample.
+//Constant features correlate 0. Return 1 if success, -1 if failure
+int PointBiserialBlock(double *corr, unsigned long long *features, int featureNum, int wordNum, double *rows, int rowNum, int dim);
+
+//Pearson correlations of featureNum sparse features with rowNum standardized rows, corr[f*rowNum+r]. The nonzeros of feature f
+//are values[k] in columns[k] for featureStart[f]<=k<featureStart[f+1], and its other values are 0. A centered row sums to 0,
+//so the covariance is the dot product over the nonzeros alone, scaled by the feature norm from its sum and sum of squares.
+//The cost is proportional to the nonzeros. Constant features correlate 0. Return 1 if success, -1 if failure
+int SparseCorrelateBlock(double *corr, int *featureStart, int *columns, double *values, int featureNum, double *rows, int rowNum, int dim);
+
+//Centered norms of rowNum sparse rows of dim values, sqrt(sum(x^2)-sum(x)^2/dim) from the nonzeros alone. The nonzeros of row i
+//are values[k] for rowStart[i]<=k<rowStart[i+1]
+void SparseRowNorms(double *norms, int *rowStart, double *values, int rowNum, int dim);
+
+//Pearson correlations of featureNum standardized features with rowNum sparse rows, corr[f*rowNum+r]. A standardized feature
+//sums to 0, so the row mean drops out of the covariance and only the nonzeros of the row are visited; the row is scaled by its
+//centered norm from SparseRowNorms. The features are interleaved CORRELATE_BLOCK_NUM at a time so each nonzero gathers one
+//short run. Constant rows correlate 0. Return 1 if success, -1 if failure
+int SparseRowsCorrelateBlock(double *corr, double *features, int featureNum, int *rowStart, int *columns, double *values, 
+							 double *rowNorms, int rowNum, int dim);
+
+//Return 1 if every row of a rowNum*dim matrix has at most CATEGORY_MAX_NUM distinct values, otherwise 0
+int IsCategoricalMatrixRows(double *matrix, int rowNum, int dim);
+
+//Encode a row of dim values into codes and CATEGORY_MAX_NUM sorted levels. Return the number of levels, -1 if there are too many
+int EncodeCategoryRow(unsigned char *codes, double *levels, double *row, int dim);
+
+//Decode an encoded row into dim values
+void DecodeCategoryRow(double *row, unsigned char *codes, double *levels, int dim);
+
+//Encode the rows of a rowNum*dim matrix. Return 1 if success, -1 if failure
+int PackCategoryRows(CATEGORY_ROWS_STRUCT *rows, double *matrix, int rowNum, int dim);
+
+//Free the encoded rows
+void FreeCategoryRows(CATEGORY_ROWS_STRUCT *rows);
+
+//Association of featureNum categorical features with rowNum standardized rows, corr[f*rowNum+r]. One pass over a row
+//accumulates its per-category sums S_c, from which isEta=0 gives the Pearson correlation with the levels as ordinal values,
+//sum(L_c*S_c)/|L-mean|, and isEta=1 the eta-squared of a one-way ANOVA of the row by category, sum(S_c^2/n_c).
+//The samples of each feature are grouped by category, and the largest category is not summed: a centered row gives it
+//minus the sum of the others. Constant features give 0. Return 1 if success, -1 if failure
+int CategoryCorrelateBlock(double *corr, unsigned char *codes, double *levels, int featureNum, int isEta, double *rows, int rowNum, int dim);
+
+//Quantize the rows of a rowNum*dim matrix to bits (8 or 16) bit codes, each row spanning the full code range. Return 1 if success, -1 if failure
+int QuantizeMatrixRows(QUANT_ROWS_STRUCT *rows, double *matrix, int rowNum, int dim, int bits);
+
+//Free the quantized rows
+void FreeQuantRows(QUANT_ROWS_STRUCT *rows);
+
+//16 bit codes of rowNum quantized rows from row first: the stored codes, or 8 bit codes widened into buffer
+short *QuantRowsAsInt16(QUANT_ROWS_STRUCT *rows, int first, int rowNum, short *buffer);
+
+//Pearson correlations of featureNum quantized features with rowNum quantized rows, corr[f*rowNum+r], both as 16 bit codes with their
+//sums and centered norms: (sum(a*b)-sum(a)*sum(b)/dim)/(norm(a)*norm(b)). The integer products are summed exactly, by SSE2
+//multiply-adds where available. Constant features or rows give 0
+void QuantCorrelateBlock(double *corr, short *features, double *featureSums, double *featureNorms, int featureNum, 
+						 short *rows, double *rowSums, double *rowNorms, int rowNum, int dim);
+
+#endif
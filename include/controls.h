@@ -0,0 +1,34 @@
+/*
+ *  controls.h
+ *  Orthonormal basis of control variables, projected out of data rows
+ *
+ */
+
+#ifndef CONTROLS_H
+#define CONTROLS_H
+
+#include "dataMatrix.h"
+
+#define MAX_CONTROL_NUM 100		//control names in a list of CollectControls
+
+typedef struct
+{
+	double *q;			//orthonormal basis vectors, basisNum arrays of sampleNum values. The first one is the intercept
+	int basisNum;
+	int sampleNum;
+}CONTROL_BASIS_STRUCT;
+
+//Build an orthonormal basis of the intercept and controlNum control arrays (stored one after another) by Householder QR.
+//Controls that are linearly dependent on the intercept or on earlier controls are dropped. Return the number of basis vectors, -1 if failure
+int BuildControlBasis(CONTROL_BASIS_STRUCT *basis, double *controls, int controlNum, int sampleNum);
+
+//Free the control basis
+void FreeControlBasis(CONTROL_BASIS_STRUCT *basis);
+
+//Project the control basis out of rowNum arrays of sampleNum values stored one after another. Rows are processed in blocks so the basis stays in cache
+void ProjectOutControls(CONTROL_BASIS_STRUCT *basis, double *rows, int rowNum);
+
+//Collect the control arrays: expression rows named in a comma-separated list, followed by all rows of a covariate matrix. Return the number of controls, -1 if failure
+int CollectControls(double *controls, char *regulatorNames, DATA_MATRIX_STRUCT *expressionMatrix, DATA_MATRIX_STRUCT *covariateMatrix);
+
+#endif
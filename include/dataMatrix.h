@@ -7,8 +7,12 @@
  *
  */
 
-#define MAX_SAMPLE_NUM 10000
+#ifndef DATA_MATRIX_H
+#define DATA_MATRIX_H
+
 #define MAX_WORD_SIZE  255
+#define BINARY_MATRIX_MAGIC "GS2AMAT1"
+#define BINARY_MATRIX_MAGIC_LEN 8
 
 typedef struct
 {
@@ -25,13 +29,31 @@ typedef struct
 	int recordNum;
 }DATA_MATRIX_STRUCT;
 
+//Values of a sparse data matrix in compressed sparse rows. The nonzeros of record i are values[k] in sample columns[k],
+//for rowStart[i]<=k<rowStart[i+1]. The names are kept in a DATA_MATRIX_STRUCT whose matrix is NULL
+typedef struct
+{
+	int *rowStart;
+	int *columns;
+	double *values;
+	int nonzeroNum;
+}SPARSE_ROWS_STRUCT;
+
+//Hash index of the names of a set of IDs, by open addressing: slots hold positions in ids, or -1
+typedef struct
+{
+	ID_INFO_STRUCT *ids;
+	int *slots;
+	size_t slotNum;
+}ID_INDEX_STRUCT;
+
 //allocate memory for data matrix
 int AllocDataMatrix(DATA_MATRIX_STRUCT *matrix, int sampleNum, int recordNum);
 
 //Free memory for data matrix
 void FreeDataMatrix(DATA_MATRIX_STRUCT *matrix);
 
-//Read the data matrix from a file
+//Read the data matrix from a file, in text or in the binary format of SaveDataMatrixBinary
 int ReadDataMatrix(char *fileName, DATA_MATRIX_STRUCT *matrix);
 
 //Intersect sample ID sets in two matrics and generate new matrics with the intersected ID set. Return the number of intersected IDs
@@ -39,3 +61,63 @@ int IntersectSampleIDs(DATA_MATRIX_STRUCT *srcMatrix1, DATA_MATRIX_STRUCT *srcMa
 
 //Save the data matrix
 int SaveDataMatrix(char *fileName, DATA_MATRIX_STRUCT *matrix);
+
+//Save the data matrix with threadNum threads. Rows are formatted in blocks into per-block buffers and written in order
+//with one large write per block. Return 1 if success, -1 if failure
+int SaveDataMatrixThreads(char *fileName, DATA_MATRIX_STRUCT *matrix, int threadNum);
+
+//Save the data matrix in the binary format: BINARY_MATRIX_MAGIC, sampleNum and recordNum as int, the sample names and the
+//record names in MAX_WORD_SIZE chars each, then the matrix as double in row-major order. Native byte order. Return 1 if success, -1 if failure
+int SaveDataMatrixBinary(char *fileName, DATA_MATRIX_STRUCT *matrix);
+
+//Read a data matrix saved by SaveDataMatrixBinary. Return 1 if success, -1 if failure
+int ReadDataMatrixBinary(char *fileName, DATA_MATRIX_STRUCT *matrix);
+
+//Check whether a file starts with BINARY_MATRIX_MAGIC. Return 1 if it does, 0 if not, -1 if the file cannot be opened
+int IsBinaryDataMatrix(char *fileName);
+
+//Read a sparse data matrix. The header row is that of the text format. Each record row is the record ID followed by
+//column:value entries for its nonzeros, column being the 1-based sample index in the header. The names go to matrix, with
+//matrix->matrix NULL, and the values to rows. Return 1 if success, -1 if failure
+int ReadSparseDataMatrix(char *fileName, DATA_MATRIX_STRUCT *matrix, SPARSE_ROWS_STRUCT *rows);
+
+//Free memory for sparse rows
+void FreeSparseRows(SPARSE_ROWS_STRUCT *rows);
+
+//Remove repeated rows of a data matrix in place, keeping the first of each set of identical rows with its record info. Rows are
+//hashed and compared bitwise. profiles[i] is set to the row that record i is kept as. Return the number of rows kept, -1 if failure
+int UniqueDataMatrixRows(DATA_MATRIX_STRUCT *matrix, int *profiles);
+
+//Read IDs, the first word of each line, into idNum ID info structures. Blank lines are skipped. Return 1 if the file has exactly
+//idNum IDs, -1 otherwise
+int ReadIDList(char *fileName, ID_INFO_STRUCT *ids, int idNum);
+
+//Read a Matrix Market coordinate file (real, integer or pattern, general) into sparse rows, with the record IDs from
+//rowIDFileName and the sample IDs from sampleIDFileName, one per line as for 10x feature and barcode lists. The names go to
+//matrix, with matrix->matrix NULL, and the values to rows. Return 1 if success, -1 if failure
+int ReadMatrixMarket(char *fileName, char *rowIDFileName, char *sampleIDFileName, DATA_MATRIX_STRUCT *matrix, SPARSE_ROWS_STRUCT *rows);
+
+//Build a hash index of the names of idNum IDs. The first of repeated names is the one found. Return 1 if success, -1 if failure
+int BuildIDIndex(ID_INDEX_STRUCT *index, ID_INFO_STRUCT *ids, int idNum);
+
+//Return the position of name among the indexed IDs, -1 if it is not there
+int FindID(ID_INDEX_STRUCT *index, char *name);
+
+//Free the hash index
+void FreeIDIndex(ID_INDEX_STRUCT *index);
+
+//Match the sample IDs of two matrices through a hash index. match[i] is set to the index in matrix2 of sample i of matrix1,
+//or -1. Return the number of matched samples, -1 if failure
+int MatchSampleIDs(DATA_MATRIX_STRUCT *matrix1, DATA_MATRIX_STRUCT *matrix2, int *match);
+
+//Keep the samples selected[0..selectedNum-1] of a matrix, in that order: the names, and the dense values or, when srcRows is
+//not NULL, the sparse rows. Return 1 if success, -1 if failure
+int SelectSamples(DATA_MATRIX_STRUCT *src, SPARSE_ROWS_STRUCT *srcRows, int *selected, int selectedNum, 
+				  DATA_MATRIX_STRUCT *dest, SPARSE_ROWS_STRUCT *destRows);
+
+//Intersect two matrices by samples, in the sample order of matrix1, through MatchSampleIDs. A matrix whose rows argument is not
+//NULL is sparse: its values are in the rows, and its trimmed values go to the dest rows. Return 1 if success, -1 if failure
+int IntersectSampleIDsRows(DATA_MATRIX_STRUCT *srcMatrix1, SPARSE_ROWS_STRUCT *srcRows1, DATA_MATRIX_STRUCT *srcMatrix2, SPARSE_ROWS_STRUCT *srcRows2, 
+						   DATA_MATRIX_STRUCT *destMatrix1, SPARSE_ROWS_STRUCT *destRows1, DATA_MATRIX_STRUCT *destMatrix2, SPARSE_ROWS_STRUCT *destRows2);
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ *  dcor.h
+ *  Fast distance correlation
+ *
+ */
+
+#ifndef DCOR_H
+#define DCOR_H
+
+#include "math_api.h"
+
+//number of projection directions used for two-variable inputs
+#define DCOR_PROJECTION_NUM 16
+
+typedef struct
+{
+	double *values;		//centered values
+	int *order;			//indices in ascending order of values
+	int *rank;			//dense ranks, tied values share a rank
+	int rankNum;
+	double *rowSums;	//row sums of the distance matrix |values[i]-values[j]|
+	double sum;			//sum of rowSums
+}UNIVARIATE_DIST_STRUCT;
+
+//Distance structure of a fixed output (target) array, prepared once and shared read-only by all evaluations
+typedef struct
+{
+	int dim;
+	int isFast;
+	double *centered;				//exact: double-centered distance matrix of the target, upper triangle (i<j) packed row by row
+	UNIVARIATE_DIST_STRUCT dist;	//fast: sorted target and its distance row sums
+	double dVar;					//squared distance variance of the target
+}DCOR_TARGET_STRUCT;
+
+//Scratch space of one evaluation. Reused across calls; one per thread
+typedef struct
+{
+	int dim;
+	double *rowSums;
+	double *proj;
+	double *tree;
+	INDEXED_FLOAT *sortBuf;
+	UNIVARIATE_DIST_STRUCT projDist;
+}DCOR_WORKSPACE_STRUCT;
+
+//Squared distance covariance (V-statistic) of two univariate arrays in O(dim*log(dim)), by sorting and Fenwick-tree partial sums
+double FastDistanceCovariance(double *x, double *y, int dim);
+
+//Prepare the distance structure of a target array. isFast: O(dim) structure for EvalDistanceCorrelation's fast path, otherwise the O(dim^2) centered matrix.
+//Return 1 if success, -1 if failure
+int PrepareDistanceTarget(DCOR_TARGET_STRUCT *target, double *output, int dim, int isFast);
+
+//Free a prepared target
+void FreeDistanceTarget(DCOR_TARGET_STRUCT *target);
+
+//Allocate the scratch space of EvalDistanceCorrelation. Return 1 if success, -1 if failure
+int AllocDCorWorkspace(DCOR_WORKSPACE_STRUCT *workspace, int dim);
+
+//Free the scratch space
+void FreeDCorWorkspace(DCOR_WORKSPACE_STRUCT *workspace);
+
+//Distance correlation between an input (inputNum*dim values, as in ComputeDistanceCorrelation) and a prepared target.
+//Exact targets: one pass over the pairs i<j, without building the input distance matrix.
+//Fast targets: O(dim*log(dim)). One input variable is exact; with two, the input distances in dCov and in the distance row sums are
+//averaged from DCOR_PROJECTION_NUM equally spaced projections, which is within 0.33% of the Euclidean distance. More variables need an exact target
+double EvalDistanceCorrelation(DCOR_TARGET_STRUCT *target, double *input, int inputNum, DCOR_WORKSPACE_STRUCT *workspace);
+
+//Compute distance correlation with the same arguments as ComputeDistanceCorrelation, through the fast path of EvalDistanceCorrelation.
+//More than two input variables fall back to ComputeDistanceCorrelation
+double ComputeDistanceCorrelationFast(double *input, double *output, int inputNum, int dim);
+
+#endif
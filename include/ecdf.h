@@ -0,0 +1,25 @@
+/*
+ *  ecdf.h
+ *  Empirical CDF lookups against a sorted null distribution
+ *
+ */
+
+#ifndef ECDF_H
+#define ECDF_H
+
+//Count the items of a sorted array (ascending order) that are smaller than value. Iterative and branchless
+int EcdfCountLess(double value, double *sorted, int size);
+
+//Count the items of a sorted array (ascending order) that are smaller than or equal to value. Iterative and branchless
+int EcdfCountLessEqual(double value, double *sorted, int size);
+
+//Batched EcdfCountLess. counts[i] is the number of items in sorted smaller than queries[i]. Queries need not be sorted. Return 1 if success, -1 if failure
+int EcdfBatchCountLess(int *counts, double *queries, int queryNum, double *sorted, int size);
+
+//Batched EcdfCountLessEqual. counts[i] is the number of items in sorted smaller than or equal to queries[i]. Return 1 if success, -1 if failure
+int EcdfBatchCountLessEqual(int *counts, double *queries, int queryNum, double *sorted, int size);
+
+//Upper-tail permutation p-values, pValues[i] = #(null>=queries[i])/nullNum. The null has to be sorted in ascending order. Return 1 if success, -1 if failure
+int EcdfUpperTailP(double *pValues, double *queries, int queryNum, double *sortedNull, int nullNum);
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ *  format.h
+ *  Fast number formatting into large output buffers
+ *
+ */
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdio.h>
+
+#define FORMAT_MAX_WIDTH 330			//longest text of one formatted number, "%f" of -DBL_MAX included
+#define OUTPUT_BUFFER_SIZE (1<<20)		//default size of a buffer that is flushed into a file
+
+//Growable text buffer. fh: file the buffer is flushed into when full, or NULL for a buffer that only grows
+typedef struct
+{
+	char *text;
+	size_t len;
+	size_t size;
+	FILE *fh;
+	int isFailed;		//an allocation or a write failed
+}TEXT_BUFFER_STRUCT;
+
+//Format a real value as printf("%.*f", precision, value) does, precision 0..9. dest needs FORMAT_MAX_WIDTH+1 chars.
+//Integer arithmetic for moderate values, snprintf for large values and for products too close to a rounding boundary.
+//Return the number of chars written, not counting the terminating 0
+int FormatFixed(char *dest, double value, int precision);
+
+//Format an integer in decimal. dest needs 12 chars. Return the number of chars written, not counting the terminating 0
+int FormatInt(char *dest, int value);
+
+//Initialize a text buffer of size chars. fh: file to flush into, or NULL. Return 1 if success, -1 if failure
+int InitTextBuffer(TEXT_BUFFER_STRUCT *buf, FILE *fh, size_t size);
+
+//Free a text buffer. Does not flush it
+void FreeTextBuffer(TEXT_BUFFER_STRUCT *buf);
+
+//Write the buffered text into the file of the buffer and empty the buffer. Return 1 if success, -1 if failure
+int FlushTextBuffer(TEXT_BUFFER_STRUCT *buf);
+
+//Make room for need more chars, by flushing into the file or else by growing. Return 1 if success, -1 if failure
+int ReserveTextBuffer(TEXT_BUFFER_STRUCT *buf, size_t need);
+
+//Append len chars
+void AppendChars(TEXT_BUFFER_STRUCT *buf, char *s, size_t len);
+
+//Append a 0-terminated string
+void AppendString(TEXT_BUFFER_STRUCT *buf, char *s);
+
+//Append an integer in decimal
+void AppendInt(TEXT_BUFFER_STRUCT *buf, int value);
+
+//Append a real value as printf("%.*f", precision, value) does
+void AppendFixed(TEXT_BUFFER_STRUCT *buf, double value, int precision);
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ *  gs2a.h
+ *  GS2A scoring engine. The prepared expression and candidate data of an analysis are kept in a context, and every entry point
+ *  takes the context, so that several analyses can be held at once and one context can be scored from several threads
+ *
+ */
+
+#ifndef GS2A_H
+#define GS2A_H
+
+#include <stdio.h>
+#include "dataMatrix.h"
+#include "assoc.h"
+#include "controls.h"
+
+#define GS2A_BLOCK_NUM 64		//candidates or permuted features correlated at a time
+
+//correlation measures
+enum {CORRELATION_PEARSON, CORRELATION_SPEARMAN, CORRELATION_BICOR, CORRELATION_KENDALL, CORRELATION_MI, CORRELATION_ETA};
+
+//statistics of the correlations of a candidate with the targets against the other genes. mean: the GS2A score, the mean shift
+//of the targets in units of the standard deviation of the others. chisq: the mean squared standardized deviation of the targets, minus 0.5
+enum {GS2A_STAT_MEAN, GS2A_STAT_CHI_SQUARE, GS2A_STATISTIC_NUM};
+
+//Sufficient statistics of a correlation vector, from which every statistic is computed
+typedef struct
+{
+	int targetNum;
+	int nonTargetNum;
+	double targetMean;
+	double targetDeviation;		//sum of the squared deviations of the targets from the mean of the others
+	double nonTargetMean;
+	double nonTargetStdev;
+}GS2A_MOMENTS_STRUCT;
+
+//A statistic of the registry: its name and its value from the moments
+typedef struct
+{
+	char *name;
+	double (*compute)(GS2A_MOMENTS_STRUCT *moments);
+}GS2A_STATISTIC_STRUCT;
+
+extern GS2A_STATISTIC_STRUCT gs2aStatistics[GS2A_STATISTIC_NUM];
+
+//Scores and p-values of a candidate, one per statistic of the context, in its order
+typedef struct
+{
+	ID_INFO_STRUCT *id;
+	int isSignature;
+	double score[GS2A_STATISTIC_NUM];
+	double pValue[GS2A_STATISTIC_NUM];
+}CANDIDATE_SCORE_STRUCT;
+
+//Prepared data of one analysis. The caller fills expressions and candidates with the expression and candidate data
+//intersected by samples, or, for sparse data, their names with matrix NULL and the values in sparseExpressions or
+//sparseCandidates, and optionally controls. PrepareGS2AContext then transforms them for the correlation measure and keeps
+//only what the measure reads. Once prepared, a context is only read, so the entry points may be called on it from several threads at once
+typedef struct
+{
+	int correlationMethod;
+	int threadNum;							//threads of each entry point
+	int quantBits;							//8 or 16 to quantize the candidates, 0 to keep them as double
+	int statistics[GS2A_STATISTIC_NUM];		//the statistics computed from each correlation vector, mean only by default
+	int statisticNum;
+	double *controls;						//controlNum arrays of the samples of expressions, projected out of every row for partial
+	int controlNum;							//correlations. Pearson and dense data only
+	CONTROL_BASIS_STRUCT controlBasis;		//q is NULL without controls
+	DATA_MATRIX_STRUCT expressions;			//matrix is NULL for sparse or quantized expression
+	DATA_MATRIX_STRUCT candidates;			//the unique candidate rows. matrix is NULL for packed, sparse, categorical or quantized candidates
+	SPARSE_ROWS_STRUCT sparseExpressions;	//rowStart is NULL for dense expression
+	SPARSE_ROWS_STRUCT sparseCandidates;	//rowStart is NULL for dense candidates
+	int candidateNum;						//candidates before the repeated rows are removed
+	ID_INFO_STRUCT *candidateInfo;			//IDs of all candidateNum candidates
+	int *candidateProfiles;					//candidateProfiles[i]: the unique candidate row of candidate i
+	int *candidateGenes;					//candidateGenes[i]: the expression row of the gene of candidate i, masked in its score, or -1
+	double *expressionNorms;				//centered norms of the sparse expression rows
+	KENDALL_ROWS_STRUCT kendallRows;
+	MI_ROWS_STRUCT mutualInfoRows;
+	BIT_ROWS_STRUCT binaryCandidates;		//bits is NULL for other candidates
+	CATEGORY_ROWS_STRUCT categoryCandidates;	//codes is NULL for other candidates
+	QUANT_ROWS_STRUCT quantCandidates;		//sums is NULL for other candidates
+	QUANT_ROWS_STRUCT quantExpressions;
+	char *error;							//the reason of the last failure
+}GS2A_CONTEXT_STRUCT;
+
+//Return the correlation measure of a name (pearson, spearman, bicor, kendall, mi or eta), -1 if none
+int ParseCorrelationMethod(char *name);
+
+//Return the name of a correlation measure
+char *CorrelationMethodName(int correlationMethod);
+
+//Parse a comma separated list of statistic names into statistics. Return the number of statistics, -1 if a name is unknown or repeated
+int ParseStatistics(char *names, int *statistics);
+
+//Start an empty context
+void InitGS2AContext(GS2A_CONTEXT_STRUCT *context, int correlationMethod, int threadNum, int quantBits);
+
+//Prepare the data filled in a context: keep the IDs of the candidates, remove repeated candidate rows, and transform
+//the rows so that every correlation is a dot product or a prepared kernel. Return 1 if success, -1 if failure, with the reason in error
+int PrepareGS2AContext(GS2A_CONTEXT_STRUCT *context);
+
+//Free all data of a context
+void FreeGS2AContext(GS2A_CONTEXT_STRUCT *context);
+
+//Moments of the correlations of a feature with the geneNum genes, the targets against the others. Gene maskedGene is left out,
+//if not -1. Return 1 if success, -1 if there are no targets, no other genes, or no spread among the others
+int ComputeGS2AMoments(GS2A_MOMENTS_STRUCT *moments, double *corr, int geneNum, int *isTarget, int maskedGene);
+
+//GS2A score from the correlations of a feature with the geneNum genes: the mean correlation of the targets above the others,
+//in units of the standard deviation of the others, times sqrt(targets). Gene maskedGene is left out, if not -1
+double ComputeGS2AScore(double *corr, int geneNum, int *isTarget, int maskedGene);
+
+//Score candidates[0..candidateNum-1], positions among the candidates of the context, or all candidates if candidates is NULL,
+//against the genes with isTarget set, by every statistic of the context. The p-values are set to 1. Return 1 if success, -1 if failure
+int GS2AScoreBatch(GS2A_CONTEXT_STRUCT *context, int *isTarget, int *candidates, int candidateNum, CANDIDATE_SCORE_STRUCT *scores);
+
+//Correlate the permutations first..first+permutationNum-1 with all genes, into permutedCorr[k*geneNum]. Permutation p draws a
+//candidate and permutes it from its own random stream (seed, p), so the result depends neither on the threads nor on how the
+//permutations are split into calls. The correlations do not depend on the targets. Return 1 if success, -1 if failure
+int GS2APermute(GS2A_CONTEXT_STRUCT *context, long seed, int first, int permutationNum, double *permutedCorr);
+
+//Absolute scores of permutationNum permuted correlation vectors against the genes with isTarget set, randScores[s*permutationNum+k]
+//for statistic s of the context
+void GS2ANullScores(GS2A_CONTEXT_STRUCT *context, int *isTarget, double *permutedCorr, int permutationNum, double *randScores);
+
+//Set the p-values of candidateNum scores from permutationNum random scores of each of statisticNum statistics, laid out as by
+//GS2ANullScores. The random scores are sorted. Return 1 if success, -1 if failure
+int AssignPermutationP(CANDIDATE_SCORE_STRUCT *scores, int candidateNum, double *randScores, int permutationNum, int statisticNum);
+
+//Set the p-values of candidateNum scores from permutationNum permutations, correlated a few blocks at a time. Return 1 if success, -1 if failure
+int GS2APermutationP(GS2A_CONTEXT_STRUCT *context, int *isTarget, long seed, int permutationNum, CANDIDATE_SCORE_STRUCT *scores, int candidateNum);
+
+//Write the scores as a table to an open stream: ID, isSignature, and a score and a p-value column per statistic, named by the
+//statistic if there are several. Return 1 if success, 0 if failure
+int WriteGS2AScores(FILE *fh, CANDIDATE_SCORE_STRUCT *candidateScores, int candNum, int *statistics, int statisticNum);
+
+#endif
@@ -7,27 +7,43 @@
  *
  */
 
+#ifndef MATH_API_H
+#define MATH_API_H
+
+#include "rng_stream.h"
+
 typedef struct
 {
 	double value;
 	int index;
 }INDEXED_FLOAT;
 
-//Quicksort an array in real values, in ascending order
+//Quicksort an array in real values, in ascending order. Sorts a[lo..hi] with SortF (introsort or radix sort, see sort.h)
 void QuicksortF(double *a, int lo, int hi);
 
-//Quicksort an indexed array, in ascending order 
+//Quicksort an indexed array, in ascending order. Sorts a[lo..hi] with SortIndexedArray
 void QuicksortIndexedArray(INDEXED_FLOAT *a, int lo, int hi);
 
 //BTreeSearchingF: Searching value in array, which was organized in ascending order previously
 int  bTreeSearchingF(double value, double *a, int lo, int hi);
 
-//Rank the values in a float array and store the rank values in an integer array
+//Rank the values in a float array and store the rank values in an integer array. Tied values share the middle rank of their run, rounded down
 void Ranking(int *rank, double *values, int sampleNum);
 
+//Rank the values with one indexed sort. rank2 receives twice the 0-based average rank of each value (first+last position of its run of ties),
+//which is exact in integers. sortBuf: workspace of sampleNum items
+void DoubledRanking(int *rank2, double *values, INDEXED_FLOAT *sortBuf, int sampleNum);
+
+//Rank the values with one indexed sort. Tied values share the average of their 0-based ranks. rank can be values.
+//sortBuf and rank2: workspace of sampleNum items
+void AverageRanking(double *rank, double *values, INDEXED_FLOAT *sortBuf, int *rank2, int sampleNum);
+
 //Normal score transform
 int NormalTransform(double *destA, int *rank, int sampleNum);
 
+//Inverse of the standard normal CDF (Acklam's rational approximation, from Ziegler's code)
+double normalInv(double p);
+
 //Compute distance correlation. dim: number of samples; inputNum: number of variables in the input; input: the input array with inputNum*dim items; output: the output array
 double ComputeDistanceCorrelation(double *input, double *output, int inputNum, int dim);
 
@@ -37,5 +53,16 @@ double PearsonCorrel(double *a, double *b, int dim);
 //Partial correlation
 double PartialCorrel(double *a, double *b, double *control, int dim);
 
+//Center an array and scale it to unit norm, so that the Pearson correlation of two standardized arrays is their dot product. Return the norm of the centered array. An array with zero variance is set to zeros
+double StandardizeArray(double *destA, double *srcA, int dim);
+
+//Dot product of two arrays
+double DotProduct(double *a, double *b, int dim);
+
 //Randomly permute an array of float values
-void PermuteFloatArrays(double *a, int size);
\ No newline at end of file
+void PermuteFloatArrays(double *a, int size);
+
+//Randomly permute an array of float values, drawing from a reentrant stream
+void PermuteFloatArraysStream(double *a, int size, RNG_STREAM_STRUCT *rng);
+
+#endif
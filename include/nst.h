@@ -0,0 +1,29 @@
+/*
+ *  nst.h
+ *  Table-driven, multithreaded Normal Score Transform
+ *
+ */
+
+#ifndef NST_H
+#define NST_H
+
+#include "math_api.h"
+
+//Build the half-rank normal score table of a row length: table[k] = normalInv((k/2+0.5)/sampleNum), k = 0..2*sampleNum-2,
+//where k is twice the average rank. Return 1 if success, -1 if failure
+int BuildNormalScoreTable(double *table, int sampleNum);
+
+//Normal score transform of one row with a prebuilt half-rank table. The row is ranked by one indexed sort, and tied values
+//share the normal score of their average rank. destA can be srcA. sortBuf and rankBuf: workspace of sampleNum items
+void NSTNormRow(double *destA, double *srcA, int sampleNum, double *table, INDEXED_FLOAT *sortBuf, int *rankBuf);
+
+//Normal score transform of every row of a geneNum*sampleNum matrix in place, with threadNum threads. Return 1 if success, -1 if failure
+int NSTNormMatrix(double *data, int geneNum, int sampleNum, int threadNum);
+
+//Normal score transform of a data matrix file (header row of sample names, then one record per row) into another,
+//without loading the matrix. A reader thread, threadNum worker threads and the calling thread as the ordered writer
+//share a ring of rows, so memory depends on the sample number but not the record number. Like ReadDataMatrix, reading
+//stops at the first row without sampleNum values. Return the number of records, or -1 if failure
+int NSTNormStream(char *inputFileName, char *outputFileName, int threadNum, int *pSampleNum);
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ *  rng_stream.h
+ *  Reentrant random number streams for multithreaded code
+ *
+ */
+
+#ifndef RNG_STREAM_H
+#define RNG_STREAM_H
+
+//State of one stream. Unlike rngs.c, all state is in the structure, so each thread or task can own a stream
+typedef struct
+{
+	unsigned long long state;
+}RNG_STREAM_STRUCT;
+
+//Seed a stream from a base seed and a stream index. The same (seed, index) always gives the same sequence, and different indices give independent sequences
+void InitRngStream(RNG_STREAM_STRUCT *rng, long seed, long index);
+
+//Return a pseudo-random real number uniformly distributed between 0.0 and 1.0 (both excluded)
+double RandomStream(RNG_STREAM_STRUCT *rng);
+
+//Return a pseudo-random integer uniformly distributed between 0 and n-1
+long EquilikelyStream(RNG_STREAM_STRUCT *rng, long n);
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ *  sort.h
+ *  Introsort and LSD radix sort for real values and indexed real values
+ *
+ */
+
+#ifndef SORT_H
+#define SORT_H
+
+#include "math_api.h"
+
+//Introsort a real array in ascending order: median-of-three quicksort that falls back to heapsort past 2*log2(num) levels,
+//and finishes short ranges with insertion sort. O(num*log(num)) in the worst case, including sorted and tie-heavy input
+void IntroSortF(double *a, int num);
+
+//Introsort an indexed array by value in ascending order
+void IntroSortIndexedArray(INDEXED_FLOAT *a, int num);
+
+//LSD radix sort of a real array in ascending order, 8 bits per pass on the order-preserving bit pattern of the values.
+//Passes in which all keys share one digit are skipped. Return 1 if success, -1 if failure
+int RadixSortF(double *a, int num);
+
+//LSD radix sort of an indexed array by value in ascending order. Stable. Return 1 if success, -1 if failure
+int RadixSortIndexedArray(INDEXED_FLOAT *a, int num);
+
+//Rearrange a real array so that a[k] is the value a sorted array would hold there, no larger values before it and no
+//smaller values after it. Quickselect with median-of-three pivots, introsort past 2*log2(num) levels. Return a[k]
+double SelectF(double *a, int num, int k);
+
+//Median of a real array, the mean of the two middle values for an even length. The array is rearranged
+double MedianF(double *a, int num);
+
+//Sort a real array in ascending order, with radix sort for long arrays and introsort otherwise
+void SortF(double *a, int num);
+
+//Sort an indexed array by value in ascending order, with radix sort for long arrays and introsort otherwise
+void SortIndexedArray(INDEXED_FLOAT *a, int num);
+
+#endif
@@ -4,37 +4,55 @@
 #include <memory.h>
 #include <assert.h>
 #include <float.h>
-#include "rngs.h"
-#include "rvgs.h"
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include "math_api.h"
-#include "dataMatrix.h"
+#include "format.h"
+#include "gs2a.h"
 
 #define PERMUTATION_NUM 1000
 
+#define PERMUTATION_SEED 123456
+
+//candidate file formats of -f
+enum {CANDIDATE_DENSE, CANDIDATE_SPARSE};
+
+//expression file formats of -e
+enum {EXPRESSION_DENSE, EXPRESSION_MTX};
+
+//State of the query server: the prepared context, indexes of the gene and candidate IDs, and the correlations of the permuted
+//candidates, which do not depend on the targets of a query
 typedef struct
 {
-	ID_INFO_STRUCT *id;
-	double score;
-	double pValue;
-}CANDIDATE_SCORE_STRUCT;
+	GS2A_CONTEXT_STRUCT *context;
+	ID_INDEX_STRUCT geneIndex;
+	ID_INDEX_STRUCT candidateIndex;
+	double *permutedCorr;
+	int permutationNum;
+}GS2A_SERVER_STRUCT;
 
 //Search in gene expression data structures to mark a list of IDs in a file.
 int MarkIDs(char *fileName, DATA_MATRIX_STRUCT *data);
 
-//Compute GS2A score for a candidate feature
-double ComputeGS2AScore(DATA_MATRIX_STRUCT *expressionMatrix, 
-						double *feature, 
-						int featureSize,
-						char *maskedID);
+//Write to output file
+int WriteToOutput(char *fileName, CANDIDATE_SCORE_STRUCT *candidateScores, int candNum, int *statistics, int statisticNum);
 
-//Compute scores for all candidates and store the values in candidate score structure
-int ComputeScoreMain(DATA_MATRIX_STRUCT *expressionMatrix, DATA_MATRIX_STRUCT *candidateMatrix, CANDIDATE_SCORE_STRUCT *candidateScores);
+//Mark the IDs of a query, a comma separated list or, if isFile, a file of IDs, in marks[] by their positions in the index.
+//Return the number of IDs newly marked, -1 if the file cannot be opened
+int MarkQueryIDs(char *value, int isFile, ID_INDEX_STRUCT *index, int *marks);
 
-//Compute p-values for candidates based on permutation
-int ComputePermutationP(DATA_MATRIX_STRUCT *expressionMatrix, DATA_MATRIX_STRUCT *candidateMatrix, CANDIDATE_SCORE_STRUCT *candidateScores, int candidateNum, int permutationNum);
+//Answer one query line of key=value words, writing OK and the scores, or ERROR and the reason, to out. Return 1 if answered, -1 if not
+int AnswerQuery(char *query, GS2A_SERVER_STRUCT *server, FILE *out);
 
-//Write to output file
-int WriteToOutput(char *fileName, CANDIDATE_SCORE_STRUCT *candidateScores, int candNum);
+//Answer the query lines read from in until its end or a quit line. Return 0 after quit, 1 otherwise
+int AnswerQueries(FILE *in, FILE *out, GS2A_SERVER_STRUCT *server);
+
+//Keep the prepared context, correlate permutationNum permuted candidates once, and answer queries on stdin if socketName is "-",
+//otherwise on a Unix domain socket, one connection at a time, until quit. Return 1 if success, -1 if failure
+int RunServer(char *socketName, GS2A_CONTEXT_STRUCT *context, int permutationNum);
 
 //print command usage 
 void PrintCommandUsage();
@@ -85,205 +103,464 @@ int MarkIDs(char *fileName, DATA_MATRIX_STRUCT *data)
 	
 	return matchedIDNum;
 }
+//Write to output file
+int WriteToOutput(char *fileName, CANDIDATE_SCORE_STRUCT *candidateScores, int candNum, int *statistics, int statisticNum)
+{
+	FILE *fh;
+	int result;
+	
+	fh = (FILE *)fopen(fileName, "w");
+	
+	if (!fh)
+	{
+		return 0;
+	}
+	
+	result = WriteGS2AScores(fh, candidateScores, candNum, statistics, statisticNum);
+	
+	if (fclose(fh)!=0)
+	{
+		result = 0;
+	}
+	
+	return result;
+}
 
-//Compute GS2A score for a candidate feature
-double ComputeGS2AScore(DATA_MATRIX_STRUCT *expressionMatrix, 
-					 double *feature, 
-					 int featureSize,
-					 char *maskedID)
+//Mark the IDs of a query, a comma separated list or, if isFile, a file of IDs, in marks[] by their positions in the index.
+//Return the number of IDs newly marked, -1 if the file cannot be opened
+int MarkQueryIDs(char *value, int isFile, ID_INDEX_STRUCT *index, int *marks)
 {
-	int i;
-	int geneNum = expressionMatrix->recordNum;
-	double *targetValues, *nonTargetValues;
-	int targetNum = 0, nonTargetNum = 0;
-	double targetMean, nonTargetMean, nonTargetStdev;
-		
-	assert(featureSize==expressionMatrix->sampleNum);
-	assert(featureSize>1);
-	assert(geneNum>1);
+	FILE *fh = NULL;
+	char tmpS[MAX_WORD_SIZE];
+	char *c;
+	int len, position, matchedIDNum;
 	
-	if (!((featureSize==expressionMatrix->sampleNum)&&(featureSize>1)&&(geneNum>1)))
+	if (isFile)
 	{
-		return 1;
+		fh = (FILE *)fopen(value, "r");
+		
+		if (!fh)
+		{
+			return -1;
+		}
 	}
 	
-	targetValues = (double *)malloc(geneNum*sizeof(double));
-	nonTargetValues = (double *)malloc(geneNum*sizeof(double));
+	matchedIDNum = 0;
+	c = value;
 	
-	assert((targetValues!=NULL)&&(nonTargetValues!=NULL));
+	while (1)
+	{
+		if (isFile)
+		{
+			if (fscanf(fh, "%254s", tmpS)!=1)
+			{
+				break;
+			}
+		}
+		else
+		{
+			if (*c==0)
+			{
+				break;
+			}
+			
+			len = (int)strcspn(c, ",");
+			memcpy(tmpS, c, (len<MAX_WORD_SIZE-1)?len:MAX_WORD_SIZE-1);
+			tmpS[(len<MAX_WORD_SIZE-1)?len:MAX_WORD_SIZE-1] = 0;
+			c += (c[len]==',')?len+1:len;
+		}
+		
+		position = FindID(index, tmpS);
+		
+		if ((position>=0)&&(!marks[position]))
+		{
+			marks[position] = 1;
+			matchedIDNum++;
+		}
+	}
 	
-	//Compute Correlation values
-	for (i=0;i<geneNum;i++)
+	if (fh)
 	{
-		if (!strcmp(expressionMatrix->recordInfo[i].name, maskedID))
+		fclose(fh);
+	}
+	
+	return matchedIDNum;
+}
+//Answer one query line of key=value words, writing OK and the scores, or ERROR and the reason, to out. Return 1 if answered, -1 if not
+int AnswerQuery(char *query, GS2A_SERVER_STRUCT *server, FILE *out)
+{
+	GS2A_CONTEXT_STRUCT *context = server->context;
+	int geneNum = context->expressions.recordNum;
+	char *word, *value, *position;
+	char *targets, *candidates, *outputFileName, *error;
+	int targetsIsFile, candidatesIsFile, permutationNum;
+	int *geneMarks, *candidateMarks;
+	int *queryCandidates;
+	CANDIDATE_SCORE_STRUCT *queryScores;
+	double *randScores;
+	int targetNum, queryNum, result, m;
+	
+	targets = NULL;
+	candidates = NULL;
+	outputFileName = NULL;
+	targetsIsFile = 0;
+	candidatesIsFile = 0;
+	permutationNum = server->permutationNum;
+	error = NULL;
+	
+	for (word=strtok_r(query, " \t\r\n", &position);(word!=NULL)&&(error==NULL);word=strtok_r(NULL, " \t\r\n", &position))
+	{
+		value = strchr(word, '=');
+		
+		if (value==NULL)
 		{
-			continue;
+			error = "a query is a line of key=value words";
+			break;
 		}
 		
-		if (expressionMatrix->recordInfo[i].flag)
+		*(value++) = 0;
+		
+		if ((strcmp(word, "targets")==0)||(strcmp(word, "target_file")==0))
+		{
+			targets = value;
+			targetsIsFile = (strcmp(word, "target_file")==0);
+		}
+		else if ((strcmp(word, "candidates")==0)||(strcmp(word, "candidate_file")==0))
+		{
+			candidates = value;
+			candidatesIsFile = (strcmp(word, "candidate_file")==0);
+		}
+		else if (strcmp(word, "permutations")==0)
 		{
-			targetValues[targetNum] = PearsonCorrel(feature, &(expressionMatrix->matrix[i*featureSize]), featureSize);
-			targetNum++;
+			permutationNum = atoi(value);
+		}
+		else if (strcmp(word, "method")==0)
+		{
+			if (strcmp(value, CorrelationMethodName(context->correlationMethod))!=0)
+			{
+				error = "the method of a query must be the -m of the server";
+			}
+		}
+		else if (strcmp(word, "output")==0)
+		{
+			outputFileName = value;
 		}
 		else
 		{
-			nonTargetValues[nonTargetNum] = PearsonCorrel(feature, &(expressionMatrix->matrix[i*featureSize]), featureSize);
-			nonTargetNum++;
+			error = "unknown key, expected targets, target_file, candidates, candidate_file, permutations, method or output";
 		}
 	}
 	
-	assert((targetNum>0)&&(nonTargetNum>0));
-	
-	if (!((targetNum>0)&&(nonTargetNum>0)))
+	if ((error==NULL)&&(targets==NULL))
 	{
-		free(targetValues);
-		free(nonTargetValues);
-		return 0;
+		error = "no targets or target_file";
 	}
 	
-	targetMean = 0;
+	if ((error==NULL)&&((permutationNum<=0)||(permutationNum>server->permutationNum)))
+	{
+		error = "permutations must be between 1 and the -n of the server";
+	}
 	
-	for (i=0;i<targetNum;i++)
+	if (error!=NULL)
 	{
-		targetMean += targetValues[i];
+		fprintf(out, "ERROR %s\n", error);
+		fflush(out);
+		return -1;
 	}
 	
-	targetMean /= targetNum;
+	geneMarks = (int *)calloc(geneNum+1, sizeof(int));
+	candidateMarks = (int *)calloc(context->candidateNum+1, sizeof(int));
 	
-	nonTargetMean = 0;
+	assert((geneMarks!=NULL)&&(candidateMarks!=NULL));
 	
-	for (i=0;i<nonTargetNum;i++)
+	if ((geneMarks==NULL)||(candidateMarks==NULL))
 	{
-		nonTargetMean += nonTargetValues[i];
+		free(geneMarks);
+		free(candidateMarks);
+		fprintf(out, "ERROR cannot allocate memory\n");
+		fflush(out);
+		return -1;
 	}
 	
-	nonTargetMean /= nonTargetNum;
-	
-	nonTargetStdev = 0;
+	//the targets mark the signature genes, which the context is scored against without changing it
+	targetNum = MarkQueryIDs(targets, targetsIsFile, &(server->geneIndex), geneMarks);
 	
-	for (i=0;i<nonTargetNum;i++)
+	if (candidates!=NULL)
 	{
-		nonTargetStdev += (nonTargetValues[i]-nonTargetMean)*(nonTargetValues[i]-nonTargetMean);
+		queryNum = MarkQueryIDs(candidates, candidatesIsFile, &(server->candidateIndex), candidateMarks);
+	}
+	else
+	{
+		for (m=0;m<context->candidateNum;m++)
+		{
+			candidateMarks[m] = 1;
+		}
+		
+		queryNum = context->candidateNum;
 	}
 	
-	nonTargetStdev = sqrt(nonTargetStdev/nonTargetNum);
-	
-	free(targetValues);
-	free(nonTargetValues);
+	//a masked candidate gene leaves at least one target and one other gene to score against
+	if (targetNum<0)
+	{
+		error = "cannot open the target file";
+	}
+	else if ((targetNum<2)||(targetNum>geneNum-2))
+	{
+		error = "at least 2 target genes and 2 other genes are needed in the expression data";
+	}
+	else if (queryNum<0)
+	{
+		error = "cannot open the candidate file";
+	}
+	else if (queryNum==0)
+	{
+		error = "no candidate found";
+	}
 	
-	return (targetMean-nonTargetMean)/nonTargetStdev*sqrt(targetNum);
-}
+	if (error!=NULL)
+	{
+		free(geneMarks);
+		free(candidateMarks);
+		fprintf(out, "ERROR %s\n", error);
+		fflush(out);
+		return -1;
+	}
 	
-//Compute p-values for candidates based on permutation
-int ComputePermutationP(DATA_MATRIX_STRUCT *expressionMatrix, DATA_MATRIX_STRUCT *candidateMatrix, CANDIDATE_SCORE_STRUCT *candidateScores, int candidateNum, int permutationNum)
-{
-	int i;	
-	double *randScore;
-	int sampleNum = candidateMatrix->sampleNum;
-	double *tmpFeature;
-	int tmpIndex;
+	queryCandidates = (int *)malloc(queryNum*sizeof(int));
+	queryScores = (CANDIDATE_SCORE_STRUCT *)malloc(queryNum*sizeof(CANDIDATE_SCORE_STRUCT));
+	randScores = (double *)malloc((size_t)context->statisticNum*permutationNum*sizeof(double));
 	
-	assert(expressionMatrix->sampleNum==candidateMatrix->sampleNum);
+	assert((queryCandidates!=NULL)&&(queryScores!=NULL)&&(randScores!=NULL));
 	
-	if (expressionMatrix->sampleNum!=candidateMatrix->sampleNum)
+	if ((queryCandidates==NULL)||(queryScores==NULL)||(randScores==NULL))
 	{
+		free(geneMarks);
+		free(candidateMarks);
+		free(queryCandidates);
+		free(queryScores);
+		free(randScores);
+		fprintf(out, "ERROR cannot allocate memory\n");
+		fflush(out);
 		return -1;
 	}
 	
-	randScore = (double *)malloc(permutationNum*sizeof(double));
-	tmpFeature = (double *)malloc(sampleNum*sizeof(double));
+	//the queried candidates in the order of the candidate file
+	queryNum = 0;
 	
-	assert((randScore!=NULL)&&(tmpFeature!=NULL));
-	
-	for (i=0;i<permutationNum;i++)
+	for (m=0;m<context->candidateNum;m++)
 	{
-		tmpIndex = (int)Uniform(0, candidateMatrix->recordNum);
-		tmpIndex = tmpIndex<0?0:(tmpIndex>=candidateMatrix->recordNum?candidateMatrix->recordNum-1:tmpIndex);
-		
-		memcpy(tmpFeature, candidateMatrix->matrix+tmpIndex*sampleNum, sampleNum*sizeof(double));
-		PermuteFloatArrays(tmpFeature,sampleNum);
-		
-		randScore[i] = fabs(ComputeGS2AScore(expressionMatrix, tmpFeature, sampleNum, ""));
+		if (candidateMarks[m])
+		{
+			queryCandidates[queryNum++] = m;
+		}
 	}
 	
-	QuicksortF(randScore, 0, permutationNum-1);
+	result = GS2AScoreBatch(context, geneMarks, queryCandidates, queryNum, queryScores);
+	
+	//the null scores are the kept permuted correlations scored against the targets of the query
+	GS2ANullScores(context, geneMarks, server->permutedCorr, permutationNum, randScores);
 	
-	for (i=0;i<candidateNum;i++)
+	if (result<=0)
 	{
-		candidateScores[i].pValue = (double)(permutationNum-1-bTreeSearchingF(fabs(candidateScores[i].score), randScore, 0, permutationNum-1))/permutationNum;
+		fprintf(out, "ERROR %s\n", context->error);
 	}
-
-	free(randScore);
-	free(tmpFeature);
-	return 1;
-}
-
-//Compute scores for all candidates and store the values in candidate score structure
-int ComputeScoreMain(DATA_MATRIX_STRUCT *expressionMatrix, DATA_MATRIX_STRUCT *candidateMatrix, CANDIDATE_SCORE_STRUCT *candidateScores)
-{
-	int i;
-	double *weights;
-
-	assert(expressionMatrix->sampleNum==candidateMatrix->sampleNum);
-	
-	if (expressionMatrix->sampleNum!=candidateMatrix->sampleNum)
+	else if (AssignPermutationP(queryScores, queryNum, randScores, permutationNum, context->statisticNum)<=0)
 	{
-		return -1;
+		fprintf(out, "ERROR cannot compute the permutation p-values\n");
+	}
+	else if (outputFileName!=NULL)
+	{
+		if (WriteToOutput(outputFileName, queryScores, queryNum, context->statistics, context->statisticNum))
+		{
+			fprintf(out, "OK %d %s\n", queryNum, outputFileName);
+		}
+		else
+		{
+			fprintf(out, "ERROR cannot write to %s\n", outputFileName);
+		}
+	}
+	else
+	{
+		fprintf(out, "OK %d\n", queryNum);
+		fflush(out);
+		WriteGS2AScores(out, queryScores, queryNum, context->statistics, context->statisticNum);
 	}
 	
-	weights = (double *)malloc(expressionMatrix->recordNum*sizeof(double));
+	fflush(out);
 	
-	assert(weights!=NULL);
+	free(geneMarks);
+	free(candidateMarks);
+	free(queryCandidates);
+	free(queryScores);
+	free(randScores);
 	
-	for (i=0;i<expressionMatrix->recordNum;i++)
-	{
-		weights[i] = 1.0;
-	}
+	return 1;
+}
+
+//Answer the query lines read from in until its end or a quit line. Return 0 after quit, 1 otherwise
+int AnswerQueries(FILE *in, FILE *out, GS2A_SERVER_STRUCT *server)
+{
+	char *line = NULL;
+	size_t lineSize = 0;
+	char *query;
 	
-	for (i=0;i<candidateMatrix->recordNum;i++)
+	while (getline(&line, &lineSize, in)>=0)
 	{
-		candidateScores[i].score = ComputeGS2AScore(expressionMatrix, 
-						 candidateMatrix->matrix+i*(candidateMatrix->sampleNum), 
-						 candidateMatrix->sampleNum, 
-						 candidateMatrix->recordInfo[i].name);
-		candidateScores[i].id = candidateMatrix->recordInfo+i;
-		candidateScores[i].pValue = 1;
+		query = line+strspn(line, " \t\r\n");
+		
+		//blank lines and comments are skipped
+		if ((*query==0)||(*query=='#'))
+		{
+			continue;
+		}
+		
+		if ((strncmp(query, "quit", 4)==0)&&(strspn(query+4, " \t\r\n")==strlen(query+4)))
+		{
+			fprintf(out, "OK quit\n");
+			fflush(out);
+			free(line);
+			return 0;
+		}
+		
+		AnswerQuery(query, server, out);
 	}
 	
-	free(weights);
+	free(line);
 	
 	return 1;
 }
 
-//Write to output file
-int WriteToOutput(char *fileName, CANDIDATE_SCORE_STRUCT *candidateScores, int candNum)
+//Keep the prepared data, correlate permutationNum permuted candidates once, and answer queries on stdin if socketName is "-",
+//otherwise on a Unix domain socket, one connection at a time, until quit. Return 1 if success, -1 if failure
+int RunServer(char *socketName, GS2A_CONTEXT_STRUCT *context, int permutationNum)
 {
-	FILE *fh;
-	int i;
+	GS2A_SERVER_STRUCT server;
+	struct sockaddr_un address;
+	struct stat fileStat;
+	FILE *in, *out;
+	int listenFd, connectionFd, isRunning;
 	
-	fh = (FILE *)fopen(fileName, "w");
+	server.context = context;
+	server.permutationNum = permutationNum;
+	server.permutedCorr = (double *)malloc((size_t)permutationNum*context->expressions.recordNum*sizeof(double));
 	
-	if (!fh)
+	assert(server.permutedCorr!=NULL);
+	
+	if ((server.permutedCorr==NULL)||(BuildIDIndex(&(server.geneIndex), context->expressions.recordInfo, context->expressions.recordNum)<=0))
 	{
-		return 0;
+		printf("ERROR: cannot allocate memory for %d permutations!\n", permutationNum);
+		free(server.permutedCorr);
+		return -1;
 	}
 	
-	fprintf(fh, "ID\tisSignature\tscore\tpValue\n");
+	if (BuildIDIndex(&(server.candidateIndex), context->candidateInfo, context->candidateNum)<=0)
+	{
+		printf("ERROR: cannot allocate memory for the candidate index!\n");
+		FreeIDIndex(&(server.geneIndex));
+		free(server.permutedCorr);
+		return -1;
+	}
 	
-	for (i=0;i<candNum;i++)
+	printf("Permutation......\n");
+	
+	if (GS2APermute(context, PERMUTATION_SEED, 0, permutationNum, server.permutedCorr)<=0)
 	{
-		fprintf(fh, "%s\t%d\t%f\t%f\n", 
-				candidateScores[i].id->name,
-				candidateScores[i].id->flag,
-				candidateScores[i].score,
-				candidateScores[i].pValue);
+		printf("ERROR: %s!\n", context->error);
+		FreeIDIndex(&(server.geneIndex));
+		FreeIDIndex(&(server.candidateIndex));
+		free(server.permutedCorr);
+		return -1;
 	}
 	
-	fclose(fh);
+	if (strcmp(socketName, "-")==0)
+	{
+		printf("Ready for queries on stdin.\n");
+		fflush(stdout);
+		
+		AnswerQueries(stdin, stdout, &server);
+	}
+	else
+	{
+		listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		
+		//a socket left by an earlier server is replaced, any other file is kept
+		if ((stat(socketName, &fileStat)==0)&&S_ISSOCK(fileStat.st_mode))
+		{
+			unlink(socketName);
+		}
+		
+		if ((listenFd<0)||(strlen(socketName)>=sizeof(address.sun_path)))
+		{
+			printf("ERROR: cannot create socket %s!\n", socketName);
+		}
+		else
+		{
+			strcpy(address.sun_path, socketName);
+			
+			if ((bind(listenFd, (struct sockaddr *)&address, sizeof(address))<0)||(listen(listenFd, 16)<0))
+			{
+				printf("ERROR: cannot listen on socket %s!\n", socketName);
+			}
+			else
+			{
+				//a client closing its connection early must not end the server
+				signal(SIGPIPE, SIG_IGN);
+				
+				printf("Ready for queries on %s.\n", socketName);
+				fflush(stdout);
+				
+				isRunning = 1;
+				
+				while (isRunning)
+				{
+					connectionFd = accept(listenFd, NULL, NULL);
+					
+					if (connectionFd<0)
+					{
+						continue;
+					}
+					
+					in = fdopen(connectionFd, "r");
+					out = fdopen(dup(connectionFd), "w");
+					
+					if ((in!=NULL)&&(out!=NULL))
+					{
+						isRunning = AnswerQueries(in, out, &server);
+					}
+					
+					if (in!=NULL)
+					{
+						fclose(in);
+					}
+					else
+					{
+						close(connectionFd);
+					}
+					
+					if (out!=NULL)
+					{
+						fclose(out);
+					}
+				}
+				
+				unlink(socketName);
+			}
+		}
+		
+		if (listenFd>=0)
+		{
+			close(listenFd);
+		}
+	}
+	
+	FreeIDIndex(&(server.geneIndex));
+	FreeIDIndex(&(server.candidateIndex));
+	free(server.permutedCorr);
 	
 	return 1;
 }
-
 //print command usage 
 void PrintCommandUsage()
 {
@@ -294,6 +571,29 @@ void PrintCommandUsage()
 	printf("-t <target gene id file>\n");
 	printf("-c <candidate data file>\n");
 	printf("-o <output file>\n");
+	printf("-m <correlation: pearson, spearman, bicor, kendall, mi or eta> (optional, default: pearson. bicor: biweight midcorrelation,\n");
+	printf("   mi: mutual information, eta: eta-squared of the genes by candidate category, for candidates of at most %d distinct values)\n", CATEGORY_MAX_NUM);
+	printf("-p <number of threads> (optional, default: number of processors)\n");
+	printf("-a <statistics: a comma separated list of mean and chisq> (optional, default: mean. mean: the GS2A score, the mean shift of\n");
+	printf("   the targets in units of the standard deviation of the other genes. chisq: the chi-square variance ratio of the targets.\n");
+	printf("   All are computed from the same correlations, with a score and a p-value column each when there are several)\n");
+	printf("-r <control gene name, or a comma-separated list of names> (optional, partial correlations given the controls. pearson,\n");
+	printf("   dense data only)\n");
+	printf("-k <covariate data file, controlled for in addition to -r> (optional)\n");
+	printf("-f <candidate format: dense or sparse> (optional, default: dense. sparse: a row per candidate of ID and column:value\n");
+	printf("   entries for its nonzeros, column being the 1-based sample index in the header. pearson only)\n");
+	printf("-e <expression format: dense or mtx> (optional, default: dense. mtx: a Matrix Market coordinate file of genes by samples,\n");
+	printf("   such as single-cell counts, with -g and -s. pearson only)\n");
+	printf("-g <gene ID file of mtx expression, one per line>\n");
+	printf("-s <sample ID file of mtx expression, one per line>\n");
+	printf("-q <candidate storage: double, int16 or int8> (optional, default: double. int16 and int8 quantize every candidate row,\n");
+	printf("   and the expression rows to int16. pearson or spearman, dense candidates only)\n");
+	printf("-n <number of permutations> (optional, default: %d)\n", PERMUTATION_NUM);
+	printf("-S <Unix domain socket, or - for stdin> (optional. Server mode: the data are prepared and the permutations correlated once,\n");
+	printf("   then each query line of key=value words is answered by OK <candidate number> and the output table, or ERROR <reason>.\n");
+	printf("   Keys: targets=<id,id,...> or target_file=<file>, candidates=<id,...> or candidate_file=<file> (default: all),\n");
+	printf("   permutations=<at most -n>, method=<the -m of the server>, output=<file> to write the table there. quit stops the server.\n");
+	printf("   -t and -o are not used)\n");
 	printf("example:\n");
 	printf("GS2A -d expression.txt -t target.txt -c candidate.txt -o output.txt \n");
 }
@@ -301,11 +601,21 @@ void PrintCommandUsage()
 int main (int argc, const char * argv[]) 
 {
 	char expressionFileName[1000], targetIDFileName[1000], candidateFileName[1000], outputFileName[1000];
+	char geneIDFileName[1000], sampleIDFileName[1000], socketName[1000], knownRegulatorName[1000], covariateFileName[1000];
 	DATA_MATRIX_STRUCT expressions;
 	DATA_MATRIX_STRUCT candidate;
-	DATA_MATRIX_STRUCT expressionTrimmed;
-	DATA_MATRIX_STRUCT candidateTrimmed;
+	DATA_MATRIX_STRUCT covariates;
+	SPARSE_ROWS_STRUCT candidateRows;
+	SPARSE_ROWS_STRUCT expressionRows;
+	GS2A_CONTEXT_STRUCT context;
 	CANDIDATE_SCORE_STRUCT *candScores;
+	int *isTarget;
+	int candidateFormat, expressionFormat;
+	int correlationMethod, threadNum;
+	int statistics[GS2A_STATISTIC_NUM];
+	int statisticNum;
+	int quantBits;
+	int permutationNum;
 	int matchedIDNum;
 	int i;
 	
@@ -320,6 +630,21 @@ int main (int argc, const char * argv[])
 	targetIDFileName[0] = 0;
 	candidateFileName[0] = 0;
 	outputFileName[0] = 0;
+	geneIDFileName[0] = 0;
+	sampleIDFileName[0] = 0;
+	socketName[0] = 0;
+	knownRegulatorName[0] = 0;
+	covariateFileName[0] = 0;
+	permutationNum = PERMUTATION_NUM;
+	correlationMethod = CORRELATION_PEARSON;
+	statistics[0] = GS2A_STAT_MEAN;
+	statisticNum = 1;
+	threadNum = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	candidateFormat = CANDIDATE_DENSE;
+	quantBits = 0;
+	expressionFormat = EXPRESSION_DENSE;
+	memset(&candidateRows, 0, sizeof(SPARSE_ROWS_STRUCT));
+	memset(&expressionRows, 0, sizeof(SPARSE_ROWS_STRUCT));
 	
 	for (i=2;i<argc;i++)
 	{
@@ -339,20 +664,111 @@ int main (int argc, const char * argv[])
 		{
 			strcpy(outputFileName, argv[i]);
 		}
+		if (strcmp(argv[i-1], "-g")==0)
+		{
+			strcpy(geneIDFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-s")==0)
+		{
+			strcpy(sampleIDFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-S")==0)
+		{
+			strcpy(socketName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-r")==0)
+		{
+			strcpy(knownRegulatorName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-k")==0)
+		{
+			strcpy(covariateFileName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-a")==0)
+		{
+			statisticNum = ParseStatistics((char *)argv[i], statistics);
+		}
+		if (strcmp(argv[i-1], "-n")==0)
+		{
+			permutationNum = atoi(argv[i]);
+		}
+		if (strcmp(argv[i-1], "-e")==0)
+		{
+			if (strcmp(argv[i], "dense")==0)
+			{
+				expressionFormat = EXPRESSION_DENSE;
+			}
+			else if (strcmp(argv[i], "mtx")==0)
+			{
+				expressionFormat = EXPRESSION_MTX;
+			}
+			else
+			{
+				expressionFormat = -1;
+			}
+		}
+		if (strcmp(argv[i-1], "-m")==0)
+		{
+			correlationMethod = ParseCorrelationMethod((char *)argv[i]);
+		}
+		if (strcmp(argv[i-1], "-p")==0)
+		{
+			threadNum = atoi(argv[i]);
+		}
+		if (strcmp(argv[i-1], "-q")==0)
+		{
+			if (strcmp(argv[i], "double")==0)
+			{
+				quantBits = 0;
+			}
+			else if (strcmp(argv[i], "int16")==0)
+			{
+				quantBits = 16;
+			}
+			else if (strcmp(argv[i], "int8")==0)
+			{
+				quantBits = 8;
+			}
+			else
+			{
+				quantBits = -1;
+			}
+		}
+		if (strcmp(argv[i-1], "-f")==0)
+		{
+			if (strcmp(argv[i], "dense")==0)
+			{
+				candidateFormat = CANDIDATE_DENSE;
+			}
+			else if (strcmp(argv[i], "sparse")==0)
+			{
+				candidateFormat = CANDIDATE_SPARSE;
+			}
+			else
+			{
+				candidateFormat = -1;
+			}
+		}
 	}
 	
-	if ((expressionFileName[0]==0)||(targetIDFileName[0]==0)||(candidateFileName[0]==0)||(outputFileName[0]==0))
+	if ((expressionFileName[0]==0)||(candidateFileName[0]==0)||((socketName[0]==0)&&((targetIDFileName[0]==0)||(outputFileName[0]==0)))
+		||(correlationMethod<0)||(threadNum<=0)||(permutationNum<=0)
+		||(candidateFormat<0)||((candidateFormat==CANDIDATE_SPARSE)&&(correlationMethod!=CORRELATION_PEARSON))||(quantBits<0)
+		||((quantBits>0)&&(((correlationMethod!=CORRELATION_PEARSON)&&(correlationMethod!=CORRELATION_SPEARMAN))||(candidateFormat!=CANDIDATE_DENSE)))
+		||(expressionFormat<0)||((expressionFormat==EXPRESSION_MTX)&&((geneIDFileName[0]==0)||(sampleIDFileName[0]==0)
+																	  ||(correlationMethod!=CORRELATION_PEARSON)||(quantBits>0)))
+		||(statisticNum<=0)||(((knownRegulatorName[0]!=0)||(covariateFileName[0]!=0))&&((correlationMethod!=CORRELATION_PEARSON)||(quantBits>0)
+																						   ||(candidateFormat!=CANDIDATE_DENSE)||(expressionFormat!=EXPRESSION_DENSE))))
 	{
 		printf("Command error!\n");
 		PrintCommandUsage();
 		return -1;
 	}
 	
-	PlantSeeds(123456);
-	
 	//Read expression data
 	
-	if (ReadDataMatrix(expressionFileName, &expressions)<=0)
+	if (((expressionFormat==EXPRESSION_MTX)?ReadMatrixMarket(expressionFileName, geneIDFileName, sampleIDFileName, &expressions, &expressionRows)
+		 :ReadDataMatrix(expressionFileName, &expressions))<=0)
 	{
 		printf("ERROR: cannot open %s or incorrect format!\n", expressionFileName);
 		return -1;
@@ -364,10 +780,12 @@ int main (int argc, const char * argv[])
 	
 	//read candidate data
 	
-	if (ReadDataMatrix(candidateFileName, &candidate)<=0)
+	if (((candidateFormat==CANDIDATE_SPARSE)?ReadSparseDataMatrix(candidateFileName, &candidate, &candidateRows)
+		 :ReadDataMatrix(candidateFileName, &candidate))<=0)
 	{
 		printf("ERROR: cannot open %s or incorrect format!\n", candidateFileName);
 		FreeDataMatrix(&expressions);
+		FreeSparseRows(&expressionRows);
 		return -1;
 	}
 	else
@@ -375,60 +793,196 @@ int main (int argc, const char * argv[])
 		printf("%d records and %d samples in candidate data\n", candidate.recordNum, candidate.sampleNum);
 	}
 	
-	//read ID data
+	//read covariate data
 	
-	matchedIDNum = MarkIDs(targetIDFileName, &expressions);
+	if (covariateFileName[0])
+	{
+		if (ReadDataMatrix(covariateFileName, &covariates)<=0)
+		{
+			printf("ERROR: cannot open %s or incorrect format!\n", covariateFileName);
+			FreeDataMatrix(&expressions);
+			FreeDataMatrix(&candidate);
+			FreeSparseRows(&candidateRows);
+			FreeSparseRows(&expressionRows);
+			return -1;
+		}
+		else
+		{
+			printf("%d covariates and %d samples in covariate data\n", covariates.recordNum, covariates.sampleNum);
+		}
+	}
 	
-	printf("%d genes in expression data are signitures\n", matchedIDNum);
+	//read ID data. In server mode each query gives its own
 	
-	if (matchedIDNum <=0)
+	if (socketName[0]==0)
 	{
-		printf("no signature gene found in expression data!\n");
-		FreeDataMatrix(&expressions);
-		FreeDataMatrix(&candidate);
+		matchedIDNum = MarkIDs(targetIDFileName, &expressions);
 		
-		return -1;
+		printf("%d genes in expression data are signitures\n", matchedIDNum);
+		
+		if (matchedIDNum <=0)
+		{
+			printf("no signature gene found in expression data!\n");
+			FreeDataMatrix(&expressions);
+			FreeDataMatrix(&candidate);
+			FreeSparseRows(&candidateRows);
+			FreeSparseRows(&expressionRows);
+			
+			if (covariateFileName[0])
+			{
+				FreeDataMatrix(&covariates);
+			}
+			
+			return -1;
+		}
 	}
 	
-	MarkIDs(targetIDFileName, &candidate);
-	
 	//intersect expression data and candidate data by samples
 	
-	if (IntersectSampleIDs(&expressions, &candidate, &expressionTrimmed, &candidateTrimmed)<=0)
+	InitGS2AContext(&context, correlationMethod, threadNum, quantBits);
+	
+	//sparse candidates are trimmed into sparseCandidates of the context, whose candidates keep only their names. So is mtx
+	//expression, into sparseExpressions and expressions
+	if (IntersectSampleIDsRows(&expressions, (expressionFormat==EXPRESSION_MTX)?&expressionRows:NULL, 
+							   &candidate, (candidateFormat==CANDIDATE_SPARSE)?&candidateRows:NULL, 
+							   &(context.expressions), &(context.sparseExpressions), &(context.candidates), &(context.sparseCandidates))<=0)
 	{
 		printf("Failed in matching samples between expression data and candidate data.");
 		FreeDataMatrix(&expressions);
 		FreeDataMatrix(&candidate);
+		FreeSparseRows(&candidateRows);
+		FreeSparseRows(&expressionRows);
+		
+		if (covariateFileName[0])
+		{
+			FreeDataMatrix(&covariates);
+		}
 		
 		return -1;
 	}
 	else
 	{
-		printf("%d samples in the intersaction of expression dataset and candidate dataset.\n", candidateTrimmed.sampleNum);
+		printf("%d samples in the intersaction of expression dataset and candidate dataset.\n", context.candidates.sampleNum);
 	}
 	
-	candScores = (CANDIDATE_SCORE_STRUCT *)malloc((candidateTrimmed.recordNum)*sizeof(CANDIDATE_SCORE_STRUCT));
+	FreeDataMatrix(&expressions);
+	FreeDataMatrix(&candidate);
+	FreeSparseRows(&candidateRows);
+	FreeSparseRows(&expressionRows);
+	
+	memcpy(context.statistics, statistics, statisticNum*sizeof(int));
+	context.statisticNum = statisticNum;
 	
-	assert(candScores!=NULL);
+	//the controls of partial correlations, taken from the raw rows of the analyzed samples
+	if ((knownRegulatorName[0]!=0)||(covariateFileName[0]!=0))
+	{
+		context.controls = (double *)malloc(((size_t)MAX_CONTROL_NUM+(covariateFileName[0]?covariates.recordNum:0))*context.expressions.sampleNum*sizeof(double));
+		
+		assert(context.controls!=NULL);
+		
+		context.controlNum = (context.controls!=NULL)?CollectControls(context.controls, knownRegulatorName, &(context.expressions), 
+																	   covariateFileName[0]?&covariates:NULL):-1;
+		
+		if (covariateFileName[0])
+		{
+			FreeDataMatrix(&covariates);
+		}
+		
+		if (context.controlNum<=0)
+		{
+			printf("ERROR: cannot set up the controls!\n");
+			FreeGS2AContext(&context);
+			return -1;
+		}
+		
+		printf("Projecting %d controls out of expression and candidate data......\n", context.controlNum);
+	}
 	
-	printf("Computing GS2A scores......\n");
+	if (correlationMethod==CORRELATION_MI)
+	{
+		printf("%d equal-frequency bins per row for mutual information.\n", MutualInfoBinNum(context.expressions.sampleNum));
+	}
 	
-	ComputeScoreMain(&expressionTrimmed, &candidateTrimmed, candScores);
+	if (PrepareGS2AContext(&context)<=0)
+	{
+		printf("ERROR: %s!\n", context.error);
+		FreeGS2AContext(&context);
+		return -1;
+	}
 	
-	printf("Permutation......\n");
+	if (context.candidates.recordNum<context.candidateNum)
+	{
+		printf("%d unique profiles among %d candidates.\n", context.candidates.recordNum, context.candidateNum);
+	}
 	
-	ComputePermutationP(&expressionTrimmed, &candidateTrimmed, candScores, candidateTrimmed.recordNum, PERMUTATION_NUM);
+	if (context.binaryCandidates.bits!=NULL)
+	{
+		printf("Binary candidates, bit-packed.\n");
+	}
 	
-	if (!WriteToOutput(outputFileName, candScores, candidateTrimmed.recordNum))
+	if (context.sparseExpressions.rowStart!=NULL)
 	{
-		printf("Cannot write to %s!\n", outputFileName);
+		printf("Sparse expression, %d nonzeros.\n", context.sparseExpressions.nonzeroNum);
 	}
 	
-	FreeDataMatrix(&expressions);
-	FreeDataMatrix(&candidate);
-	FreeDataMatrix(&expressionTrimmed);
-	FreeDataMatrix(&candidateTrimmed);
+	if (context.quantCandidates.sums!=NULL)
+	{
+		printf("Candidates quantized to int%d, expression to int16.\n", quantBits);
+	}
+	
+	if (context.categoryCandidates.codes!=NULL)
+	{
+		printf("Categorical candidates, stored as codes.\n");
+	}
+	
+	candScores = NULL;
+	isTarget = NULL;
+	
+	if (socketName[0]!=0)
+	{
+		if (RunServer(socketName, &context, permutationNum)<=0)
+		{
+			FreeGS2AContext(&context);
+			return -1;
+		}
+	}
+	else
+	{
+		candScores = (CANDIDATE_SCORE_STRUCT *)malloc(context.candidateNum*sizeof(CANDIDATE_SCORE_STRUCT));
+		isTarget = (int *)malloc((context.expressions.recordNum+1)*sizeof(int));
+		
+		assert((candScores!=NULL)&&(isTarget!=NULL));
+		
+		//the signature genes marked in the expression data
+		for (i=0;i<context.expressions.recordNum;i++)
+		{
+			isTarget[i] = context.expressions.recordInfo[i].flag;
+		}
+		
+		printf("Computing GS2A scores......\n");
+		
+		if (GS2AScoreBatch(&context, isTarget, NULL, context.candidateNum, candScores)<=0)
+		{
+			printf("ERROR: %s!\n", context.error);
+		}
+		else
+		{
+			printf("Permutation......\n");
+			
+			if (GS2APermutationP(&context, isTarget, PERMUTATION_SEED, permutationNum, candScores, context.candidateNum)<=0)
+			{
+				printf("ERROR: %s!\n", context.error);
+			}
+			else if (!WriteToOutput(outputFileName, candScores, context.candidateNum, context.statistics, context.statisticNum))
+			{
+				printf("Cannot write to %s!\n", outputFileName);
+			}
+		}
+	}
+	
+	FreeGS2AContext(&context);
 	free(candScores);
+	free(isTarget);
 	
 	printf("Finished.\n");
 	
@@ -4,37 +4,17 @@
 #include <memory.h>
 #include <assert.h>
 #include <float.h>
-#include "rngs.h"
-#include "rvgs.h"
-#include "math_api.h"
-#include "dataMatrix.h"
+#include <unistd.h>
+#include "gs2a.h"
 
 #define PERMUTATION_NUM 1000
-
-typedef struct
-{
-	ID_INFO_STRUCT *id;
-	double score;
-	double pValue;
-}CANDIDATE_SCORE_STRUCT;
+#define PERMUTATION_SEED 123456
 
 //Search in gene expression data structures to mark a list of IDs in a file.
 int MarkIDs(char *fileName, DATA_MATRIX_STRUCT *data);
 
-//Compute GS2A score for a candidate feature
-double ComputeGS2AScore(DATA_MATRIX_STRUCT *expressionMatrix, 
-						double *feature, 
-						int featureSize,
-						char *maskedID);
-
-//Compute scores for all candidates and store the values in candidate score structure
-int ComputeScoreMain(DATA_MATRIX_STRUCT *expressionMatrix, DATA_MATRIX_STRUCT *candidateMatrix, CANDIDATE_SCORE_STRUCT *candidateScores);
-
-//Compute p-values for candidates based on permutation
-int ComputePermutationP(DATA_MATRIX_STRUCT *expressionMatrix, DATA_MATRIX_STRUCT *candidateMatrix, CANDIDATE_SCORE_STRUCT *candidateScores, int candidateNum, int permutationNum);
-
 //Write to output file
-int WriteToOutput(char *fileName, CANDIDATE_SCORE_STRUCT *candidateScores, int candNum);
+int WriteToOutput(char *fileName, CANDIDATE_SCORE_STRUCT *candidateScores, int candNum, int statistic);
 
 //print command usage 
 void PrintCommandUsage();
@@ -86,178 +66,11 @@ int MarkIDs(char *fileName, DATA_MATRIX_STRUCT *data)
 	return matchedIDNum;
 }
 
-//Compute GS2A score for a candidate feature
-double ComputeGS2AScore(DATA_MATRIX_STRUCT *expressionMatrix, 
-					 double *feature, 
-					 int featureSize,
-					 char *maskedID)
-{
-	int i;
-	int geneNum = expressionMatrix->recordNum;
-	double *targetValues, *nonTargetValues;
-	int targetNum = 0, nonTargetNum = 0;
-	double targetSquareSum, nonTargetMean, nonTargetStdev;
-		
-	assert(featureSize==expressionMatrix->sampleNum);
-	assert(featureSize>1);
-	assert(geneNum>1);
-	
-	if (!((featureSize==expressionMatrix->sampleNum)&&(featureSize>1)&&(geneNum>1)))
-	{
-		return 1;
-	}
-	
-	targetValues = (double *)malloc(geneNum*sizeof(double));
-	nonTargetValues = (double *)malloc(geneNum*sizeof(double));
-	
-	assert((targetValues!=NULL)&&(nonTargetValues!=NULL));
-	
-	//Compute Correlation values
-	for (i=0;i<geneNum;i++)
-	{
-		if (!strcmp(expressionMatrix->recordInfo[i].name, maskedID))
-		{
-			continue;
-		}
-		
-		if (expressionMatrix->recordInfo[i].flag)
-		{
-			targetValues[targetNum] = PearsonCorrel(feature, &(expressionMatrix->matrix[i*featureSize]), featureSize);
-			targetNum++;
-		}
-		else
-		{
-			nonTargetValues[nonTargetNum] = PearsonCorrel(feature, &(expressionMatrix->matrix[i*featureSize]), featureSize);
-			nonTargetNum++;
-		}
-	}
-	
-	assert((targetNum>0)&&(nonTargetNum>0));
-	
-	if (!((targetNum>0)&&(nonTargetNum>0)))
-	{
-		free(targetValues);
-		free(nonTargetValues);
-		return 0;
-	}
-	
-	nonTargetMean = 0;
-	
-	for (i=0;i<nonTargetNum;i++)
-	{
-		nonTargetMean += nonTargetValues[i];
-	}
-	
-	nonTargetMean /= nonTargetNum;
-	
-	nonTargetStdev = 0;
-	
-	for (i=0;i<nonTargetNum;i++)
-	{
-		nonTargetStdev += (nonTargetValues[i]-nonTargetMean)*(nonTargetValues[i]-nonTargetMean);
-	}
-	
-	nonTargetStdev = sqrt(nonTargetStdev/nonTargetNum);
-
-	targetSquareSum = 0;
-
-	for (i=0;i<targetNum;i++)
-	{
-		targetSquareSum += (targetValues[i]-nonTargetMean)*(targetValues[i]-nonTargetMean)/nonTargetStdev/nonTargetStdev;
-	}
-	
-	free(targetValues);
-	free(nonTargetValues);
-	
-	return targetSquareSum/(targetNum-1)-0.5;
-}
-	
-//Compute p-values for candidates based on permutation
-int ComputePermutationP(DATA_MATRIX_STRUCT *expressionMatrix, DATA_MATRIX_STRUCT *candidateMatrix, CANDIDATE_SCORE_STRUCT *candidateScores, int candidateNum, int permutationNum)
-{
-	int i;	
-	double *randScore;
-	int sampleNum = candidateMatrix->sampleNum;
-	double *tmpFeature;
-	int tmpIndex;
-	
-	assert(expressionMatrix->sampleNum==candidateMatrix->sampleNum);
-	
-	if (expressionMatrix->sampleNum!=candidateMatrix->sampleNum)
-	{
-		return -1;
-	}
-	
-	randScore = (double *)malloc(permutationNum*sizeof(double));
-	tmpFeature = (double *)malloc(sampleNum*sizeof(double));
-	
-	assert((randScore!=NULL)&&(tmpFeature!=NULL));
-	
-	for (i=0;i<permutationNum;i++)
-	{
-		tmpIndex = (int)Uniform(0, candidateMatrix->recordNum);
-		tmpIndex = tmpIndex<0?0:(tmpIndex>=candidateMatrix->recordNum?candidateMatrix->recordNum-1:tmpIndex);
-		
-		memcpy(tmpFeature, candidateMatrix->matrix+tmpIndex*sampleNum, sampleNum*sizeof(double));
-		PermuteFloatArrays(tmpFeature,sampleNum);
-		
-		randScore[i] = fabs(ComputeGS2AScore(expressionMatrix, tmpFeature, sampleNum, ""));
-	}
-	
-	QuicksortF(randScore, 0, permutationNum-1);
-	
-	for (i=0;i<candidateNum;i++)
-	{
-		candidateScores[i].pValue = (double)(permutationNum-1-bTreeSearchingF(fabs(candidateScores[i].score), randScore, 0, permutationNum-1))/permutationNum;
-	}
-
-	free(randScore);
-	free(tmpFeature);
-	return 1;
-}
-
-//Compute scores for all candidates and store the values in candidate score structure
-int ComputeScoreMain(DATA_MATRIX_STRUCT *expressionMatrix, DATA_MATRIX_STRUCT *candidateMatrix, CANDIDATE_SCORE_STRUCT *candidateScores)
-{
-	int i;
-	double *weights;
-
-	assert(expressionMatrix->sampleNum==candidateMatrix->sampleNum);
-	
-	if (expressionMatrix->sampleNum!=candidateMatrix->sampleNum)
-	{
-		return -1;
-	}
-	
-	weights = (double *)malloc(expressionMatrix->recordNum*sizeof(double));
-	
-	assert(weights!=NULL);
-	
-	for (i=0;i<expressionMatrix->recordNum;i++)
-	{
-		weights[i] = 1.0;
-	}
-	
-	for (i=0;i<candidateMatrix->recordNum;i++)
-	{
-		candidateScores[i].score = ComputeGS2AScore(expressionMatrix, 
-						 candidateMatrix->matrix+i*(candidateMatrix->sampleNum), 
-						 candidateMatrix->sampleNum, 
-						 candidateMatrix->recordInfo[i].name);
-		candidateScores[i].id = candidateMatrix->recordInfo+i;
-		candidateScores[i].pValue = 1;
-	}
-	
-	free(weights);
-	
-	return 1;
-}
-
 //Write to output file
-int WriteToOutput(char *fileName, CANDIDATE_SCORE_STRUCT *candidateScores, int candNum)
+int WriteToOutput(char *fileName, CANDIDATE_SCORE_STRUCT *candidateScores, int candNum, int statistic)
 {
 	FILE *fh;
-	int i;
+	int result;
 	
 	fh = (FILE *)fopen(fileName, "w");
 	
@@ -266,20 +79,14 @@ int WriteToOutput(char *fileName, CANDIDATE_SCORE_STRUCT *candidateScores, int c
 		return 0;
 	}
 	
-	fprintf(fh, "ID\tisSignature\tscore\tpValue\n");
+	result = WriteGS2AScores(fh, candidateScores, candNum, &statistic, 1);
 	
-	for (i=0;i<candNum;i++)
+	if (fclose(fh)!=0)
 	{
-		fprintf(fh, "%s\t%d\t%f\t%f\n", 
-				candidateScores[i].id->name,
-				candidateScores[i].id->flag,
-				candidateScores[i].score,
-				candidateScores[i].pValue);
+		result = 0;
 	}
 	
-	fclose(fh);
-	
-	return 1;
+	return result;
 }
 
 //print command usage 
@@ -301,9 +108,9 @@ int main (int argc, const char * argv[])
 	char expressionFileName[1000], targetIDFileName[1000], candidateFileName[1000], outputFileName[1000];
 	DATA_MATRIX_STRUCT expressions;
 	DATA_MATRIX_STRUCT candidate;
-	DATA_MATRIX_STRUCT expressionTrimmed;
-	DATA_MATRIX_STRUCT candidateTrimmed;
+	GS2A_CONTEXT_STRUCT context;
 	CANDIDATE_SCORE_STRUCT *candScores;
+	int *isTarget;
 	int matchedIDNum;
 	int i;
 	
@@ -346,8 +153,6 @@ int main (int argc, const char * argv[])
 		return -1;
 	}
 	
-	PlantSeeds(123456);
-	
 	//Read expression data
 	
 	if (ReadDataMatrix(expressionFileName, &expressions)<=0)
@@ -388,11 +193,11 @@ int main (int argc, const char * argv[])
 		return -1;
 	}
 	
-	MarkIDs(targetIDFileName, &candidate);
+	//intersect expression data and candidate data by samples. The scoring is that of GS2A with the chi-square statistic only
 	
-	//intersect expression data and candidate data by samples
+	InitGS2AContext(&context, CORRELATION_PEARSON, (int)sysconf(_SC_NPROCESSORS_ONLN), 0);
 	
-	if (IntersectSampleIDs(&expressions, &candidate, &expressionTrimmed, &candidateTrimmed)<=0)
+	if (IntersectSampleIDs(&expressions, &candidate, &(context.expressions), &(context.candidates))<=0)
 	{
 		printf("Failed in matching samples between expression data and candidate data.");
 		FreeDataMatrix(&expressions);
@@ -402,31 +207,63 @@ int main (int argc, const char * argv[])
 	}
 	else
 	{
-		printf("%d samples in the intersaction of expression dataset and candidate dataset.\n", candidateTrimmed.sampleNum);
+		printf("%d samples in the intersaction of expression dataset and candidate dataset.\n", context.candidates.sampleNum);
 	}
 	
-	candScores = (CANDIDATE_SCORE_STRUCT *)malloc((candidateTrimmed.recordNum)*sizeof(CANDIDATE_SCORE_STRUCT));
+	FreeDataMatrix(&expressions);
+	FreeDataMatrix(&candidate);
 	
-	assert(candScores!=NULL);
+	context.statistics[0] = GS2A_STAT_CHI_SQUARE;
+	context.statisticNum = 1;
 	
-	printf("Computing GS2A scores......\n");
+	if (PrepareGS2AContext(&context)<=0)
+	{
+		printf("ERROR: %s!\n", context.error);
+		FreeGS2AContext(&context);
+		return -1;
+	}
 	
-	ComputeScoreMain(&expressionTrimmed, &candidateTrimmed, candScores);
+	candScores = (CANDIDATE_SCORE_STRUCT *)malloc(context.candidateNum*sizeof(CANDIDATE_SCORE_STRUCT));
+	isTarget = (int *)malloc((context.expressions.recordNum+1)*sizeof(int));
 	
-	printf("Permutation......\n");
+	assert((candScores!=NULL)&&(isTarget!=NULL));
 	
-	ComputePermutationP(&expressionTrimmed, &candidateTrimmed, candScores, candidateTrimmed.recordNum, PERMUTATION_NUM);
+	if ((candScores==NULL)||(isTarget==NULL))
+	{
+		FreeGS2AContext(&context);
+		free(candScores);
+		free(isTarget);
+		return -1;
+	}
 	
-	if (!WriteToOutput(outputFileName, candScores, candidateTrimmed.recordNum))
+	for (i=0;i<context.expressions.recordNum;i++)
 	{
-		printf("Cannot write to %s!\n", outputFileName);
+		isTarget[i] = context.expressions.recordInfo[i].flag;
 	}
 	
-	FreeDataMatrix(&expressions);
-	FreeDataMatrix(&candidate);
-	FreeDataMatrix(&expressionTrimmed);
-	FreeDataMatrix(&candidateTrimmed);
+	printf("Computing GS2A scores......\n");
+	
+	if (GS2AScoreBatch(&context, isTarget, NULL, context.candidateNum, candScores)<=0)
+	{
+		printf("ERROR: %s!\n", context.error);
+	}
+	else
+	{
+		printf("Permutation......\n");
+		
+		if (GS2APermutationP(&context, isTarget, PERMUTATION_SEED, PERMUTATION_NUM, candScores, context.candidateNum)<=0)
+		{
+			printf("ERROR: %s!\n", context.error);
+		}
+		else if (!WriteToOutput(outputFileName, candScores, context.candidateNum, GS2A_STAT_CHI_SQUARE))
+		{
+			printf("Cannot write to %s!\n", outputFileName);
+		}
+	}
+	
+	FreeGS2AContext(&context);
 	free(candScores);
+	free(isTarget);
 	
 	printf("Finished.\n");
 	
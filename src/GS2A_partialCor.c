@@ -4,43 +4,21 @@
 #include <memory.h>
 #include <assert.h>
 #include <float.h>
-#include "rngs.h"
-#include "rvgs.h"
-#include "math_api.h"
-#include "dataMatrix.h"
+#include <unistd.h>
+#include "gs2a.h"
 
 #define PERMUTATION_NUM 100
-
-typedef struct
-{
-	ID_INFO_STRUCT *id;
-	double score;
-	double pValue;
-}CANDIDATE_SCORE_STRUCT;
+#define PERMUTATION_SEED 123456
 
 //Search in gene expression data structures to mark a list of IDs in a file.
 int MarkIDs(char *fileName, DATA_MATRIX_STRUCT *data);
 
-//Compute GS2A score for a candidate feature
-double ComputeGS2AScore(DATA_MATRIX_STRUCT *expressionMatrix, 
-						double *feature, 
-						int featureSize,
-						char *maskedID);
-
-//Compute scores for all candidates and store the values in candidate score structure
-int ComputeScoreMain(DATA_MATRIX_STRUCT *expressionMatrix, DATA_MATRIX_STRUCT *candidateMatrix, CANDIDATE_SCORE_STRUCT *candidateScores);
-
-//Compute p-values for candidates based on permutation
-int ComputePermutationP(DATA_MATRIX_STRUCT *expressionMatrix, DATA_MATRIX_STRUCT *candidateMatrix, CANDIDATE_SCORE_STRUCT *candidateScores, int candidateNum, int permutationNum);
-
 //Write to output file
-int WriteToOutput(char *fileName, CANDIDATE_SCORE_STRUCT *candidateScores, int candNum);
+int WriteToOutput(char *fileName, CANDIDATE_SCORE_STRUCT *candidateScores, int candNum, int statistic);
 
 //print command usage 
 void PrintCommandUsage();
 
-double *knownRegulatorArray;
-
 //Search in gene expression data structures to mark a list of IDs in a file. Return number of matched ID
 int MarkIDs(char *fileName, DATA_MATRIX_STRUCT *data)
 {
@@ -88,189 +66,11 @@ int MarkIDs(char *fileName, DATA_MATRIX_STRUCT *data)
 	return matchedIDNum;
 }
 
-//Compute GS2A score for a candidate feature
-double ComputeGS2AScore(DATA_MATRIX_STRUCT *expressionMatrix, 
-					 double *feature, 
-					 int featureSize,
-					 char *maskedID)
-{
-	int i;
-	int geneNum = expressionMatrix->recordNum;
-	double *targetValues, *nonTargetValues;
-	int targetNum = 0, nonTargetNum = 0;
-	double targetMean, nonTargetMean, nonTargetStdev;
-		
-	assert(featureSize==expressionMatrix->sampleNum);
-	assert(featureSize>1);
-	assert(geneNum>1);
-	
-	if (!((featureSize==expressionMatrix->sampleNum)&&(featureSize>1)&&(geneNum>1)))
-	{
-		return 1;
-	}
-	
-	targetValues = (double *)malloc(geneNum*sizeof(double));
-	nonTargetValues = (double *)malloc(geneNum*sizeof(double));
-	
-	assert((targetValues!=NULL)&&(nonTargetValues!=NULL));
-	
-	//Compute Correlation values
-	for (i=0;i<geneNum;i++)
-	{
-		if (!strcmp(expressionMatrix->recordInfo[i].name, maskedID))
-		{
-			continue;
-		}
-		
-		if (expressionMatrix->recordInfo[i].flag)
-		{
-			//targetValues[targetNum] = PearsonCorrel(feature, &(expressionMatrix->matrix[i*featureSize]), featureSize);
-			targetValues[targetNum] = PartialCorrel(feature, &(expressionMatrix->matrix[i*featureSize]), knownRegulatorArray, featureSize);
-			targetNum++;
-		}
-		else
-		{
-			//nonTargetValues[nonTargetNum] = PearsonCorrel(feature, &(expressionMatrix->matrix[i*featureSize]), featureSize);
-			nonTargetValues[nonTargetNum] = PartialCorrel(feature, &(expressionMatrix->matrix[i*featureSize]), knownRegulatorArray, featureSize);
-			nonTargetNum++;
-		}
-	}
-	
-	assert((targetNum>0)&&(nonTargetNum>0));
-	
-	if (!((targetNum>0)&&(nonTargetNum>0)))
-	{
-		free(targetValues);
-		free(nonTargetValues);
-		return 0;
-	}
-	
-	targetMean = 0;
-	
-	for (i=0;i<targetNum;i++)
-	{
-		targetMean += targetValues[i];
-	}
-	
-	targetMean /= targetNum;
-	
-	nonTargetMean = 0;
-	
-	for (i=0;i<nonTargetNum;i++)
-	{
-		nonTargetMean += nonTargetValues[i];
-	}
-	
-	nonTargetMean /= nonTargetNum;
-	
-	nonTargetStdev = 0;
-	
-	for (i=0;i<nonTargetNum;i++)
-	{
-		nonTargetStdev += (nonTargetValues[i]-nonTargetMean)*(nonTargetValues[i]-nonTargetMean);
-	}
-	
-	nonTargetStdev = sqrt(nonTargetStdev/nonTargetNum);
-	
-	free(targetValues);
-	free(nonTargetValues);
-	
-	if (fabs(nonTargetStdev)<0.000001)
-	{
-		return 0.0;
-	}
-	else 
-	{
-		return (targetMean-nonTargetMean)/nonTargetStdev*sqrt(targetNum);
-	}
-}
-	
-//Compute p-values for candidates based on permutation
-int ComputePermutationP(DATA_MATRIX_STRUCT *expressionMatrix, DATA_MATRIX_STRUCT *candidateMatrix, CANDIDATE_SCORE_STRUCT *candidateScores, int candidateNum, int permutationNum)
-{
-	int i;	
-	double *randScore;
-	int sampleNum = candidateMatrix->sampleNum;
-	double *tmpFeature;
-	int tmpIndex;
-	
-	assert(expressionMatrix->sampleNum==candidateMatrix->sampleNum);
-	
-	if (expressionMatrix->sampleNum!=candidateMatrix->sampleNum)
-	{
-		return -1;
-	}
-	
-	randScore = (double *)malloc(permutationNum*sizeof(double));
-	tmpFeature = (double *)malloc(sampleNum*sizeof(double));
-	
-	assert((randScore!=NULL)&&(tmpFeature!=NULL));
-	
-	for (i=0;i<permutationNum;i++)
-	{
-		tmpIndex = (int)Uniform(0, candidateMatrix->recordNum);
-		tmpIndex = tmpIndex<0?0:(tmpIndex>=candidateMatrix->recordNum?candidateMatrix->recordNum-1:tmpIndex);
-		
-		memcpy(tmpFeature, candidateMatrix->matrix+tmpIndex*sampleNum, sampleNum*sizeof(double));
-		PermuteFloatArrays(tmpFeature,sampleNum);
-		
-		randScore[i] = fabs(ComputeGS2AScore(expressionMatrix, tmpFeature, sampleNum, ""));
-	}
-	
-	QuicksortF(randScore, 0, permutationNum-1);
-	
-	for (i=0;i<candidateNum;i++)
-	{
-		candidateScores[i].pValue = (double)(permutationNum-1-bTreeSearchingF(fabs(candidateScores[i].score), randScore, 0, permutationNum-1))/permutationNum;
-	}
-
-	free(randScore);
-	free(tmpFeature);
-	return 1;
-}
-
-//Compute scores for all candidates and store the values in candidate score structure
-int ComputeScoreMain(DATA_MATRIX_STRUCT *expressionMatrix, DATA_MATRIX_STRUCT *candidateMatrix, CANDIDATE_SCORE_STRUCT *candidateScores)
-{
-	int i;
-	double *weights;
-
-	assert(expressionMatrix->sampleNum==candidateMatrix->sampleNum);
-	
-	if (expressionMatrix->sampleNum!=candidateMatrix->sampleNum)
-	{
-		return -1;
-	}
-	
-	weights = (double *)malloc(expressionMatrix->recordNum*sizeof(double));
-	
-	assert(weights!=NULL);
-	
-	for (i=0;i<expressionMatrix->recordNum;i++)
-	{
-		weights[i] = 1.0;
-	}
-	
-	for (i=0;i<candidateMatrix->recordNum;i++)
-	{
-		candidateScores[i].score = ComputeGS2AScore(expressionMatrix, 
-						 candidateMatrix->matrix+i*(candidateMatrix->sampleNum), 
-						 candidateMatrix->sampleNum, 
-						 candidateMatrix->recordInfo[i].name);
-		candidateScores[i].id = candidateMatrix->recordInfo+i;
-		candidateScores[i].pValue = 1;
-	}
-	
-	free(weights);
-	
-	return 1;
-}
-
 //Write to output file
-int WriteToOutput(char *fileName, CANDIDATE_SCORE_STRUCT *candidateScores, int candNum)
+int WriteToOutput(char *fileName, CANDIDATE_SCORE_STRUCT *candidateScores, int candNum, int statistic)
 {
 	FILE *fh;
-	int i;
+	int result;
 	
 	fh = (FILE *)fopen(fileName, "w");
 	
@@ -279,20 +79,14 @@ int WriteToOutput(char *fileName, CANDIDATE_SCORE_STRUCT *candidateScores, int c
 		return 0;
 	}
 	
-	fprintf(fh, "ID\tisSignature\tscore\tpValue\n");
+	result = WriteGS2AScores(fh, candidateScores, candNum, &statistic, 1);
 	
-	for (i=0;i<candNum;i++)
+	if (fclose(fh)!=0)
 	{
-		fprintf(fh, "%s\t%d\t%f\t%f\n", 
-				candidateScores[i].id->name,
-				candidateScores[i].id->flag,
-				candidateScores[i].score,
-				candidateScores[i].pValue);
+		result = 0;
 	}
 	
-	fclose(fh);
-	
-	return 1;
+	return result;
 }
 
 //print command usage 
@@ -304,17 +98,24 @@ void PrintCommandUsage()
 	printf("-d <expression data file>\n");
 	printf("-t <target gene id file>\n");
 	printf("-c <candidate data file>\n");
-	printf("-r <known regulator name>\n");
+	printf("-r <known regulator name, or a comma-separated list of names>\n");
+	printf("-k <covariate data file, controlled for in addition to -r> (optional)\n");
 	printf("-o <output file>\n");
+	printf("-m <mode: exact (default) or residual>\n");
+	printf("   Both project the controls out of all rows once and score with dot products, which gives the exact partial\n");
+	printf("   correlations; the option is kept for existing scripts\n");
 	printf("example:\n");
 	printf("GS2A -d breast_cancer_sample.txt -t estrogen_target.txt -c transcription_factor.txt -r ESR1 -o output.txt \n");
+	printf("GS2A -d breast_cancer_sample.txt -t estrogen_target.txt -c transcription_factor.txt -r ESR1,MKI67 -k purity.txt -o output.txt \n");
 }
 
 int main (int argc, const char * argv[]) 
 {
-	char expressionFileName[1000], targetIDFileName[1000], candidateFileName[1000], knownRegulatorName[1000], outputFileName[1000];
-	DATA_MATRIX_STRUCT expressions, candidate, expressionTrimmed, candidateTrimmed;
+	char expressionFileName[1000], targetIDFileName[1000], candidateFileName[1000], knownRegulatorName[1000], outputFileName[1000], modeName[1000], covariateFileName[1000];
+	DATA_MATRIX_STRUCT expressions, candidate, covariates;
+	GS2A_CONTEXT_STRUCT context;
 	CANDIDATE_SCORE_STRUCT *candScores;
+	int *isTarget;
 	int matchedIDNum;
 	int i;
 	
@@ -330,6 +131,8 @@ int main (int argc, const char * argv[])
 	candidateFileName[0] = 0;
 	knownRegulatorName[0] = 0;
 	outputFileName[0] = 0;
+	covariateFileName[0] = 0;
+	strcpy(modeName, "exact");
 	
 	for (i=2;i<argc;i++)
 	{
@@ -353,17 +156,24 @@ int main (int argc, const char * argv[])
 		{
 			strcpy(outputFileName, argv[i]);
 		}
+		if (strcmp(argv[i-1], "-m")==0)
+		{
+			strcpy(modeName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-k")==0)
+		{
+			strcpy(covariateFileName, argv[i]);
+		}
 	}
 	
-	if ((expressionFileName[0]==0)||(targetIDFileName[0]==0)||(candidateFileName[0]==0)||(knownRegulatorName[0]==0)||(outputFileName[0]==0))
+	if ((expressionFileName[0]==0)||(targetIDFileName[0]==0)||(candidateFileName[0]==0)||((knownRegulatorName[0]==0)&&(covariateFileName[0]==0))||(outputFileName[0]==0)
+		||((strcmp(modeName, "exact")!=0)&&(strcmp(modeName, "residual")!=0)))
 	{
 		printf("Command error!\n");
 		PrintCommandUsage();
 		return -1;
 	}
 	
-	PlantSeeds(123456);
-	
 	//Read expression data
 	
 	if (ReadDataMatrix(expressionFileName, &expressions)<=0)
@@ -389,6 +199,23 @@ int main (int argc, const char * argv[])
 		printf("%d records and %d samples in candidate data\n", candidate.recordNum, candidate.sampleNum);
 	}
 	
+	//read covariate data
+	
+	if (covariateFileName[0])
+	{
+		if (ReadDataMatrix(covariateFileName, &covariates)<=0)
+		{
+			printf("ERROR: cannot open %s or incorrect format!\n", covariateFileName);
+			FreeDataMatrix(&expressions);
+			FreeDataMatrix(&candidate);
+			return -1;
+		}
+		else
+		{
+			printf("%d covariates and %d samples in covariate data\n", covariates.recordNum, covariates.sampleNum);
+		}
+	}
+	
 	//read ID data
 	
 	matchedIDNum = MarkIDs(targetIDFileName, &expressions);
@@ -401,57 +228,109 @@ int main (int argc, const char * argv[])
 		FreeDataMatrix(&expressions);
 		FreeDataMatrix(&candidate);
 		
+		if (covariateFileName[0])
+		{
+			FreeDataMatrix(&covariates);
+		}
+		
 		return -1;
 	}
 	
-	MarkIDs(targetIDFileName, &candidate);
+	//intersect expression data and candidate data by samples. The scoring is that of GS2A with the controls
 	
-	//intersect expression data and candidate data by samples
+	InitGS2AContext(&context, CORRELATION_PEARSON, (int)sysconf(_SC_NPROCESSORS_ONLN), 0);
 	
-	if (IntersectSampleIDs(&expressions, &candidate, &expressionTrimmed, &candidateTrimmed)<=0)
+	if (IntersectSampleIDs(&expressions, &candidate, &(context.expressions), &(context.candidates))<=0)
 	{
 		printf("Failed in matching samples between expression data and candidate data.");
 		FreeDataMatrix(&expressions);
 		FreeDataMatrix(&candidate);
 		
+		if (covariateFileName[0])
+		{
+			FreeDataMatrix(&covariates);
+		}
+		
 		return -1;
 	}
 	else
 	{
-		printf("%d samples in the intersaction of expression dataset and candidate dataset.\n", candidateTrimmed.sampleNum);
+		printf("%d samples in the intersaction of expression dataset and candidate dataset.\n", context.candidates.sampleNum);
 	}
 	
-	candScores = (CANDIDATE_SCORE_STRUCT *)malloc((candidateTrimmed.recordNum)*sizeof(CANDIDATE_SCORE_STRUCT));
+	FreeDataMatrix(&expressions);
+	FreeDataMatrix(&candidate);
+	
+	//the controls, taken from the raw rows of the analyzed samples
+	context.controls = (double *)malloc(((size_t)MAX_CONTROL_NUM+(covariateFileName[0]?covariates.recordNum:0))*context.expressions.sampleNum*sizeof(double));
+	
+	assert(context.controls!=NULL);
 	
-	assert(candScores!=NULL);
+	context.controlNum = (context.controls!=NULL)?CollectControls(context.controls, knownRegulatorName, &(context.expressions), 
+																   covariateFileName[0]?&covariates:NULL):-1;
 	
-	for (i=0;i<expressionTrimmed.recordNum;i++)
+	if (covariateFileName[0])
 	{
-		if (strcmp(knownRegulatorName, expressionTrimmed.recordInfo[i].name)==0)
-		{
-			knownRegulatorArray = expressionTrimmed.matrix+i*expressionTrimmed.sampleNum;
-			break;
-		}
+		FreeDataMatrix(&covariates);
 	}
 	
-	printf("Computing GS2A scores......\n");
+	if (context.controlNum<=0)
+	{
+		printf("ERROR: cannot set up the controls!\n");
+		FreeGS2AContext(&context);
+		return -1;
+	}
 	
-	ComputeScoreMain(&expressionTrimmed, &candidateTrimmed, candScores);
+	printf("Projecting %d controls out of expression and candidate data......\n", context.controlNum);
 	
-	printf("Permutation......\n");
+	if (PrepareGS2AContext(&context)<=0)
+	{
+		printf("ERROR: %s!\n", context.error);
+		FreeGS2AContext(&context);
+		return -1;
+	}
 	
-	ComputePermutationP(&expressionTrimmed, &candidateTrimmed, candScores, candidateTrimmed.recordNum, PERMUTATION_NUM);
+	candScores = (CANDIDATE_SCORE_STRUCT *)malloc(context.candidateNum*sizeof(CANDIDATE_SCORE_STRUCT));
+	isTarget = (int *)malloc((context.expressions.recordNum+1)*sizeof(int));
 	
-	if (!WriteToOutput(outputFileName, candScores, candidateTrimmed.recordNum))
+	assert((candScores!=NULL)&&(isTarget!=NULL));
+	
+	if ((candScores==NULL)||(isTarget==NULL))
 	{
-		printf("Cannot write to %s!\n", outputFileName);
+		FreeGS2AContext(&context);
+		free(candScores);
+		free(isTarget);
+		return -1;
 	}
 	
-	FreeDataMatrix(&expressions);
-	FreeDataMatrix(&candidate);
-	FreeDataMatrix(&expressionTrimmed);
-	FreeDataMatrix(&candidateTrimmed);
+	for (i=0;i<context.expressions.recordNum;i++)
+	{
+		isTarget[i] = context.expressions.recordInfo[i].flag;
+	}
+	
+	printf("Computing GS2A scores......\n");
+	
+	if (GS2AScoreBatch(&context, isTarget, NULL, context.candidateNum, candScores)<=0)
+	{
+		printf("ERROR: %s!\n", context.error);
+	}
+	else
+	{
+		printf("Permutation......\n");
+		
+		if (GS2APermutationP(&context, isTarget, PERMUTATION_SEED, PERMUTATION_NUM, candScores, context.candidateNum)<=0)
+		{
+			printf("ERROR: %s!\n", context.error);
+		}
+		else if (!WriteToOutput(outputFileName, candScores, context.candidateNum, GS2A_STAT_MEAN))
+		{
+			printf("Cannot write to %s!\n", outputFileName);
+		}
+	}
+	
+	FreeGS2AContext(&context);
 	free(candScores);
+	free(isTarget);
 	
 	printf("Finished.\n");
 	
@@ -12,40 +12,16 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <memory.h>
+#include <unistd.h>
 #include "math_api.h"
 #include "dataMatrix.h"
+#include "nst.h"
 
 
-//Normalize data using Normal Score Transformation
-void NSTNormData(double *data, int geneNum, int sampleNum);
-
 //print command usage 
 void PrintCommandUsage();
 
 
-//Normalize data using Normal Score Transformation
-void NSTNormData(double *data, int geneNum, int sampleNum)
-{
-	int i;
-	int *rank;
-	double *normData;
-	
-	rank = (int *)malloc(sampleNum*sizeof(double));
-	normData = (double *)malloc(sampleNum*sizeof(double));
-	
-	assert((rank!=NULL)&&(normData!=NULL));
-							
-	for (i=0;i<geneNum;i++)
-	{
-		Ranking(rank, data+i*sampleNum, sampleNum);
-		NormalTransform(normData, rank, sampleNum);
-		memcpy(data+i*sampleNum, normData, sampleNum*sizeof(double));
-	}
-	
-	free(rank);
-	free(normData);
-}
-
 //print command usage 
 void PrintCommandUsage()
 {
@@ -54,6 +30,9 @@ void PrintCommandUsage()
 	printf("usage:\n");
 	printf("-i <input data matrix>\n");
 	printf("-o <output normalized data matrix>\n");
+	printf("-p <number of threads> (optional, default: number of processors)\n");
+	printf("-m <memory or stream> (optional, default: memory. stream normalizes row by row without loading the matrix)\n");
+	printf("-f <output format: text or binary> (optional, default: text. binary is read back by all tools, and needs -m memory)\n");
 	printf("example:\n");
 	printf("NSTNorm -i input.txt -o output.txt \n");
 }
@@ -62,6 +41,8 @@ int main (int argc, const char * argv[])
 {
 	char expressionFileName[1000], outputFileName[1000];
 	DATA_MATRIX_STRUCT expressions;
+	int threadNum, isStreaming, isBinary;
+	int sampleNum, recordNum;
 	int i;
 	
 	
@@ -74,6 +55,9 @@ int main (int argc, const char * argv[])
 	
 	expressionFileName[0] = 0;
 	outputFileName[0] = 0;
+	threadNum = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	isStreaming = 0;
+	isBinary = 0;
 	
 	for (i=2;i<argc;i++)
 	{
@@ -85,15 +69,56 @@ int main (int argc, const char * argv[])
 		{
 			strcpy(outputFileName, argv[i]);
 		}
+		if (strcmp(argv[i-1], "-p")==0)
+		{
+			threadNum = atoi(argv[i]);
+		}
+		if (strcmp(argv[i-1], "-m")==0)
+		{
+			if (strcmp(argv[i], "stream")==0)
+			{
+				isStreaming = 1;
+			}
+			else if (strcmp(argv[i], "memory")!=0)
+			{
+				isStreaming = -1;
+			}
+		}
+		if (strcmp(argv[i-1], "-f")==0)
+		{
+			if (strcmp(argv[i], "binary")==0)
+			{
+				isBinary = 1;
+			}
+			else if (strcmp(argv[i], "text")!=0)
+			{
+				isBinary = -1;
+			}
+		}
 	}
 	
-	if ((expressionFileName[0]==0)||(outputFileName[0]==0))
+	if ((expressionFileName[0]==0)||(outputFileName[0]==0)||(threadNum<=0)||(isStreaming<0)||(isBinary<0)||(isStreaming&&isBinary))
 	{
 		printf("Command error!\n");
 		PrintCommandUsage();
 		return -1;
 	}
 	
+	if (isStreaming)
+	{
+		recordNum = NSTNormStream(expressionFileName, outputFileName, threadNum, &sampleNum);
+		
+		if (recordNum<0)
+		{
+			printf("Cannot open %s or %s, or file format error!\n", expressionFileName, outputFileName);
+			return -1;
+		}
+		
+		printf("sampleNum=%d\ngeneNum=%d\n", sampleNum, recordNum);
+		printf("NST finished.\n");
+		return 0;
+	}
+	
 	if (ReadDataMatrix(expressionFileName, &expressions)<=0)
 	{
 		printf("Cannot open %s or file format error!\n", expressionFileName);
@@ -102,9 +127,14 @@ int main (int argc, const char * argv[])
 	
 	printf("sampleNum=%d\ngeneNum=%d\n", expressions.sampleNum, expressions.recordNum);
 	
-	NSTNormData(expressions.matrix, expressions.recordNum, expressions.sampleNum);
+	if (NSTNormMatrix(expressions.matrix, expressions.recordNum, expressions.sampleNum, threadNum)<=0)
+	{
+		printf("ERROR: cannot allocate memory!\n");
+		FreeDataMatrix(&expressions);
+		return -1;
+	}
 	
-	if (SaveDataMatrix(outputFileName, &expressions)<=0)
+	if ((isBinary?SaveDataMatrixBinary(outputFileName, &expressions):SaveDataMatrixThreads(outputFileName, &expressions, threadNum))<=0)
 	{
 		printf("Cannot save to %s\n",outputFileName);
 	}
@@ -3,25 +3,49 @@
 #include <stdlib.h>
 #include <memory.h>
 #include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "rngs.h"
 #include "rvgs.h"
 #include "words.h"
 #include "math_api.h"
+#include "ecdf.h"
+#include "dcor.h"
+#include "nst.h"
+#include "format.h"
 
-#define MAX_SAMPLE_NUM 1000
+#define MAX_SAMPLE_NUM 10000
 #define MAX_WORD_SIZE  1000
 #define PERMUTATION_TIMES 1000
+#define PERMUTATION_SEED 123456
+#define SCORE_TASK_CHUNK 4				//number of candidates or permutations a worker takes at a time
 
 typedef struct
 {
 	char name[MAX_WORD_SIZE];
 	double *values;
-	int *rank;
 	double *normValues;
 	double score;
 	double pvalue;
 }GENE_DATA_STRUCT;
 
+//Shared state of the ComputeScores workers. Tasks 0..candNum-1 score the candidates, the following permutationNum tasks build the null
+typedef struct
+{
+	DCOR_TARGET_STRUCT *target;
+	GENE_DATA_STRUCT **candData;
+	int candNum;
+	double *knownRegulatorValues;
+	int sampleNum;
+	double *randomScore;
+	int permutationNum;
+	long seed;
+	int nextTask;
+	int finishedTaskNum;
+	int isFailed;		//a worker could not allocate its workspace
+	pthread_mutex_t lock;
+}SCORE_ENGINE_STRUCT;
+
 //Allocate the gene expression data structure
 int AllocExpressionStruct(GENE_DATA_STRUCT **pExpressions, int geneNum, int sampleNum);
 
@@ -40,8 +64,12 @@ int SearchIDsFromFile(char *fileName, GENE_DATA_STRUCT *srcArray, int srcGeneNum
 //Normalize dataset using Normal Score Transformation
 void NSTNormData(GENE_DATA_STRUCT *data, int geneNum, int sampleNum);
 
-//Compute the scores and p-values for each candidate based on distance correlation
-void ComputeScores(GENE_DATA_STRUCT **targetData, int targetNum, GENE_DATA_STRUCT **candData, int candNum, GENE_DATA_STRUCT *knownRegulatorData, int sampleNum, int permutationNum);
+//Worker thread of ComputeScores. Takes chunks of tasks until none are left
+void *ScoreWorker(void *arg);
+
+//Compute the scores and p-values for each candidate based on distance correlation. useFastDCor: use the O(n*log(n)) distance correlation.
+//Return 1 if success, -1 if failure
+int ComputeScores(GENE_DATA_STRUCT **targetData, int targetNum, GENE_DATA_STRUCT **candData, int candNum, GENE_DATA_STRUCT *knownRegulatorData, int sampleNum, int permutationNum, int useFastDCor, int threadNum);
 
 //Write to output file
 int WriteToOutput(char *fileName, GENE_DATA_STRUCT **candData, int candNum);
@@ -66,10 +94,9 @@ int AllocExpressionStruct(GENE_DATA_STRUCT **pExpressions, int geneNum, int samp
 	for (i=0;i<geneNum;i++)
 	{
 		(*pExpressions)[i].values = (double *)malloc(sampleNum*sizeof(double));
-		(*pExpressions)[i].rank = (int *)malloc(sampleNum*sizeof(double));
 		(*pExpressions)[i].normValues = (double *)malloc(sampleNum*sizeof(double));
 		
-		assert(((*pExpressions)[i].values!=NULL)&&((*pExpressions)[i].rank != NULL)&&((*pExpressions)[i].normValues != NULL));
+		assert(((*pExpressions)[i].values!=NULL)&&((*pExpressions)[i].normValues != NULL));
 	}
 	
 	return geneNum;
@@ -88,7 +115,6 @@ int FreeExpressionStruct(GENE_DATA_STRUCT **pExpressions, int geneNum)
 	for (i=0;i<geneNum;i++)
 	{
 		free((*pExpressions)[i].values);
-		free((*pExpressions)[i].rank);
 		free((*pExpressions)[i].normValues);
 	}
 	
@@ -185,8 +211,7 @@ int ReadExprssionFile(char *fileName, GENE_DATA_STRUCT **pExpressions, int *pGen
 		
 		for (i=0;i<sampleNum;i++)
 		{
-			(*pExpressions)[geneNum].values[i] = atof(words[i+1])+Uniform(-0.00000001, 0.00000001); //If two values equal, add a small random value to make them different
-			(*pExpressions)[geneNum].rank[i] = -1;
+			(*pExpressions)[geneNum].values[i] = atof(words[i+1]);
 			(*pExpressions)[geneNum].normValues[i] = 0.0;
 		}
 		
@@ -274,27 +299,144 @@ int SearchIDsFromFile(char *fileName, GENE_DATA_STRUCT *srcArray, int srcGeneNum
 void NSTNormData(GENE_DATA_STRUCT *data, int geneNum, int sampleNum)
 {
 	int i;
+	double *table;
+	INDEXED_FLOAT *sortBuf;
+	int *rankBuf;
+	
+	table = (double *)malloc((2*sampleNum-1)*sizeof(double));
+	sortBuf = (INDEXED_FLOAT *)malloc(sampleNum*sizeof(INDEXED_FLOAT));
+	rankBuf = (int *)malloc(sampleNum*sizeof(int));
 	
+	assert((table!=NULL)&&(sortBuf!=NULL)&&(rankBuf!=NULL));
+	
+	BuildNormalScoreTable(table, sampleNum);
+	
+	//tied values share the normal score of their average rank, so no jitter is needed to break ties
 	for (i=0;i<geneNum;i++)
 	{
-		Ranking(data[i].rank, data[i].values, sampleNum);
-		NormalTransform(data[i].normValues, data[i].rank, sampleNum);
+		NSTNormRow(data[i].normValues, data[i].values, sampleNum, table, sortBuf, rankBuf);
+	}
+	
+	free(table);
+	free(sortBuf);
+	free(rankBuf);
+}
+
+//Worker thread of ComputeScores. Takes chunks of tasks until none are left
+void *ScoreWorker(void *arg)
+{
+	SCORE_ENGINE_STRUCT *engine = (SCORE_ENGINE_STRUCT *)arg;
+	DCOR_WORKSPACE_STRUCT workspace;
+	RNG_STREAM_STRUCT rng;
+	double *input;
+	int sampleNum = engine->sampleNum;
+	int taskNum = engine->candNum+engine->permutationNum;
+	int first, last, t, candIndex;
+	
+	//known regulator and candidate are stored one after another
+	input = (double *)malloc(2*sampleNum*sizeof(double));
+	
+	assert(input!=NULL);
+	
+	if ((input==NULL)||(AllocDCorWorkspace(&workspace, sampleNum)<=0))
+	{
+		free(input);
+		
+		pthread_mutex_lock(&(engine->lock));
+		engine->isFailed = 1;
+		pthread_mutex_unlock(&(engine->lock));
+		
+		return NULL;
+	}
+	
+	memcpy(input, engine->knownRegulatorValues, sampleNum*sizeof(double));
+	
+	while (1)
+	{
+		pthread_mutex_lock(&(engine->lock));
+		first = (engine->isFailed)?taskNum:engine->nextTask;
+		engine->nextTask += SCORE_TASK_CHUNK;
+		pthread_mutex_unlock(&(engine->lock));
+		
+		if (first>=taskNum)
+		{
+			break;
+		}
+		
+		last = (first+SCORE_TASK_CHUNK<taskNum)?first+SCORE_TASK_CHUNK:taskNum;
+		
+		for (t=first;t<last;t++)
+		{
+			if (t<engine->candNum)
+			{
+				memcpy(input+sampleNum, engine->candData[t]->normValues, sampleNum*sizeof(double));
+				engine->candData[t]->score = EvalDistanceCorrelation(engine->target, input, 2, &workspace);
+			}
+			else
+			{
+				//each permutation has its own stream, so the null does not depend on the number of threads,
+				//and draws a random candidate, so the null is not built from a single gene
+				InitRngStream(&rng, engine->seed, t-engine->candNum);
+				candIndex = (int)EquilikelyStream(&rng, engine->candNum);
+				
+				memcpy(input+sampleNum, engine->candData[candIndex]->normValues, sampleNum*sizeof(double));
+				PermuteFloatArraysStream(input+sampleNum, sampleNum, &rng);
+				
+				engine->randomScore[t-engine->candNum] = EvalDistanceCorrelation(engine->target, input, 2, &workspace);
+			}
+		}
+		
+		pthread_mutex_lock(&(engine->lock));
+		
+		if ((engine->finishedTaskNum+last-first)*100/taskNum>engine->finishedTaskNum*100/taskNum)
+		{
+			printf("%d percent of candidates and permutation passes processed. \r", (engine->finishedTaskNum+last-first)*100/taskNum);
+			fflush(stdout);
+		}
+		
+		engine->finishedTaskNum += last-first;
+		pthread_mutex_unlock(&(engine->lock));
 	}
+	
+	free(input);
+	FreeDCorWorkspace(&workspace);
+	
+	return NULL;
 }
 
-//Compute the scores and p-values for each candidate based on distance correlation
-void ComputeScores(GENE_DATA_STRUCT **targetData, int targetNum, GENE_DATA_STRUCT **candData, int candNum, GENE_DATA_STRUCT *knownRegulatorData, int sampleNum, int permutationNum)
+//Compute the scores and p-values for each candidate based on distance correlation. useFastDCor: use the O(n*log(n)) distance correlation.
+//Return 1 if success, -1 if failure
+int ComputeScores(GENE_DATA_STRUCT **targetData, int targetNum, GENE_DATA_STRUCT **candData, int candNum, GENE_DATA_STRUCT *knownRegulatorData, int sampleNum, int permutationNum, int useFastDCor, int threadNum)
 {
 	int i,j;
-	double targetSignatureValues[MAX_SAMPLE_NUM];
-	double regulatorValues[MAX_SAMPLE_NUM];
-	double *randomScore;
+	int result;
+	double *targetSignatureValues;
+	double *randomScore, *candScores;
+	int *counts;
+	DCOR_TARGET_STRUCT target;
+	SCORE_ENGINE_STRUCT engine;
+	pthread_t *threads;
+	
+	assert((targetNum>0)&&(candNum>0)&&(sampleNum>0)&&(permutationNum>0)&&(threadNum>0));
+	
+	targetSignatureValues = (double *)malloc(sampleNum*sizeof(double));
+	randomScore = (double *)malloc(permutationNum*sizeof(double));
+	threads = (pthread_t *)malloc(threadNum*sizeof(pthread_t));
+	
+	assert((targetSignatureValues!=NULL)&&(randomScore!=NULL)&&(threads!=NULL));
 	
-	assert((targetNum>0)&&(candNum>0)&&(sampleNum>0)&&(permutationNum>0));
+	if ((targetSignatureValues==NULL)||(randomScore==NULL)||(threads==NULL))
+	{
+		printf("ERROR: cannot allocate memory for the scores!\n");
+		free(targetSignatureValues);
+		free(randomScore);
+		free(threads);
+		return -1;
+	}
 	
 	//Compute the average of all targets
 	
-	memset(targetSignatureValues, 0, MAX_SAMPLE_NUM*sizeof(double));
+	memset(targetSignatureValues, 0, sampleNum*sizeof(double));
 	
 	for (i=0;i<targetNum;i++)
 	{
@@ -309,59 +451,106 @@ void ComputeScores(GENE_DATA_STRUCT **targetData, int targetNum, GENE_DATA_STRUC
 		targetSignatureValues[j] /= targetNum;
 	}
 	
-	//Compute distance correlation for each candidate
-	memcpy(regulatorValues, knownRegulatorData->normValues, sampleNum*sizeof(double));
+	//the target signature is fixed, so its distance structure is built once and shared read-only by all workers
+	if (PrepareDistanceTarget(&target, targetSignatureValues, sampleNum, useFastDCor)<=0)
+	{
+		printf("ERROR: cannot allocate memory for distance correlation!\n");
+		free(targetSignatureValues);
+		free(randomScore);
+		free(threads);
+		return -1;
+	}
 	
-	printf("Processing candidates.....\n");
+	//Compute distance correlation for each candidate and each permutation
 	
-	for (i=0;i<candNum;i++)
+	printf("Processing candidates and permutations with %d threads.....\n", threadNum);
+	
+	engine.target = &target;
+	engine.candData = candData;
+	engine.candNum = candNum;
+	engine.knownRegulatorValues = knownRegulatorData->normValues;
+	engine.sampleNum = sampleNum;
+	engine.randomScore = randomScore;
+	engine.permutationNum = permutationNum;
+	engine.seed = PERMUTATION_SEED;
+	engine.nextTask = 0;
+	engine.finishedTaskNum = 0;
+	engine.isFailed = 0;
+	pthread_mutex_init(&(engine.lock), NULL);
+	
+	for (i=1;i<threadNum;i++)
 	{
-		memcpy(regulatorValues+sampleNum, candData[i]->normValues, sampleNum*sizeof(double));
-		candData[i]->score = ComputeDistanceCorrelation(regulatorValues, targetSignatureValues, 2, sampleNum);
-		
-		if (i%(candNum/100)==0)
-		{
-			printf("%d percent of candidates processed. \r", i/(candNum/100));
-		}
+		pthread_create(threads+i, NULL, ScoreWorker, &engine);
 	}
 	
-	//Generate random score based on permutation
+	ScoreWorker(&engine);
 	
-	printf("Permutation ......\n");
+	for (i=1;i<threadNum;i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
 	
-	randomScore = (double *)malloc(permutationNum*sizeof(double));
+	pthread_mutex_destroy(&(engine.lock));
 	
-	assert(randomScore!=NULL);
+	printf("\n");
 	
-	for (i=0;i<permutationNum;i++)
+	//the scores of a failed run are incomplete, so no p-values are given
+	if (engine.isFailed)
 	{
-		PermuteFloatArrays(regulatorValues+sampleNum, sampleNum);
-		
-		randomScore[i] = ComputeDistanceCorrelation(regulatorValues, targetSignatureValues, 2, sampleNum);
-		
-		if (i%(permutationNum/100)==0)
-		{
-			printf("%d percent permutation passes finished. \r", i/(permutationNum/100));
-		}
+		printf("ERROR: cannot allocate memory for distance correlation!\n");
+		free(randomScore);
+		free(targetSignatureValues);
+		free(threads);
+		FreeDistanceTarget(&target);
+		return -1;
 	}
 	
 	//Compute pvalues for each candidate
 	
 	QuicksortF(randomScore, 0, permutationNum-1);
 	
-	for (i=0;i<candNum;i++)
+	candScores = (double *)malloc(candNum*sizeof(double));
+	counts = (int *)malloc(candNum*sizeof(int));
+	
+	assert((candScores!=NULL)&&(counts!=NULL));
+	
+	for (i=0;(i<candNum)&&(candScores!=NULL);i++)
 	{
-		candData[i]->pvalue = (permutationNum-0.5-bTreeSearchingF(candData[i]->score, randomScore, 0, permutationNum-1))/permutationNum;
+		candScores[i] = candData[i]->score;
+	}
+	
+	if ((candScores==NULL)||(counts==NULL)||(EcdfBatchCountLess(counts, candScores, candNum, randomScore, permutationNum)<=0))
+	{
+		printf("ERROR: cannot compute the p-values!\n");
+		result = -1;
+	}
+	else
+	{
+		//half a pseudo-count keeps p-values above zero when a candidate beats every random score
+		for (i=0;i<candNum;i++)
+		{
+			candData[i]->pvalue = (permutationNum-counts[i]+0.5)/(permutationNum+1);
+		}
+		
+		result = 1;
 	}
 	
 	free(randomScore);
+	free(candScores);
+	free(counts);
+	free(targetSignatureValues);
+	free(threads);
+	FreeDistanceTarget(&target);
+	
+	return result;
 }
 
 //Write to output file
 int WriteToOutput(char *fileName, GENE_DATA_STRUCT **candData, int candNum)
 {
 	FILE *fh;
-	int i;
+	TEXT_BUFFER_STRUCT buf;
+	int i, result;
 	
 	fh = (FILE *)fopen(fileName, "w");
 	
@@ -370,14 +559,31 @@ int WriteToOutput(char *fileName, GENE_DATA_STRUCT **candData, int candNum)
 		return 0;
 	}
 	
+	if (InitTextBuffer(&buf, fh, OUTPUT_BUFFER_SIZE)<=0)
+	{
+		fclose(fh);
+		return 0;
+	}
+	
 	for (i=0;i<candNum;i++)
 	{
-		fprintf(fh, "%s\t%f\t%f\n", candData[i]->name, candData[i]->score, candData[i]->pvalue);
+		AppendString(&buf, candData[i]->name);
+		AppendChars(&buf, "\t", 1);
+		AppendFixed(&buf, candData[i]->score, 6);
+		AppendChars(&buf, "\t", 1);
+		AppendFixed(&buf, candData[i]->pvalue, 6);
+		AppendChars(&buf, "\n", 1);
 	}
 	
-	fclose(fh);
+	result = FlushTextBuffer(&buf);
+	FreeTextBuffer(&buf);
 	
-	return 1;
+	if (fclose(fh)!=0)
+	{
+		result = -1;
+	}
+	
+	return (result>0)?1:0;
 }
 
 //print command usage 
@@ -391,18 +597,22 @@ void PrintCommandUsage()
 	printf("-c <candidate gene id file>\n");
 	printf("-r <name of known regulator>\n");
 	printf("-o <output file>\n");
+	printf("-m <distance correlation: exact or fast> (optional, default: exact)\n");
+	printf("-p <number of threads> (optional, default: number of processors)\n");
 	printf("example:\n");
 	printf("RegulatorMiner -d BRCA_sample_expression.txt -t ER_target_ID.txt -c candidate_ID.txt -r ESR1 -o output.txt \n");
 }
 
 int main (int argc, const char * argv[]) 
 {
-	char expressionFileName[1000], targetIDFileName[1000], candidateIDFileName[1000], knownRegulatorID[1000], outputFileName[1000];
+	char expressionFileName[1000], targetIDFileName[1000], candidateIDFileName[1000], knownRegulatorID[1000], outputFileName[1000], methodName[1000];
 	GENE_DATA_STRUCT *expressions;
 	GENE_DATA_STRUCT **targetData;
 	GENE_DATA_STRUCT **candData;
 	GENE_DATA_STRUCT *knownRegulatorData;
 	int allGeneNum, targetGeneNum, candGeneNum, sampleNum, tmpIndex;
+	int useFastDCor;
+	int threadNum;
 	int i;
 	
 	
@@ -418,6 +628,8 @@ int main (int argc, const char * argv[])
 	candidateIDFileName[0] = 0;
 	knownRegulatorID[0] = 0;
 	outputFileName[0] = 0;
+	methodName[0] = 0;
+	threadNum = (int)sysconf(_SC_NPROCESSORS_ONLN);
 	
 	for (i=2;i<argc;i++)
 	{
@@ -441,9 +653,18 @@ int main (int argc, const char * argv[])
 		{
 			strcpy(outputFileName, argv[i]);
 		}
+		if (strcmp(argv[i-1], "-m")==0)
+		{
+			strcpy(methodName, argv[i]);
+		}
+		if (strcmp(argv[i-1], "-p")==0)
+		{
+			threadNum = atoi(argv[i]);
+		}
 	}
 	
-	if ((expressionFileName[0]==0)||(targetIDFileName[0]==0)||(candidateIDFileName[0]==0)||(knownRegulatorID[0]==0)||(outputFileName[0]==0))
+	if ((expressionFileName[0]==0)||(targetIDFileName[0]==0)||(candidateIDFileName[0]==0)||(knownRegulatorID[0]==0)||(outputFileName[0]==0)
+		||((methodName[0]!=0)&&(strcmp(methodName, "exact")!=0)&&(strcmp(methodName, "fast")!=0))||(threadNum<=0))
 	{
 		printf("Command error!\n");
 		PrintCommandUsage();
@@ -520,7 +741,18 @@ int main (int argc, const char * argv[])
 	
 	NSTNormData(expressions, allGeneNum, sampleNum);
 	
-	ComputeScores(targetData, targetGeneNum, candData, candGeneNum, knownRegulatorData, sampleNum, PERMUTATION_TIMES);
+	//the fast approximation is opt-in; the exact statistic stays the default at any sample size
+	useFastDCor = (strcmp(methodName, "fast")==0);
+	
+	printf("Using %s distance correlation.\n", useFastDCor?"fast":"exact");
+	
+	if (ComputeScores(targetData, targetGeneNum, candData, candGeneNum, knownRegulatorData, sampleNum, PERMUTATION_TIMES, useFastDCor, threadNum)<=0)
+	{
+		FreeExpressionStruct(&expressions, allGeneNum);
+		free(targetData);
+		free(candData);
+		return -1;
+	}
 	
 	if (!WriteToOutput(outputFileName, candData, candGeneNum))
 	{
@@ -0,0 +1,1469 @@
+/*
+ *  assoc.c
+ *  Association kernels between a set of features and the rows of an expression matrix
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "math_api.h"
+#include "sort.h"
+#include "assoc.h"
+
+#define BIWEIGHT_MAD_SCALE 9.0		//u = (x-median)/(BIWEIGHT_MAD_SCALE*MAD)
+
+//Scratch of one Kendall tau worker. The feature part is filled once per feature by PrepareKendallFeature
+typedef struct
+{
+	int dim;
+	INDEXED_FLOAT *sortBuf;
+	int *order;			//sort permutation of the feature
+	int *runEnd;		//runEnd[i]: end (exclusive) of the run of tied feature values that sorted position i belongs to
+	double tiedPairs;	//tied pairs of the feature
+	int *y;				//row ranks in feature order
+	int *tree;			//Fenwick tree over the 2*dim-1 doubled ranks, 1-based
+	int *tieCounts;		//per-rank counter, all 0 between uses
+}KENDALL_WORKSPACE_STRUCT;
+
+//Shared state of the KendallBlock workers
+typedef struct
+{
+	double *corr;
+	double *features;
+	int featureNum;
+	KENDALL_ROWS_STRUCT *rows;
+	int nextFeature;
+	pthread_mutex_t lock;
+}KENDALL_ENGINE_STRUCT;
+
+//Allocate the scratch of a Kendall tau worker. Return 1 if success, -1 if failure
+int AllocKendallWorkspace(KENDALL_WORKSPACE_STRUCT *ws, int dim);
+
+//Free the scratch of a Kendall tau worker
+void FreeKendallWorkspace(KENDALL_WORKSPACE_STRUCT *ws);
+
+//Sort a feature once and record its order, its runs of ties and its tied pairs
+void PrepareKendallFeature(KENDALL_WORKSPACE_STRUCT *ws, double *feature);
+
+//Kendall tau-b of the prepared feature with one prepared row
+double KendallTauPrepared(KENDALL_WORKSPACE_STRUCT *ws, int *rank, double rowTiedPairs);
+
+//Worker thread of KendallBlock. Takes features one at a time until none are left
+void *KendallWorker(void *arg);
+
+//Exact sum of the products of two rows of dim 16 bit codes
+double QuantDotProduct(short *a, short *b, int dim);
+
+//Replace every row of a rowNum*dim matrix by its ranks, tied values sharing their average rank. Return 1 if success, -1 if failure
+int RankMatrixRows(double *matrix, int rowNum, int dim)
+{
+	INDEXED_FLOAT *sortBuf;
+	int *rank2;
+	int i;
+	
+	sortBuf = (INDEXED_FLOAT *)malloc(dim*sizeof(INDEXED_FLOAT));
+	rank2 = (int *)malloc(dim*sizeof(int));
+	
+	assert((sortBuf!=NULL)&&(rank2!=NULL));
+	
+	if ((sortBuf==NULL)||(rank2==NULL))
+	{
+		free(sortBuf);
+		free(rank2);
+		return -1;
+	}
+	
+	for (i=0;i<rowNum;i++)
+	{
+		AverageRanking(matrix+(size_t)i*dim, matrix+(size_t)i*dim, sortBuf, rank2, dim);
+	}
+	
+	free(sortBuf);
+	free(rank2);
+	
+	return 1;
+}
+
+//Center every row of a rowNum*dim matrix and scale it to unit norm, so the Pearson correlation of two rows is their dot product.
+//Constant rows become 0
+void StandardizeMatrixRows(double *matrix, int rowNum, int dim)
+{
+	int i;
+	
+	for (i=0;i<rowNum;i++)
+	{
+		StandardizeArray(matrix+(size_t)i*dim, matrix+(size_t)i*dim, dim);
+	}
+}
+
+//Replace every row of a rowNum*dim matrix by its biweight midcorrelation form: (x-med)*w with Tukey weights
+//w = (1-u^2)^2 for |u|<1, u = (x-med)/(9*MAD), scaled to unit norm. The dot product of two such rows is their bicor.
+//Rows with a zero MAD fall back to the Pearson form of StandardizeMatrixRows. Return 1 if success, -1 if failure
+int BiweightMatrixRows(double *matrix, int rowNum, int dim)
+{
+	double *tmp, *row;
+	double median, mad, u, norm;
+	int i, k;
+	
+	tmp = (double *)malloc(dim*sizeof(double));
+	
+	assert(tmp!=NULL);
+	
+	if (tmp==NULL)
+	{
+		return -1;
+	}
+	
+	for (i=0;i<rowNum;i++)
+	{
+		row = matrix+(size_t)i*dim;
+		
+		//median and MAD by linear-time selection on a scratch copy
+		memcpy(tmp, row, dim*sizeof(double));
+		median = MedianF(tmp, dim);
+		
+		for (k=0;k<dim;k++)
+		{
+			tmp[k] = fabs(row[k]-median);
+		}
+		
+		mad = MedianF(tmp, dim);
+		
+		if (mad<=0)
+		{
+			StandardizeArray(row, row, dim);
+			continue;
+		}
+		
+		norm = 0;
+		
+		for (k=0;k<dim;k++)
+		{
+			u = (row[k]-median)/(BIWEIGHT_MAD_SCALE*mad);
+			
+			if (fabs(u)<1)
+			{
+				row[k] = (row[k]-median)*(1-u*u)*(1-u*u);
+			}
+			else
+			{
+				row[k] = 0;
+			}
+			
+			norm += row[k]*row[k];
+		}
+		
+		norm = sqrt(norm);
+		
+		for (k=0;k<dim;k++)
+		{
+			row[k] = (norm>0)?row[k]/norm:0;
+		}
+	}
+	
+	free(tmp);
+	
+	return 1;
+}
+
+//the accumulators of CorrelateBlock are unrolled by hand for blocks of 4 features
+#if CORRELATE_BLOCK_NUM!=4
+#error "CorrelateBlock is unrolled for CORRELATE_BLOCK_NUM 4"
+#endif
+
+//Correlations of featureNum standardized features with rowNum standardized rows, corr[f*rowNum+r]. The features are taken
+//CORRELATE_BLOCK_NUM at a time, so each row is read once per block
+void CorrelateBlock(double *corr, double *features, int featureNum, double *rows, int rowNum, int dim)
+{
+	int f, r, k;
+	double s0, s1, s2, s3;
+	double *f0, *f1, *f2, *f3, *row;
+	
+	for (f=0;f+CORRELATE_BLOCK_NUM<=featureNum;f+=CORRELATE_BLOCK_NUM)
+	{
+		f0 = features+(size_t)f*dim;
+		f1 = f0+dim;
+		f2 = f1+dim;
+		f3 = f2+dim;
+		
+		for (r=0;r<rowNum;r++)
+		{
+			row = rows+(size_t)r*dim;
+			s0 = s1 = s2 = s3 = 0;
+			
+			for (k=0;k<dim;k++)
+			{
+				s0 += f0[k]*row[k];
+				s1 += f1[k]*row[k];
+				s2 += f2[k]*row[k];
+				s3 += f3[k]*row[k];
+			}
+			
+			corr[(size_t)f*rowNum+r] = s0;
+			corr[(size_t)(f+1)*rowNum+r] = s1;
+			corr[(size_t)(f+2)*rowNum+r] = s2;
+			corr[(size_t)(f+3)*rowNum+r] = s3;
+		}
+	}
+	
+	//remaining features one at a time
+	for (;f<featureNum;f++)
+	{
+		for (r=0;r<rowNum;r++)
+		{
+			corr[(size_t)f*rowNum+r] = DotProduct(features+(size_t)f*dim, rows+(size_t)r*dim, dim);
+		}
+	}
+}
+
+//Prepare the rows of a rowNum*dim matrix for KendallBlock. Return 1 if success, -1 if failure
+int PrepareKendallRows(KENDALL_ROWS_STRUCT *rows, double *matrix, int rowNum, int dim)
+{
+	INDEXED_FLOAT *sortBuf;
+	int i, first, last;
+	
+	rows->ranks = (int *)malloc((size_t)rowNum*dim*sizeof(int));
+	rows->tiedPairs = (double *)malloc(rowNum*sizeof(double));
+	sortBuf = (INDEXED_FLOAT *)malloc(dim*sizeof(INDEXED_FLOAT));
+	rows->rowNum = rowNum;
+	rows->dim = dim;
+	
+	assert((rows->ranks!=NULL)&&(rows->tiedPairs!=NULL)&&(sortBuf!=NULL));
+	
+	if ((rows->ranks==NULL)||(rows->tiedPairs==NULL)||(sortBuf==NULL))
+	{
+		FreeKendallRows(rows);
+		free(sortBuf);
+		return -1;
+	}
+	
+	for (i=0;i<rowNum;i++)
+	{
+		//tied values get equal ranks and the order is kept, which is all Kendall tau looks at
+		DoubledRanking(rows->ranks+(size_t)i*dim, matrix+(size_t)i*dim, sortBuf, dim);
+		
+		rows->tiedPairs[i] = 0;
+		
+		//sortBuf is left sorted, and the doubled rank of a run of ties starting at sorted position first is first+last
+		for (first=0;first<dim;first=last+1)
+		{
+			last = rows->ranks[(size_t)i*dim+sortBuf[first].index]-first;
+			
+			rows->tiedPairs[i] += 0.5*(double)(last-first+1)*(last-first);
+		}
+	}
+	
+	free(sortBuf);
+	
+	return 1;
+}
+
+//Free the prepared rows
+void FreeKendallRows(KENDALL_ROWS_STRUCT *rows)
+{
+	free(rows->ranks);
+	free(rows->tiedPairs);
+	rows->ranks = NULL;
+	rows->tiedPairs = NULL;
+}
+
+//Allocate the scratch of a Kendall tau worker. Return 1 if success, -1 if failure
+int AllocKendallWorkspace(KENDALL_WORKSPACE_STRUCT *ws, int dim)
+{
+	ws->dim = dim;
+	ws->sortBuf = (INDEXED_FLOAT *)malloc(dim*sizeof(INDEXED_FLOAT));
+	ws->order = (int *)malloc(dim*sizeof(int));
+	ws->runEnd = (int *)malloc(dim*sizeof(int));
+	ws->y = (int *)malloc(dim*sizeof(int));
+	ws->tree = (int *)malloc((2*dim+1)*sizeof(int));
+	ws->tieCounts = (int *)calloc(2*dim, sizeof(int));
+	ws->tiedPairs = 0;
+	
+	assert((ws->sortBuf!=NULL)&&(ws->order!=NULL)&&(ws->runEnd!=NULL)&&(ws->y!=NULL)&&(ws->tree!=NULL)&&(ws->tieCounts!=NULL));
+	
+	if ((ws->sortBuf==NULL)||(ws->order==NULL)||(ws->runEnd==NULL)||(ws->y==NULL)||(ws->tree==NULL)||(ws->tieCounts==NULL))
+	{
+		FreeKendallWorkspace(ws);
+		return -1;
+	}
+	
+	return 1;
+}
+
+//Free the scratch of a Kendall tau worker
+void FreeKendallWorkspace(KENDALL_WORKSPACE_STRUCT *ws)
+{
+	free(ws->sortBuf);
+	free(ws->order);
+	free(ws->runEnd);
+	free(ws->y);
+	free(ws->tree);
+	free(ws->tieCounts);
+	ws->sortBuf = NULL;
+	ws->order = NULL;
+	ws->runEnd = NULL;
+	ws->y = NULL;
+	ws->tree = NULL;
+	ws->tieCounts = NULL;
+}
+
+//Sort a feature once and record its order, its runs of ties and its tied pairs
+void PrepareKendallFeature(KENDALL_WORKSPACE_STRUCT *ws, double *feature)
+{
+	int i, first, last;
+	int dim = ws->dim;
+	
+	for (i=0;i<dim;i++)
+	{
+		ws->sortBuf[i].value = feature[i];
+		ws->sortBuf[i].index = i;
+	}
+	
+	QuicksortIndexedArray(ws->sortBuf, 0, dim-1);
+	
+	ws->tiedPairs = 0;
+	
+	for (first=0;first<dim;first=last+1)
+	{
+		for (last=first;(last+1<dim)&&(ws->sortBuf[last+1].value==ws->sortBuf[first].value);last++)
+		{
+		}
+		
+		for (i=first;i<=last;i++)
+		{
+			ws->order[i] = ws->sortBuf[i].index;
+			ws->runEnd[i] = last+1;
+		}
+		
+		ws->tiedPairs += 0.5*(double)(last-first+1)*(last-first);
+	}
+}
+
+//Kendall tau-b of the prepared feature with one prepared row
+double KendallTauPrepared(KENDALL_WORKSPACE_STRUCT *ws, int *rank, double rowTiedPairs)
+{
+	int dim = ws->dim;
+	int treeSize = 2*dim;
+	int i, k, first, last, count, insertedNum;
+	int *tree = ws->tree;
+	double pairNum, jointTiedPairs, discordant, denom;
+	
+	memset(tree, 0, (treeSize+1)*sizeof(int));
+	
+	insertedNum = 0;
+	discordant = 0;
+	jointTiedPairs = 0;
+	
+	//walk the runs of tied feature values in feature order. An item is discordant with every item of an earlier run
+	//that has a larger row rank, so each run is counted against the tree before it is added to it
+	for (first=0;first<dim;first=last)
+	{
+		last = ws->runEnd[first];
+		
+		for (i=first;i<last;i++)
+		{
+			ws->y[i] = rank[ws->order[i]];
+			
+			count = 0;
+			
+			for (k=ws->y[i]+1;k>0;k-=k&(-k))
+			{
+				count += tree[k];
+			}
+			
+			discordant += insertedNum-count;
+		}
+		
+		//pairs tied in both, counted with a per-rank counter that is cleared again
+		if (last-first>1)
+		{
+			for (i=first;i<last;i++)
+			{
+				jointTiedPairs += ws->tieCounts[ws->y[i]]++;
+			}
+			
+			for (i=first;i<last;i++)
+			{
+				ws->tieCounts[ws->y[i]] = 0;
+			}
+		}
+		
+		for (i=first;i<last;i++)
+		{
+			for (k=ws->y[i]+1;k<=treeSize;k+=k&(-k))
+			{
+				tree[k]++;
+			}
+		}
+		
+		insertedNum += last-first;
+	}
+	
+	pairNum = 0.5*(double)dim*(dim-1);
+	denom = (pairNum-ws->tiedPairs)*(pairNum-rowTiedPairs);
+	
+	if (denom<=0)
+	{
+		return 0;
+	}
+	
+	return (pairNum-ws->tiedPairs-rowTiedPairs+jointTiedPairs-2*discordant)/sqrt(denom);
+}
+
+//Worker thread of KendallBlock. Takes features one at a time until none are left
+void *KendallWorker(void *arg)
+{
+	KENDALL_ENGINE_STRUCT *engine = (KENDALL_ENGINE_STRUCT *)arg;
+	KENDALL_ROWS_STRUCT *rows = engine->rows;
+	KENDALL_WORKSPACE_STRUCT ws;
+	int f, r;
+	
+	if (AllocKendallWorkspace(&ws, rows->dim)<=0)
+	{
+		return NULL;
+	}
+	
+	while (1)
+	{
+		pthread_mutex_lock(&(engine->lock));
+		f = engine->nextFeature;
+		engine->nextFeature++;
+		pthread_mutex_unlock(&(engine->lock));
+		
+		if (f>=engine->featureNum)
+		{
+			break;
+		}
+		
+		PrepareKendallFeature(&ws, engine->features+(size_t)f*rows->dim);
+		
+		for (r=0;r<rows->rowNum;r++)
+		{
+			engine->corr[(size_t)f*rows->rowNum+r] = KendallTauPrepared(&ws, rows->ranks+(size_t)r*rows->dim, rows->tiedPairs[r]);
+		}
+	}
+	
+	FreeKendallWorkspace(&ws);
+	
+	return NULL;
+}
+
+//Kendall tau-b of featureNum features with all prepared rows, corr[f*rowNum+r], by Knight's O(dim*log(dim)) algorithm.
+//Each feature is sorted once and its order reused for all rows. threadNum threads share the features. Return 1 if success, -1 if failure
+int KendallBlock(double *corr, double *features, int featureNum, KENDALL_ROWS_STRUCT *rows, int threadNum)
+{
+	KENDALL_ENGINE_STRUCT engine;
+	pthread_t *threads;
+	int i;
+	
+	if (threadNum>featureNum)
+	{
+		threadNum = featureNum;
+	}
+	
+	if (threadNum<=0)
+	{
+		return (featureNum==0)?1:-1;
+	}
+	
+	threads = (pthread_t *)malloc(threadNum*sizeof(pthread_t));
+	
+	assert(threads!=NULL);
+	
+	if (threads==NULL)
+	{
+		return -1;
+	}
+	
+	engine.corr = corr;
+	engine.features = features;
+	engine.featureNum = featureNum;
+	engine.rows = rows;
+	engine.nextFeature = 0;
+	pthread_mutex_init(&(engine.lock), NULL);
+	
+	for (i=1;i<threadNum;i++)
+	{
+		pthread_create(threads+i, NULL, KendallWorker, &engine);
+	}
+	
+	KendallWorker(&engine);
+	
+	for (i=1;i<threadNum;i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	
+	pthread_mutex_destroy(&(engine.lock));
+	free(threads);
+	
+	//a worker without scratch leaves its share to the others, so only a failure of all of them loses features
+	return (engine.nextFeature>=featureNum)?1:-1;
+}
+
+//Number of equal-frequency bins used for mutual information of dim samples: the cube root of dim, within 2..MI_MAX_BIN_NUM
+int MutualInfoBinNum(int dim)
+{
+	int binNum = (int)floor(cbrt((double)dim)+0.5);
+	
+	return (binNum<2)?2:((binNum>MI_MAX_BIN_NUM)?MI_MAX_BIN_NUM:binNum);
+}
+
+//Replace every value of a rowNum*dim matrix by its equal-frequency bin code 0..binNum-1, from its average rank.
+//Tied values share a bin. Return 1 if success, -1 if failure
+int DiscretizeMatrixRows(double *matrix, int rowNum, int dim, int binNum)
+{
+	int i, k, code;
+	double *row;
+	
+	if (RankMatrixRows(matrix, rowNum, dim)<=0)
+	{
+		return -1;
+	}
+	
+	for (i=0;i<rowNum;i++)
+	{
+		row = matrix+(size_t)i*dim;
+		
+		for (k=0;k<dim;k++)
+		{
+			code = (int)((row[k]+0.5)*binNum/dim);
+			row[k] = (code<binNum)?code:binNum-1;
+		}
+	}
+	
+	return 1;
+}
+
+//Prepare the rows of a rowNum*dim matrix for MutualInfoBlock: bin codes in unsigned char and row entropies. Return 1 if success, -1 if failure
+int PrepareMutualInfoRows(MI_ROWS_STRUCT *rows, double *matrix, int rowNum, int dim, int binNum)
+{
+	double *codes;
+	int counts[MI_MAX_BIN_NUM];
+	int i, k;
+	
+	assert((binNum>=2)&&(binNum<=MI_MAX_BIN_NUM));
+	
+	rows->codes = (unsigned char *)malloc((size_t)rowNum*dim);
+	rows->entropies = (double *)malloc(rowNum*sizeof(double));
+	rows->countLogCount = (double *)malloc((dim+1)*sizeof(double));
+	codes = (double *)malloc((size_t)rowNum*dim*sizeof(double));
+	rows->rowNum = rowNum;
+	rows->dim = dim;
+	rows->binNum = binNum;
+	
+	assert((rows->codes!=NULL)&&(rows->entropies!=NULL)&&(rows->countLogCount!=NULL)&&(codes!=NULL));
+	
+	if ((rows->codes==NULL)||(rows->entropies==NULL)||(rows->countLogCount==NULL)||(codes==NULL))
+	{
+		FreeMutualInfoRows(rows);
+		free(codes);
+		return -1;
+	}
+	
+	memcpy(codes, matrix, (size_t)rowNum*dim*sizeof(double));
+	
+	if (DiscretizeMatrixRows(codes, rowNum, dim, binNum)<=0)
+	{
+		FreeMutualInfoRows(rows);
+		free(codes);
+		return -1;
+	}
+	
+	rows->countLogCount[0] = 0;
+	
+	for (k=1;k<=dim;k++)
+	{
+		rows->countLogCount[k] = k*log((double)k);
+	}
+	
+	for (i=0;i<rowNum;i++)
+	{
+		memset(counts, 0, sizeof(counts));
+		
+		for (k=0;k<dim;k++)
+		{
+			rows->codes[(size_t)i*dim+k] = (unsigned char)codes[(size_t)i*dim+k];
+			counts[(int)codes[(size_t)i*dim+k]]++;
+		}
+		
+		//H = log(n)-sum(c*log(c))/n
+		rows->entropies[i] = 0;
+		
+		for (k=0;k<binNum;k++)
+		{
+			rows->entropies[i] += rows->countLogCount[counts[k]];
+		}
+		
+		rows->entropies[i] = log((double)dim)-rows->entropies[i]/dim;
+	}
+	
+	free(codes);
+	
+	return 1;
+}
+
+//Free the prepared rows
+void FreeMutualInfoRows(MI_ROWS_STRUCT *rows)
+{
+	free(rows->codes);
+	free(rows->entropies);
+	free(rows->countLogCount);
+	rows->codes = NULL;
+	rows->entropies = NULL;
+	rows->countLogCount = NULL;
+}
+
+//Mutual information (in nats) of featureNum features, given as bin codes by DiscretizeMatrixRows, with all prepared rows,
+//corr[f*rowNum+r]. Each row is histogrammed against CORRELATE_BLOCK_NUM features while its codes are in cache. Return 1 if success, -1 if failure
+int MutualInfoBlock(double *corr, double *features, int featureNum, MI_ROWS_STRUCT *rows)
+{
+	int dim = rows->dim;
+	int binNum = rows->binNum;
+	int cellNum = binNum*binNum;
+	int hist[CORRELATE_BLOCK_NUM][MI_MAX_BIN_NUM*MI_MAX_BIN_NUM];
+	int counts[MI_MAX_BIN_NUM];
+	double featureEntropies[CORRELATE_BLOCK_NUM];
+	unsigned char *featureCodes, *rowCodes;
+	double jointSum;
+	int first, blockNum, f, r, k, c;
+	
+	//feature codes are stored premultiplied by binNum, so a joint cell is one addition
+	featureCodes = (unsigned char *)malloc(CORRELATE_BLOCK_NUM*dim);
+	
+	assert(featureCodes!=NULL);
+	
+	if (featureCodes==NULL)
+	{
+		return -1;
+	}
+	
+	for (first=0;first<featureNum;first+=CORRELATE_BLOCK_NUM)
+	{
+		blockNum = (first+CORRELATE_BLOCK_NUM<=featureNum)?CORRELATE_BLOCK_NUM:featureNum-first;
+		
+		for (f=0;f<blockNum;f++)
+		{
+			memset(counts, 0, sizeof(counts));
+			
+			for (k=0;k<dim;k++)
+			{
+				c = (int)features[(size_t)(first+f)*dim+k];
+				featureCodes[f*dim+k] = (unsigned char)(c*binNum);
+				counts[c]++;
+			}
+			
+			featureEntropies[f] = 0;
+			
+			for (c=0;c<binNum;c++)
+			{
+				featureEntropies[f] += rows->countLogCount[counts[c]];
+			}
+			
+			featureEntropies[f] = log((double)dim)-featureEntropies[f]/dim;
+		}
+		
+		for (r=0;r<rows->rowNum;r++)
+		{
+			rowCodes = rows->codes+(size_t)r*dim;
+			
+			for (f=0;f<blockNum;f++)
+			{
+				memset(hist[f], 0, cellNum*sizeof(int));
+				
+				for (k=0;k<dim;k++)
+				{
+					hist[f][featureCodes[f*dim+k]+rowCodes[k]]++;
+				}
+				
+				//MI = H(feature)+H(row)-H(feature,row)
+				jointSum = 0;
+				
+				for (c=0;c<cellNum;c++)
+				{
+					jointSum += rows->countLogCount[hist[f][c]];
+				}
+				
+				corr[(size_t)(first+f)*rows->rowNum+r] = featureEntropies[f]+rows->entropies[r]-(log((double)dim)-jointSum/dim);
+			}
+		}
+	}
+	
+	free(featureCodes);
+	
+	return 1;
+}
+
+//Return 1 if every value of a rowNum*dim matrix is 0 or 1, otherwise 0
+int IsBinaryMatrixRows(double *matrix, int rowNum, int dim)
+{
+	size_t i, num = (size_t)rowNum*dim;
+	
+	for (i=0;i<num;i++)
+	{
+		if ((matrix[i]!=0)&&(matrix[i]!=1))
+		{
+			return 0;
+		}
+	}
+	
+	return 1;
+}
+
+//Pack a 0/1 row of dim values into (dim+BIT_WORD_SIZE-1)/BIT_WORD_SIZE words. Nonzero values are set bits
+void PackBinaryRow(unsigned long long *bits, double *row, int dim)
+{
+	int k;
+	
+	memset(bits, 0, ((dim+BIT_WORD_SIZE-1)/BIT_WORD_SIZE)*sizeof(unsigned long long));
+	
+	for (k=0;k<dim;k++)
+	{
+		if (row[k]!=0)
+		{
+			bits[k/BIT_WORD_SIZE] |= 1ULL<<(k%BIT_WORD_SIZE);
+		}
+	}
+}
+
+//Unpack a packed row into dim 0/1 values
+void UnpackBinaryRow(double *row, unsigned long long *bits, int dim)
+{
+	int k;
+	
+	for (k=0;k<dim;k++)
+	{
+		row[k] = (double)((bits[k/BIT_WORD_SIZE]>>(k%BIT_WORD_SIZE))&1ULL);
+	}
+}
+
+//Pack the rows of a 0/1 rowNum*dim matrix. Return 1 if success, -1 if failure
+int PackBinaryRows(BIT_ROWS_STRUCT *rows, double *matrix, int rowNum, int dim)
+{
+	int i;
+	
+	rows->rowNum = rowNum;
+	rows->dim = dim;
+	rows->wordNum = (dim+BIT_WORD_SIZE-1)/BIT_WORD_SIZE;
+	rows->bits = (unsigned long long *)malloc((size_t)rowNum*rows->wordNum*sizeof(unsigned long long));
+	
+	assert(rows->bits!=NULL);
+	
+	if (rows->bits==NULL)
+	{
+		return -1;
+	}
+	
+	for (i=0;i<rowNum;i++)
+	{
+		PackBinaryRow(rows->bits+(size_t)i*rows->wordNum, matrix+(size_t)i*dim, dim);
+	}
+	
+	return 1;
+}
+
+//Free the packed rows
+void FreeBinaryRows(BIT_ROWS_STRUCT *rows)
+{
+	free(rows->bits);
+	rows->bits = NULL;
+}
+
+//Point-biserial (Pearson) correlations of featureNum packed 0/1 features with rowNum standardized rows, corr[f*rowNum+r].
+//A centered unit-norm row correlates with a feature of m set bits as the sum of its values at the set bits times
+//sqrt(dim/(m*(dim-m))), so only the smaller of the two groups is summed and no multiply is done per sample.
+//Constant features correlate 0. Return 1 if success, -1 if failure
+int PointBiserialBlock(double *corr, unsigned long long *features, int featureNum, int wordNum, double *rows, int rowNum, int dim)
+{
+	int *index, *indexNum;
+	double *scale;
+	unsigned long long word, *bits;
+	double *row, s;
+	int f, r, w, k, m, num;
+	
+	index = (int *)malloc((size_t)featureNum*dim*sizeof(int));
+	indexNum = (int *)malloc(featureNum*sizeof(int));
+	scale = (double *)malloc(featureNum*sizeof(double));
+	
+	assert((index!=NULL)&&(indexNum!=NULL)&&(scale!=NULL));
+	
+	if ((index==NULL)||(indexNum==NULL)||(scale==NULL))
+	{
+		free(index);
+		free(indexNum);
+		free(scale);
+		return -1;
+	}
+	
+	//the group of each feature to be summed, as sample indices. A row sums to 0, so the sum over the set bits is minus
+	//the sum over the clear bits, and the smaller group is taken
+	for (f=0;f<featureNum;f++)
+	{
+		bits = features+(size_t)f*wordNum;
+		m = 0;
+		
+		for (w=0;w<wordNum;w++)
+		{
+			m += __builtin_popcountll(bits[w]);
+		}
+		
+		indexNum[f] = 0;
+		
+		if ((m==0)||(m==dim))
+		{
+			scale[f] = 0;
+			continue;
+		}
+		
+		scale[f] = sqrt((double)dim/((double)m*(dim-m)));
+		
+		if (2*m>dim)
+		{
+			scale[f] = -scale[f];
+		}
+		
+		for (w=0;w<wordNum;w++)
+		{
+			word = (2*m>dim)?~bits[w]:bits[w];
+			
+			//bits past dim in the last word are not samples
+			if ((w==wordNum-1)&&(dim%BIT_WORD_SIZE))
+			{
+				word &= (1ULL<<(dim%BIT_WORD_SIZE))-1;
+			}
+			
+			while (word)
+			{
+				index[(size_t)f*dim+indexNum[f]++] = w*BIT_WORD_SIZE+__builtin_ctzll(word);
+				word &= word-1;
+			}
+		}
+	}
+	
+	//each row stays in cache while all features gather from it
+	for (r=0;r<rowNum;r++)
+	{
+		row = rows+(size_t)r*dim;
+		
+		for (f=0;f<featureNum;f++)
+		{
+			s = 0;
+			num = indexNum[f];
+			
+			for (k=0;k<num;k++)
+			{
+				s += row[index[(size_t)f*dim+k]];
+			}
+			
+			corr[(size_t)f*rowNum+r] = s*scale[f];
+		}
+	}
+	
+	free(index);
+	free(indexNum);
+	free(scale);
+	
+	return 1;
+}
+
+//Pearson correlations of featureNum sparse features with rowNum standardized rows, corr[f*rowNum+r]. The nonzeros of feature f
+//are values[k] in columns[k] for featureStart[f]<=k<featureStart[f+1], and its other values are 0. A centered row sums to 0,
+//so the covariance is the dot product over the nonzeros alone, scaled by the feature norm from its sum and sum of squares.
+//The cost is proportional to the nonzeros. Constant features correlate 0. Return 1 if success, -1 if failure
+int SparseCorrelateBlock(double *corr, int *featureStart, int *columns, double *values, int featureNum, double *rows, int rowNum, int dim)
+{
+	double *scale;
+	double *row, sum, sumSquare, norm, s;
+	int f, r, k, last;
+	
+	scale = (double *)malloc(featureNum*sizeof(double));
+	
+	assert(scale!=NULL);
+	
+	if (scale==NULL)
+	{
+		return -1;
+	}
+	
+	for (f=0;f<featureNum;f++)
+	{
+		sum = 0;
+		sumSquare = 0;
+		
+		for (k=featureStart[f];k<featureStart[f+1];k++)
+		{
+			sum += values[k];
+			sumSquare += values[k]*values[k];
+		}
+		
+		//norm of the centered feature, the same threshold as StandardizeArray
+		norm = sumSquare-sum*sum/dim;
+		norm = (norm>0)?sqrt(norm):0;
+		scale[f] = (norm<0.00000000001)?0:1/norm;
+	}
+	
+	//each row stays in cache while all features gather from it
+	for (r=0;r<rowNum;r++)
+	{
+		row = rows+(size_t)r*dim;
+		
+		for (f=0;f<featureNum;f++)
+		{
+			s = 0;
+			last = featureStart[f+1];
+			
+			for (k=featureStart[f];k<last;k++)
+			{
+				s += values[k]*row[columns[k]];
+			}
+			
+			corr[(size_t)f*rowNum+r] = s*scale[f];
+		}
+	}
+	
+	free(scale);
+	
+	return 1;
+}
+
+//Centered norms of rowNum sparse rows of dim values, sqrt(sum(x^2)-sum(x)^2/dim) from the nonzeros alone. The nonzeros of row i
+//are values[k] for rowStart[i]<=k<rowStart[i+1]
+void SparseRowNorms(double *norms, int *rowStart, double *values, int rowNum, int dim)
+{
+	double sum, sumSquare, norm;
+	int i, k;
+	
+	for (i=0;i<rowNum;i++)
+	{
+		sum = 0;
+		sumSquare = 0;
+		
+		for (k=rowStart[i];k<rowStart[i+1];k++)
+		{
+			sum += values[k];
+			sumSquare += values[k]*values[k];
+		}
+		
+		norm = sumSquare-sum*sum/dim;
+		norms[i] = (norm>0)?sqrt(norm):0;
+	}
+}
+
+//Pearson correlations of featureNum standardized features with rowNum sparse rows, corr[f*rowNum+r]. A standardized feature
+//sums to 0, so the row mean drops out of the covariance and only the nonzeros of the row are visited; the row is scaled by its
+//centered norm from SparseRowNorms. The features are interleaved CORRELATE_BLOCK_NUM at a time so each nonzero gathers one
+//short run. Constant rows correlate 0. Return 1 if success, -1 if failure
+int SparseRowsCorrelateBlock(double *corr, double *features, int featureNum, int *rowStart, int *columns, double *values, 
+							 double *rowNorms, int rowNum, int dim)
+{
+	double *interleaved, *z;
+	double s[CORRELATE_BLOCK_NUM];
+	double scale;
+	int first, blockNum, f, r, k;
+	
+	interleaved = (double *)malloc((size_t)dim*CORRELATE_BLOCK_NUM*sizeof(double));
+	
+	assert(interleaved!=NULL);
+	
+	if (interleaved==NULL)
+	{
+		return -1;
+	}
+	
+	for (first=0;first<featureNum;first+=CORRELATE_BLOCK_NUM)
+	{
+		blockNum = (first+CORRELATE_BLOCK_NUM<=featureNum)?CORRELATE_BLOCK_NUM:featureNum-first;
+		
+		//sample k of the block's features at interleaved[k*CORRELATE_BLOCK_NUM..], zero padded past blockNum
+		for (k=0;k<dim;k++)
+		{
+			for (f=0;f<CORRELATE_BLOCK_NUM;f++)
+			{
+				interleaved[(size_t)k*CORRELATE_BLOCK_NUM+f] = (f<blockNum)?features[(size_t)(first+f)*dim+k]:0;
+			}
+		}
+		
+		for (r=0;r<rowNum;r++)
+		{
+			for (f=0;f<CORRELATE_BLOCK_NUM;f++)
+			{
+				s[f] = 0;
+			}
+			
+			for (k=rowStart[r];k<rowStart[r+1];k++)
+			{
+				z = interleaved+(size_t)columns[k]*CORRELATE_BLOCK_NUM;
+				
+				for (f=0;f<CORRELATE_BLOCK_NUM;f++)
+				{
+					s[f] += values[k]*z[f];
+				}
+			}
+			
+			//the same threshold as StandardizeArray
+			scale = (rowNorms[r]<0.00000000001)?0:1/rowNorms[r];
+			
+			for (f=0;f<blockNum;f++)
+			{
+				corr[(size_t)(first+f)*rowNum+r] = s[f]*scale;
+			}
+		}
+	}
+	
+	free(interleaved);
+	
+	return 1;
+}
+
+//Return 1 if every row of a rowNum*dim matrix has at most CATEGORY_MAX_NUM distinct values, otherwise 0
+int IsCategoricalMatrixRows(double *matrix, int rowNum, int dim)
+{
+	double levels[CATEGORY_MAX_NUM];
+	double *row;
+	int i, k, c, levelNum;
+	
+	for (i=0;i<rowNum;i++)
+	{
+		row = matrix+(size_t)i*dim;
+		levelNum = 0;
+		
+		for (k=0;k<dim;k++)
+		{
+			for (c=0;(c<levelNum)&&(levels[c]!=row[k]);c++);
+			
+			if (c<levelNum)
+			{
+				continue;
+			}
+			
+			if ((levelNum>=CATEGORY_MAX_NUM)||(row[k]!=row[k]))
+			{
+				return 0;
+			}
+			
+			levels[levelNum++] = row[k];
+		}
+	}
+	
+	return 1;
+}
+
+//Encode a row of dim values into codes and CATEGORY_MAX_NUM sorted levels. Return the number of levels, -1 if there are too many
+int EncodeCategoryRow(unsigned char *codes, double *levels, double *row, int dim)
+{
+	double tmp;
+	int k, c, levelNum;
+	
+	levelNum = 0;
+	
+	for (k=0;k<dim;k++)
+	{
+		for (c=0;(c<levelNum)&&(levels[c]!=row[k]);c++);
+		
+		if (c<levelNum)
+		{
+			continue;
+		}
+		
+		if (levelNum>=CATEGORY_MAX_NUM)
+		{
+			return -1;
+		}
+		
+		//insertion into the sorted levels
+		levels[levelNum++] = row[k];
+		
+		for (c=levelNum-1;(c>0)&&(levels[c-1]>levels[c]);c--)
+		{
+			tmp = levels[c-1];
+			levels[c-1] = levels[c];
+			levels[c] = tmp;
+		}
+	}
+	
+	for (c=levelNum;c<CATEGORY_MAX_NUM;c++)
+	{
+		levels[c] = 0;
+	}
+	
+	//a value equal to none of the levels is NaN
+	for (k=0;k<dim;k++)
+	{
+		for (c=0;(c<levelNum)&&(levels[c]!=row[k]);c++);
+		
+		if (c>=levelNum)
+		{
+			return -1;
+		}
+		
+		codes[k] = (unsigned char)c;
+	}
+	
+	return levelNum;
+}
+
+//Decode an encoded row into dim values
+void DecodeCategoryRow(double *row, unsigned char *codes, double *levels, int dim)
+{
+	int k;
+	
+	for (k=0;k<dim;k++)
+	{
+		row[k] = levels[codes[k]];
+	}
+}
+
+//Encode the rows of a rowNum*dim matrix. Return 1 if success, -1 if failure
+int PackCategoryRows(CATEGORY_ROWS_STRUCT *rows, double *matrix, int rowNum, int dim)
+{
+	int i;
+	
+	rows->rowNum = rowNum;
+	rows->dim = dim;
+	rows->codes = (unsigned char *)malloc((size_t)rowNum*dim);
+	rows->levels = (double *)malloc((size_t)rowNum*CATEGORY_MAX_NUM*sizeof(double));
+	
+	assert((rows->codes!=NULL)&&(rows->levels!=NULL));
+	
+	if ((rows->codes==NULL)||(rows->levels==NULL))
+	{
+		FreeCategoryRows(rows);
+		return -1;
+	}
+	
+	for (i=0;i<rowNum;i++)
+	{
+		if (EncodeCategoryRow(rows->codes+(size_t)i*dim, rows->levels+(size_t)i*CATEGORY_MAX_NUM, matrix+(size_t)i*dim, dim)<0)
+		{
+			FreeCategoryRows(rows);
+			return -1;
+		}
+	}
+	
+	return 1;
+}
+
+//Free the encoded rows
+void FreeCategoryRows(CATEGORY_ROWS_STRUCT *rows)
+{
+	free(rows->codes);
+	free(rows->levels);
+	rows->codes = NULL;
+	rows->levels = NULL;
+}
+
+//Association of featureNum categorical features with rowNum standardized rows, corr[f*rowNum+r]. One pass over a row
+//accumulates its per-category sums S_c, from which isEta=0 gives the Pearson correlation with the levels as ordinal values,
+//sum(L_c*S_c)/|L-mean|, and isEta=1 the eta-squared of a one-way ANOVA of the row by category, sum(S_c^2/n_c).
+//The samples of each feature are grouped by category, and the largest category is not summed: a centered row gives it
+//minus the sum of the others. Constant features give 0. Return 1 if success, -1 if failure
+int CategoryCorrelateBlock(double *corr, unsigned char *codes, double *levels, int featureNum, int isEta, double *rows, int rowNum, int dim)
+{
+	int *order, *groupEnd, *largest;
+	double *weights, *w;
+	double sums[CATEGORY_MAX_NUM];
+	int counts[CATEGORY_MAX_NUM];
+	unsigned char *code;
+	int *index;
+	double *row, *level, sum, sumSquare, norm, s, s0, s1, s2, s3;
+	int f, r, k, c, first, last;
+	
+	order = (int *)malloc((size_t)featureNum*dim*sizeof(int));
+	groupEnd = (int *)malloc((size_t)featureNum*CATEGORY_MAX_NUM*sizeof(int));
+	largest = (int *)malloc(featureNum*sizeof(int));
+	weights = (double *)malloc((size_t)featureNum*CATEGORY_MAX_NUM*sizeof(double));
+	
+	assert((order!=NULL)&&(groupEnd!=NULL)&&(largest!=NULL)&&(weights!=NULL));
+	
+	if ((order==NULL)||(groupEnd==NULL)||(largest==NULL)||(weights==NULL))
+	{
+		free(order);
+		free(groupEnd);
+		free(largest);
+		free(weights);
+		return -1;
+	}
+	
+	//samples of a feature in category order by a counting sort, and the row sums entering as sum(w_c*S_c) with
+	//w_c = L_c/|L-mean| (as the rows are centered), or as sum(w_c*S_c^2) with w_c = 1/n_c (as their sum of squares is 1)
+	for (f=0;f<featureNum;f++)
+	{
+		code = codes+(size_t)f*dim;
+		level = levels+(size_t)f*CATEGORY_MAX_NUM;
+		w = weights+(size_t)f*CATEGORY_MAX_NUM;
+		
+		memset(counts, 0, sizeof(counts));
+		
+		for (k=0;k<dim;k++)
+		{
+			counts[code[k]]++;
+		}
+		
+		sum = 0;
+		sumSquare = 0;
+		largest[f] = 0;
+		
+		for (c=0;c<CATEGORY_MAX_NUM;c++)
+		{
+			sum += counts[c]*level[c];
+			sumSquare += counts[c]*level[c]*level[c];
+			groupEnd[(size_t)f*CATEGORY_MAX_NUM+c] = (c>0?groupEnd[(size_t)f*CATEGORY_MAX_NUM+c-1]:0)+counts[c];
+			largest[f] = (counts[c]>counts[largest[f]])?c:largest[f];
+		}
+		
+		for (k=0;k<dim;k++)
+		{
+			order[(size_t)f*dim+groupEnd[(size_t)f*CATEGORY_MAX_NUM+code[k]]-counts[code[k]]] = k;
+			counts[code[k]]--;
+		}
+		
+		norm = sumSquare-sum*sum/dim;
+		norm = (norm>0)?sqrt(norm):0;
+		
+		for (c=0;c<CATEGORY_MAX_NUM;c++)
+		{
+			first = c>0?groupEnd[(size_t)f*CATEGORY_MAX_NUM+c-1]:0;
+			
+			if (isEta)
+			{
+				w[c] = ((groupEnd[(size_t)f*CATEGORY_MAX_NUM+c]>first)&&(groupEnd[(size_t)f*CATEGORY_MAX_NUM+c]-first<dim))
+					?1.0/(groupEnd[(size_t)f*CATEGORY_MAX_NUM+c]-first):0;
+			}
+			else
+			{
+				w[c] = (norm<0.00000000001)?0:level[c]/norm;
+			}
+		}
+	}
+	
+	//each row stays in cache while all features gather from it, with four partial sums per category
+	for (r=0;r<rowNum;r++)
+	{
+		row = rows+(size_t)r*dim;
+		
+		for (f=0;f<featureNum;f++)
+		{
+			index = order+(size_t)f*dim;
+			w = weights+(size_t)f*CATEGORY_MAX_NUM;
+			first = 0;
+			s = 0;
+			
+			for (c=0;c<CATEGORY_MAX_NUM;c++)
+			{
+				last = groupEnd[(size_t)f*CATEGORY_MAX_NUM+c];
+				sums[c] = 0;
+				
+				if ((c!=largest[f])&&(last>first))
+				{
+					s0 = s1 = s2 = s3 = 0;
+					
+					for (k=first;k+4<=last;k+=4)
+					{
+						s0 += row[index[k]];
+						s1 += row[index[k+1]];
+						s2 += row[index[k+2]];
+						s3 += row[index[k+3]];
+					}
+					
+					for (;k<last;k++)
+					{
+						s0 += row[index[k]];
+					}
+					
+					sums[c] = (s0+s1)+(s2+s3);
+					s += sums[c];
+				}
+				
+				first = last;
+			}
+			
+			sums[largest[f]] = -s;
+			s = 0;
+			
+			for (c=0;c<CATEGORY_MAX_NUM;c++)
+			{
+				s += isEta?w[c]*sums[c]*sums[c]:w[c]*sums[c];
+			}
+			
+			corr[(size_t)f*rowNum+r] = s;
+		}
+	}
+	
+	free(order);
+	free(groupEnd);
+	free(largest);
+	free(weights);
+	
+	return 1;
+}
+
+//Quantize the rows of a rowNum*dim matrix to bits (8 or 16) bit codes, each row spanning the full code range. Return 1 if success, -1 if failure
+int QuantizeMatrixRows(QUANT_ROWS_STRUCT *rows, double *matrix, int rowNum, int dim, int bits)
+{
+	double *row, minValue, maxValue, offset, scale, sum, sumSquare;
+	int maxCode, code;
+	int i, k;
+	
+	assert((bits==8)||(bits==16));
+	
+	maxCode = (bits==8)?127:32767;
+	rows->rowNum = rowNum;
+	rows->dim = dim;
+	rows->bits = bits;
+	rows->codes16 = (bits==16)?(short *)malloc((size_t)rowNum*dim*sizeof(short)):NULL;
+	rows->codes8 = (bits==8)?(signed char *)malloc((size_t)rowNum*dim):NULL;
+	rows->sums = (double *)malloc(rowNum*sizeof(double));
+	rows->norms = (double *)malloc(rowNum*sizeof(double));
+	
+	assert(((rows->codes16!=NULL)||(rows->codes8!=NULL))&&(rows->sums!=NULL)&&(rows->norms!=NULL));
+	
+	if (((rows->codes16==NULL)&&(rows->codes8==NULL))||(rows->sums==NULL)||(rows->norms==NULL))
+	{
+		FreeQuantRows(rows);
+		return -1;
+	}
+	
+	for (i=0;i<rowNum;i++)
+	{
+		row = matrix+(size_t)i*dim;
+		minValue = maxValue = row[0];
+		
+		for (k=1;k<dim;k++)
+		{
+			minValue = (row[k]<minValue)?row[k]:minValue;
+			maxValue = (row[k]>maxValue)?row[k]:maxValue;
+		}
+		
+		offset = (maxValue+minValue)/2;
+		scale = (maxValue-minValue)/(2*maxCode);
+		sum = 0;
+		sumSquare = 0;
+		
+		for (k=0;k<dim;k++)
+		{
+			code = (scale>0)?(int)floor((row[k]-offset)/scale+0.5):0;
+			code = (code<-maxCode)?-maxCode:((code>maxCode)?maxCode:code);
+			
+			if (bits==16)
+			{
+				rows->codes16[(size_t)i*dim+k] = (short)code;
+			}
+			else
+			{
+				rows->codes8[(size_t)i*dim+k] = (signed char)code;
+			}
+			
+			sum += code;
+			sumSquare += (double)code*code;
+		}
+		
+		rows->sums[i] = sum;
+		rows->norms[i] = sumSquare-sum*sum/dim;
+		rows->norms[i] = (rows->norms[i]>0)?sqrt(rows->norms[i]):0;
+	}
+	
+	return 1;
+}
+
+//Free the quantized rows
+void FreeQuantRows(QUANT_ROWS_STRUCT *rows)
+{
+	free(rows->codes16);
+	free(rows->codes8);
+	free(rows->sums);
+	free(rows->norms);
+	rows->codes16 = NULL;
+	rows->codes8 = NULL;
+	rows->sums = NULL;
+	rows->norms = NULL;
+}
+
+//16 bit codes of rowNum quantized rows from row first: the stored codes, or 8 bit codes widened into buffer
+short *QuantRowsAsInt16(QUANT_ROWS_STRUCT *rows, int first, int rowNum, short *buffer)
+{
+	size_t k, num = (size_t)rowNum*rows->dim;
+	signed char *codes;
+	
+	if (rows->codes16!=NULL)
+	{
+		return rows->codes16+(size_t)first*rows->dim;
+	}
+	
+	codes = rows->codes8+(size_t)first*rows->dim;
+	
+	for (k=0;k<num;k++)
+	{
+		buffer[k] = codes[k];
+	}
+	
+	return buffer;
+}
+
+//Exact sum of the products of two rows of dim 16 bit codes
+double QuantDotProduct(short *a, short *b, int dim)
+{
+	long long sum = 0;
+	int k = 0;
+#ifdef __SSE2__
+	__m128i products;
+	__m128d acc0, acc1;
+	
+	//eight products are added pairwise into four 32 bit lanes, which cannot overflow for codes within +-32767,
+	//and the lanes are widened to double at once. Sums of integers below 2^53 are exact in double
+	acc0 = _mm_setzero_pd();
+	acc1 = _mm_setzero_pd();
+	
+	for (;k+8<=dim;k+=8)
+	{
+		products = _mm_madd_epi16(_mm_loadu_si128((__m128i *)(a+k)), _mm_loadu_si128((__m128i *)(b+k)));
+		acc0 = _mm_add_pd(acc0, _mm_cvtepi32_pd(products));
+		acc1 = _mm_add_pd(acc1, _mm_cvtepi32_pd(_mm_shuffle_epi32(products, _MM_SHUFFLE(1,0,3,2))));
+	}
+	
+	acc0 = _mm_add_pd(acc0, acc1);
+	acc0 = _mm_add_pd(acc0, _mm_unpackhi_pd(acc0, acc0));
+	sum = (long long)_mm_cvtsd_f64(acc0);
+#endif
+	
+	for (;k<dim;k++)
+	{
+		sum += (int)a[k]*b[k];
+	}
+	
+	return (double)sum;
+}
+
+//Pearson correlations of featureNum quantized features with rowNum quantized rows, corr[f*rowNum+r], both as 16 bit codes with their
+//sums and centered norms: (sum(a*b)-sum(a)*sum(b)/dim)/(norm(a)*norm(b)). The integer products are summed exactly, by SSE2
+//multiply-adds where available. Constant features or rows give 0
+void QuantCorrelateBlock(double *corr, short *features, double *featureSums, double *featureNorms, int featureNum, 
+						 short *rows, double *rowSums, double *rowNorms, int rowNum, int dim)
+{
+	short *row;
+	double dot;
+	int f, r;
+	
+	//each row stays in cache while all features are multiplied with it
+	for (r=0;r<rowNum;r++)
+	{
+		row = rows+(size_t)r*dim;
+		
+		for (f=0;f<featureNum;f++)
+		{
+			if ((featureNorms[f]<=0)||(rowNorms[r]<=0))
+			{
+				corr[(size_t)f*rowNum+r] = 0;
+				continue;
+			}
+			
+			dot = QuantDotProduct(features+(size_t)f*dim, row, dim);
+			corr[(size_t)f*rowNum+r] = (dot-featureSums[f]*rowSums[r]/dim)/(featureNorms[f]*rowNorms[r]);
+		}
+	}
+}
@@ -0,0 +1,260 @@
+/*
+ *  controls.c
+ *  Orthonormal basis of control variables, projected out of data rows
+ *
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <assert.h>
+#include "math_api.h"
+#include "words.h"
+#include "controls.h"
+
+//number of rows projected together by ProjectOutControls
+#define PROJECTION_BLOCK_SIZE 64
+
+//a control whose norm drops below this fraction after removing the earlier columns is treated as linearly dependent
+#define RANK_TOLERANCE 0.0000000001
+
+//Build an orthonormal basis of the intercept and controlNum control arrays (stored one after another) by Householder QR.
+//Controls that are linearly dependent on the intercept or on earlier controls are dropped. Return the number of basis vectors, -1 if failure
+int BuildControlBasis(CONTROL_BASIS_STRUCT *basis, double *controls, int controlNum, int sampleNum)
+{
+	int i,j,k;
+	int colNum = controlNum+1;
+	int rank;
+	double *a, *v, *col;
+	double norm, origNorm, alpha, vNorm, dot;
+	
+	basis->q = NULL;
+	basis->basisNum = 0;
+	basis->sampleNum = sampleNum;
+	
+	if ((controlNum<0)||(sampleNum<=colNum))
+	{
+		return -1;
+	}
+	
+	//a holds the columns of the design matrix (intercept first), v the Householder vectors
+	a = (double *)malloc(colNum*sampleNum*sizeof(double));
+	v = (double *)malloc(colNum*sampleNum*sizeof(double));
+	
+	assert((a!=NULL)&&(v!=NULL));
+	
+	if ((a==NULL)||(v==NULL))
+	{
+		free(a);
+		free(v);
+		return -1;
+	}
+	
+	for (i=0;i<sampleNum;i++)
+	{
+		a[i] = 1.0;
+	}
+	
+	memcpy(a+sampleNum, controls, controlNum*sampleNum*sizeof(double));
+	
+	rank = 0;
+	
+	for (j=0;j<colNum;j++)
+	{
+		col = a+j*sampleNum;
+		
+		origNorm = sqrt(DotProduct(col, col, sampleNum));
+		
+		//apply the reflections found so far to this column
+		for (k=0;k<rank;k++)
+		{
+			dot = DotProduct(v+k*sampleNum+k, col+k, sampleNum-k);
+			
+			for (i=k;i<sampleNum;i++)
+			{
+				col[i] -= 2*dot*v[k*sampleNum+i];
+			}
+		}
+		
+		norm = sqrt(DotProduct(col+rank, col+rank, sampleNum-rank));
+		
+		if (norm<=RANK_TOLERANCE*origNorm)
+		{
+			continue;
+		}
+		
+		//reflector that maps col[rank..] onto -sign(col[rank])*norm*e_rank; stored normalized
+		alpha = (col[rank]>0)?-norm:norm;
+		
+		memset(v+rank*sampleNum, 0, sampleNum*sizeof(double));
+		
+		for (i=rank;i<sampleNum;i++)
+		{
+			v[rank*sampleNum+i] = col[i];
+		}
+		
+		v[rank*sampleNum+rank] -= alpha;
+		vNorm = sqrt(DotProduct(v+rank*sampleNum+rank, v+rank*sampleNum+rank, sampleNum-rank));
+		
+		for (i=rank;i<sampleNum;i++)
+		{
+			v[rank*sampleNum+i] /= vNorm;
+		}
+		
+		rank++;
+	}
+	
+	//form the thin Q explicitly: column j is H_0...H_{rank-1} e_j
+	basis->q = (double *)malloc(rank*sampleNum*sizeof(double));
+	
+	assert(basis->q!=NULL);
+	
+	if (basis->q==NULL)
+	{
+		free(a);
+		free(v);
+		return -1;
+	}
+	
+	for (j=0;j<rank;j++)
+	{
+		col = basis->q+j*sampleNum;
+		
+		memset(col, 0, sampleNum*sizeof(double));
+		col[j] = 1.0;
+		
+		for (k=rank-1;k>=0;k--)
+		{
+			dot = DotProduct(v+k*sampleNum+k, col+k, sampleNum-k);
+			
+			for (i=k;i<sampleNum;i++)
+			{
+				col[i] -= 2*dot*v[k*sampleNum+i];
+			}
+		}
+	}
+	
+	basis->basisNum = rank;
+	
+	free(a);
+	free(v);
+	
+	return rank;
+}
+
+//Free the control basis
+void FreeControlBasis(CONTROL_BASIS_STRUCT *basis)
+{
+	free(basis->q);
+	basis->q = NULL;
+	basis->basisNum = 0;
+}
+
+//Project the control basis out of rowNum arrays of sampleNum values stored one after another. Rows are processed in blocks so the basis stays in cache
+void ProjectOutControls(CONTROL_BASIS_STRUCT *basis, double *rows, int rowNum)
+{
+	int i,j,k,b;
+	int blockSize;
+	int sampleNum = basis->sampleNum;
+	double coef[PROJECTION_BLOCK_SIZE];
+	double *q, *row;
+	
+	for (b=0;b<rowNum;b+=PROJECTION_BLOCK_SIZE)
+	{
+		blockSize = (rowNum-b<PROJECTION_BLOCK_SIZE)?rowNum-b:PROJECTION_BLOCK_SIZE;
+		
+		//one basis vector against the whole block at a time. The basis is orthonormal, so the vectors can be removed one by one
+		for (k=0;k<basis->basisNum;k++)
+		{
+			q = basis->q+k*sampleNum;
+			
+			for (j=0;j<blockSize;j++)
+			{
+				coef[j] = DotProduct(q, rows+(b+j)*sampleNum, sampleNum);
+			}
+			
+			for (j=0;j<blockSize;j++)
+			{
+				row = rows+(b+j)*sampleNum;
+				
+				for (i=0;i<sampleNum;i++)
+				{
+					row[i] -= coef[j]*q[i];
+				}
+			}
+		}
+	}
+}
+
+//Collect the control arrays: expression rows named in a comma-separated list, followed by all rows of a covariate matrix. Return the number of controls, -1 if failure
+int CollectControls(double *controls, char *regulatorNames, DATA_MATRIX_STRUCT *expressionMatrix, DATA_MATRIX_STRUCT *covariateMatrix)
+{
+	char **words;
+	int wordNum = 0;
+	int controlNum = 0;
+	int sampleNum = expressionMatrix->sampleNum;
+	int i,j,k;
+	
+	if (regulatorNames[0])
+	{
+		words = AllocWords(MAX_CONTROL_NUM, MAX_WORD_SIZE);
+		
+		assert(words!=NULL);
+		
+		wordNum = StringToWords(words, regulatorNames, MAX_WORD_SIZE, MAX_CONTROL_NUM, ",");
+		
+		for (k=0;k<wordNum;k++)
+		{
+			for (i=0;i<expressionMatrix->recordNum;i++)
+			{
+				if (strcmp(words[k], expressionMatrix->recordInfo[i].name)==0)
+				{
+					break;
+				}
+			}
+			
+			if (i>=expressionMatrix->recordNum)
+			{
+				printf("ERROR: cannot find the known regulator %s in expression data!\n", words[k]);
+				FreeWords(words, MAX_CONTROL_NUM);
+				return -1;
+			}
+			
+			memcpy(controls+controlNum*sampleNum, expressionMatrix->matrix+i*sampleNum, sampleNum*sizeof(double));
+			controlNum++;
+		}
+		
+		FreeWords(words, MAX_CONTROL_NUM);
+	}
+	
+	if (covariateMatrix==NULL)
+	{
+		return controlNum;
+	}
+	
+	//covariates are matched to the analyzed samples by name
+	for (j=0;j<sampleNum;j++)
+	{
+		for (i=0;i<covariateMatrix->sampleNum;i++)
+		{
+			if (strcmp(expressionMatrix->sampleInfo[j].name, covariateMatrix->sampleInfo[i].name)==0)
+			{
+				break;
+			}
+		}
+		
+		if (i>=covariateMatrix->sampleNum)
+		{
+			printf("ERROR: sample %s is missing in the covariate data!\n", expressionMatrix->sampleInfo[j].name);
+			return -1;
+		}
+		
+		for (k=0;k<covariateMatrix->recordNum;k++)
+		{
+			controls[(controlNum+k)*sampleNum+j] = covariateMatrix->matrix[k*covariateMatrix->sampleNum+i];
+		}
+	}
+	
+	return controlNum+covariateMatrix->recordNum;
+}
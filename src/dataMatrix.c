@@ -11,9 +11,104 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <memory.h>
+#include <pthread.h>
 #include "dataMatrix.h"
 #include "words.h"
+#include "format.h"
+
+#define SAVE_BLOCK_ROW_NUM 256		//rows formatted at a time by a SaveDataMatrixThreads worker
+
+//Shared state of the SaveDataMatrixThreads workers. Block b of rows is formatted into buffers[b%slotNum]
+typedef struct
+{
+	DATA_MATRIX_STRUCT *matrix;
+	TEXT_BUFFER_STRUCT *buffers;
+	int *isDone;
+	int slotNum;
+	int blockNum;
+	int nextBlock;
+	int writtenNum;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+}SAVE_ENGINE_STRUCT;
+
+//Format the rows of a block of the matrix into a text buffer
+void FormatDataRows(TEXT_BUFFER_STRUCT *buf, DATA_MATRIX_STRUCT *matrix, int firstRow, int lastRow);
+
+//Worker thread of SaveDataMatrixThreads. Formats blocks of rows, at most slotNum blocks ahead of the writer
+void *SaveWorker(void *arg);
+
+//FNV-1a hash of a name
+unsigned long long HashName(char *name);
+
+//Read the next line of a text file into *line, grown by getline, and split it in place into words at blanks. *words grows with
+//the line, so a line may have any number of words. Return the number of words, -1 at the end of the file, if a word does not
+//fit in MAX_WORD_SIZE, or if failure
+int ReadLineWords(FILE *fh, char **line, size_t *lineSize, char ***words, int *wordCapacity);
+
+//FNV-1a hash of a name
+unsigned long long HashName(char *name)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	unsigned char *c;
+	
+	for (c=(unsigned char *)name;*c;c++)
+	{
+		hash = (hash^*c)*1099511628211ULL;
+	}
+	
+	return hash;
+}
+
+//Read the next line of a text file into *line, grown by getline, and split it in place into words at blanks. *words grows with
+//the line, so a line may have any number of words. Return the number of words, -1 at the end of the file, if a word does not
+//fit in MAX_WORD_SIZE, or if failure
+int ReadLineWords(FILE *fh, char **line, size_t *lineSize, char ***words, int *wordCapacity)
+{
+	char **newWords;
+	char *word;
+	ssize_t len;
+	int wordNum;
+	
+	len = getline(line, lineSize, fh);
+	
+	if (len<0)
+	{
+		return -1;
+	}
+	
+	//a line of len characters has at most len/2+1 words
+	if (len/2+1>*wordCapacity)
+	{
+		newWords = (char **)realloc(*words, (len/2+1)*sizeof(char *));
+		
+		assert(newWords!=NULL);
+		
+		if (newWords==NULL)
+		{
+			return -1;
+		}
+		
+		*words = newWords;
+		*wordCapacity = (int)(len/2+1);
+	}
+	
+	wordNum = 0;
+	
+	for (word=strtok(*line, " \t\r\n\v\f");word!=NULL;word=strtok(NULL, " \t\r\n\v\f"))
+	{
+		if (strlen(word)>=MAX_WORD_SIZE)
+		{
+			return -1;
+		}
+		
+		(*words)[wordNum++] = word;
+	}
+	
+	return wordNum;
+}
 
 //allocate memory for data matrix
 int AllocDataMatrix(DATA_MATRIX_STRUCT *matrix, int sampleNum, int recordNum)
@@ -52,75 +147,52 @@ void FreeDataMatrix(DATA_MATRIX_STRUCT *matrix)
 int ReadDataMatrix(char *fileName, DATA_MATRIX_STRUCT *matrix)
 {
 	FILE *fh;
-	char **words;
-	int wordNum;
-	char *tmpS;
+	char **words = NULL;
+	int wordNum, wordCapacity = 0;
+	char *line = NULL;
+	size_t lineSize = 0;
 	int sampleNum, recordNum;
 	int i;
 	
-	fh = (FILE *)fopen(fileName, "r");
-	
-	assert(fh!=NULL);
-	
-	if (!fh)
+	if (IsBinaryDataMatrix(fileName)>0)
 	{
-		return -1;
+		return ReadDataMatrixBinary(fileName, matrix);
 	}
 	
-	words = AllocWords(MAX_SAMPLE_NUM+1, MAX_WORD_SIZE+1);
+	fh = (FILE *)fopen(fileName, "r");
 	
-	assert(words!=NULL);
+	assert(fh!=NULL);
 	
-	if (words == NULL)
+	if (!fh)
 	{
 		return -1;
 	}
 	
-	tmpS = (char *)malloc((MAX_SAMPLE_NUM+1)*(MAX_WORD_SIZE+1)*sizeof(char));
-	
-	assert(tmpS!=NULL);
-	
 	recordNum = 0;
 	
-	//Read the header row to get the sample number
-	fgets(tmpS, (MAX_SAMPLE_NUM+1)*(MAX_WORD_SIZE+1)*sizeof(char), fh);
-	
-	wordNum = StringToWords(words, tmpS, MAX_WORD_SIZE+1, MAX_SAMPLE_NUM+1, " \t\r\n\v\f");
-	
-	sampleNum = wordNum-1;
+	//Read the header row to get the sample number. Lines are read whole, so the samples are not limited
+	sampleNum = ReadLineWords(fh, &line, &lineSize, &words, &wordCapacity)-1;
 	
 	//Read through the file to get the number of records
-	
-	fgets(tmpS, (MAX_SAMPLE_NUM+1)*(MAX_WORD_SIZE+1)*sizeof(char), fh);
-	wordNum = StringToWords(words, tmpS, MAX_WORD_SIZE+1, MAX_SAMPLE_NUM+1, " \t\r\n\v\f");
-	
-	while ((wordNum==sampleNum+1)&&(!feof(fh)))
+	while (ReadLineWords(fh, &line, &lineSize, &words, &wordCapacity)==sampleNum+1)
 	{
 		recordNum++;
-		
-		fgets(tmpS, (MAX_SAMPLE_NUM+1)*(MAX_WORD_SIZE+1)*sizeof(char), fh);
-		wordNum = StringToWords(words, tmpS, MAX_WORD_SIZE+1, MAX_SAMPLE_NUM+1, " \t\r\n\v\f");
 	}
 	
-	fclose(fh);
-	
-//	if ((recordNum<=0)||(sampleNum<=0)||(AllocDataMatrix(matrix, sampleNum, recordNum)<=0))
-	if (AllocDataMatrix(matrix, sampleNum, recordNum)<=0)
-	{		
-		free(tmpS);
-		FreeWords(words, MAX_SAMPLE_NUM+1);
+	if ((sampleNum<=0)||(AllocDataMatrix(matrix, sampleNum, recordNum)<=0))
+	{
+		fclose(fh);
+		free(line);
+		free(words);
 		return -1;
 	}
 	
 	//read the file again to retrieve the values
 	
-	fh = (FILE *)fopen(fileName, "r");
+	rewind(fh);
 	
-	assert(fh!=NULL);
+	ReadLineWords(fh, &line, &lineSize, &words, &wordCapacity);
 	
-	fgets(tmpS, (MAX_SAMPLE_NUM+1)*(MAX_WORD_SIZE+1)*sizeof(char), fh);
-	wordNum = StringToWords(words, tmpS, MAX_WORD_SIZE+1, MAX_SAMPLE_NUM+1, " \t\r\n\v\f");
-
 	for (i=0;i<sampleNum;i++)
 	{
 		strcpy(matrix->sampleInfo[i].name, words[i+1]);
@@ -128,11 +200,7 @@ int ReadDataMatrix(char *fileName, DATA_MATRIX_STRUCT *matrix)
 	
 	recordNum = 0;
 	
-	fgets(tmpS, (MAX_SAMPLE_NUM+1)*(MAX_WORD_SIZE+1)*sizeof(char), fh);
-	
-	wordNum = StringToWords(words, tmpS, MAX_WORD_SIZE+1, MAX_SAMPLE_NUM+1, " \t\r\n\v\f");
-	
-	while ((wordNum==sampleNum+1)&&(!feof(fh)))
+	while ((recordNum<matrix->recordNum)&&((wordNum = ReadLineWords(fh, &line, &lineSize, &words, &wordCapacity))==sampleNum+1))
 	{
 		strcpy(matrix->recordInfo[recordNum].name, words[0]);
 		
@@ -142,15 +210,12 @@ int ReadDataMatrix(char *fileName, DATA_MATRIX_STRUCT *matrix)
 		}
 		
 		recordNum++;
-		
-		fgets(tmpS, (MAX_SAMPLE_NUM+1)*(MAX_WORD_SIZE+1)*sizeof(char), fh);
-		wordNum = StringToWords(words, tmpS, MAX_WORD_SIZE+1, MAX_SAMPLE_NUM+1, " \t\r\n\v\f");
 	}
 	
 	fclose(fh);
 	
-	free(tmpS);
-	FreeWords(words, MAX_SAMPLE_NUM+1);
+	free(line);
+	free(words);
 	
 	return 1;
 }
@@ -219,8 +284,85 @@ int IntersectSampleIDs(DATA_MATRIX_STRUCT *srcMatrix1, DATA_MATRIX_STRUCT *srcMa
 //Save the data matrix
 int SaveDataMatrix(char *fileName, DATA_MATRIX_STRUCT *matrix)
 {
-	FILE *fh;
+	return SaveDataMatrixThreads(fileName, matrix, 1);
+}
+
+//Format the rows of a block of the matrix into a text buffer
+void FormatDataRows(TEXT_BUFFER_STRUCT *buf, DATA_MATRIX_STRUCT *matrix, int firstRow, int lastRow)
+{
 	int i,j;
+	double *row;
+	
+	for (i=firstRow;i<lastRow;i++)
+	{
+		AppendString(buf, matrix->recordInfo[i].name);
+		
+		row = matrix->matrix+(size_t)i*matrix->sampleNum;
+		
+		for (j=0;j<matrix->sampleNum;j++)
+		{
+			AppendChars(buf, "\t", 1);
+			AppendFixed(buf, row[j], 6);
+		}
+		
+		AppendChars(buf, "\n", 1);
+	}
+}
+
+//Worker thread of SaveDataMatrixThreads. Formats blocks of rows, at most slotNum blocks ahead of the writer
+void *SaveWorker(void *arg)
+{
+	SAVE_ENGINE_STRUCT *engine = (SAVE_ENGINE_STRUCT *)arg;
+	int block, slot, lastRow;
+	
+	while (1)
+	{
+		pthread_mutex_lock(&(engine->lock));
+		
+		while ((engine->nextBlock<engine->blockNum)&&(engine->nextBlock-engine->writtenNum>=engine->slotNum))
+		{
+			pthread_cond_wait(&(engine->changed), &(engine->lock));
+		}
+		
+		if (engine->nextBlock>=engine->blockNum)
+		{
+			pthread_mutex_unlock(&(engine->lock));
+			break;
+		}
+		
+		block = engine->nextBlock;
+		engine->nextBlock++;
+		pthread_mutex_unlock(&(engine->lock));
+		
+		slot = block%engine->slotNum;
+		lastRow = (block+1)*SAVE_BLOCK_ROW_NUM;
+		
+		if (lastRow>engine->matrix->recordNum)
+		{
+			lastRow = engine->matrix->recordNum;
+		}
+		
+		engine->buffers[slot].len = 0;
+		FormatDataRows(engine->buffers+slot, engine->matrix, block*SAVE_BLOCK_ROW_NUM, lastRow);
+		
+		pthread_mutex_lock(&(engine->lock));
+		engine->isDone[slot] = 1;
+		pthread_cond_broadcast(&(engine->changed));
+		pthread_mutex_unlock(&(engine->lock));
+	}
+	
+	return NULL;
+}
+
+//Save the data matrix with threadNum threads. Rows are formatted in blocks into per-block buffers and written in order
+//with one large write per block. Return 1 if success, -1 if failure
+int SaveDataMatrixThreads(char *fileName, DATA_MATRIX_STRUCT *matrix, int threadNum)
+{
+	FILE *fh;
+	TEXT_BUFFER_STRUCT buf;
+	SAVE_ENGINE_STRUCT engine;
+	pthread_t *threads;
+	int i, slot, result;
 	
 	fh = (FILE *)fopen(fileName, "w");
 	
@@ -231,26 +373,922 @@ int SaveDataMatrix(char *fileName, DATA_MATRIX_STRUCT *matrix)
 		return -1;
 	}
 	
-	fprintf(fh, "#");
+	if (InitTextBuffer(&buf, fh, OUTPUT_BUFFER_SIZE)<=0)
+	{
+		fclose(fh);
+		return -1;
+	}
+	
+	AppendChars(&buf, "#", 1);
 	
 	for (i=0;i<matrix->sampleNum;i++)
 	{
-		fprintf(fh, "\t%s", matrix->sampleInfo[i].name);
+		AppendChars(&buf, "\t", 1);
+		AppendString(&buf, matrix->sampleInfo[i].name);
 	}
 	
-	fprintf(fh,"\n");
+	AppendChars(&buf, "\n", 1);
 	
-	for (i=0;i<matrix->recordNum;i++)
+	if ((threadNum<=1)||(matrix->recordNum<=SAVE_BLOCK_ROW_NUM))
 	{
-		fprintf(fh, "%s", matrix->recordInfo[i].name);
+		FormatDataRows(&buf, matrix, 0, matrix->recordNum);
 		
-		for (j=0;j<matrix->sampleNum;j++)
+		result = FlushTextBuffer(&buf);
+		FreeTextBuffer(&buf);
+		
+		return ((fclose(fh)==0)&&(result>0))?1:-1;
+	}
+	
+	result = FlushTextBuffer(&buf);
+	FreeTextBuffer(&buf);
+	
+	engine.matrix = matrix;
+	engine.blockNum = (matrix->recordNum+SAVE_BLOCK_ROW_NUM-1)/SAVE_BLOCK_ROW_NUM;
+	engine.slotNum = 2*threadNum;
+	engine.nextBlock = 0;
+	engine.writtenNum = 0;
+	engine.buffers = (TEXT_BUFFER_STRUCT *)calloc(engine.slotNum, sizeof(TEXT_BUFFER_STRUCT));
+	engine.isDone = (int *)calloc(engine.slotNum, sizeof(int));
+	threads = (pthread_t *)malloc(threadNum*sizeof(pthread_t));
+	
+	assert((engine.buffers!=NULL)&&(engine.isDone!=NULL)&&(threads!=NULL));
+	
+	if ((engine.buffers==NULL)||(engine.isDone==NULL)||(threads==NULL))
+	{
+		free(engine.buffers);
+		free(engine.isDone);
+		free(threads);
+		fclose(fh);
+		return -1;
+	}
+	
+	for (i=0;i<engine.slotNum;i++)
+	{
+		//block buffers only grow, the writer empties them
+		if (InitTextBuffer(engine.buffers+i, NULL, OUTPUT_BUFFER_SIZE/4)<=0)
+		{
+			result = -1;
+		}
+	}
+	
+	if (result<=0)
+	{
+		for (i=0;i<engine.slotNum;i++)
+		{
+			FreeTextBuffer(engine.buffers+i);
+		}
+		free(engine.buffers);
+		free(engine.isDone);
+		free(threads);
+		fclose(fh);
+		return -1;
+	}
+	
+	pthread_mutex_init(&(engine.lock), NULL);
+	pthread_cond_init(&(engine.changed), NULL);
+	
+	for (i=0;i<threadNum;i++)
+	{
+		pthread_create(threads+i, NULL, SaveWorker, &engine);
+	}
+	
+	//write the blocks in order as they are finished
+	for (i=0;i<engine.blockNum;i++)
+	{
+		slot = i%engine.slotNum;
+		
+		pthread_mutex_lock(&(engine.lock));
+		
+		while (!engine.isDone[slot])
+		{
+			pthread_cond_wait(&(engine.changed), &(engine.lock));
+		}
+		
+		pthread_mutex_unlock(&(engine.lock));
+		
+		if ((engine.buffers[slot].isFailed)||(fwrite(engine.buffers[slot].text, 1, engine.buffers[slot].len, fh)!=engine.buffers[slot].len))
 		{
-			fprintf(fh, "\t%f", matrix->matrix[i*matrix->sampleNum+j]);
+			result = -1;
 		}
 		
-		fprintf(fh,"\n");
+		pthread_mutex_lock(&(engine.lock));
+		engine.isDone[slot] = 0;
+		engine.writtenNum++;
+		pthread_cond_broadcast(&(engine.changed));
+		pthread_mutex_unlock(&(engine.lock));
+	}
+	
+	for (i=0;i<threadNum;i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	
+	pthread_mutex_destroy(&(engine.lock));
+	pthread_cond_destroy(&(engine.changed));
+	
+	for (i=0;i<engine.slotNum;i++)
+	{
+		FreeTextBuffer(engine.buffers+i);
+	}
+	
+	free(engine.buffers);
+	free(engine.isDone);
+	free(threads);
+	
+	if (fclose(fh)!=0)
+	{
+		result = -1;
+	}
+	
+	return result;
+}
+
+//Save the data matrix in the binary format: BINARY_MATRIX_MAGIC, sampleNum and recordNum as int, the sample names and the
+//record names in MAX_WORD_SIZE chars each, then the matrix as double in row-major order. Native byte order. Return 1 if success, -1 if failure
+int SaveDataMatrixBinary(char *fileName, DATA_MATRIX_STRUCT *matrix)
+{
+	FILE *fh;
+	char name[MAX_WORD_SIZE];
+	int i, isFailed;
+	
+	fh = (FILE *)fopen(fileName, "wb");
+	
+	assert(fh!=NULL);
+	
+	if (!fh)
+	{
+		return -1;
+	}
+	
+	isFailed = (fwrite(BINARY_MATRIX_MAGIC, 1, BINARY_MATRIX_MAGIC_LEN, fh)!=BINARY_MATRIX_MAGIC_LEN);
+	isFailed |= (fwrite(&(matrix->sampleNum), sizeof(int), 1, fh)!=1);
+	isFailed |= (fwrite(&(matrix->recordNum), sizeof(int), 1, fh)!=1);
+	
+	//names are padded with zeros, so the file does not depend on what was left after the end of each name
+	for (i=0;i<matrix->sampleNum;i++)
+	{
+		memset(name, 0, MAX_WORD_SIZE);
+		strcpy(name, matrix->sampleInfo[i].name);
+		isFailed |= (fwrite(name, 1, MAX_WORD_SIZE, fh)!=MAX_WORD_SIZE);
+	}
+	
+	for (i=0;i<matrix->recordNum;i++)
+	{
+		memset(name, 0, MAX_WORD_SIZE);
+		strcpy(name, matrix->recordInfo[i].name);
+		isFailed |= (fwrite(name, 1, MAX_WORD_SIZE, fh)!=MAX_WORD_SIZE);
+	}
+	
+	isFailed |= (fwrite(matrix->matrix, sizeof(double), (size_t)matrix->sampleNum*matrix->recordNum, fh)!=(size_t)matrix->sampleNum*matrix->recordNum);
+	
+	if (fclose(fh)!=0)
+	{
+		isFailed = 1;
+	}
+	
+	return isFailed?-1:1;
+}
+
+//Read a data matrix saved by SaveDataMatrixBinary. Return 1 if success, -1 if failure
+int ReadDataMatrixBinary(char *fileName, DATA_MATRIX_STRUCT *matrix)
+{
+	FILE *fh;
+	char magic[BINARY_MATRIX_MAGIC_LEN];
+	int sampleNum, recordNum;
+	int i, isFailed;
+	
+	fh = (FILE *)fopen(fileName, "rb");
+	
+	assert(fh!=NULL);
+	
+	if (!fh)
+	{
+		return -1;
+	}
+	
+	if ((fread(magic, 1, BINARY_MATRIX_MAGIC_LEN, fh)!=BINARY_MATRIX_MAGIC_LEN)
+		||(memcmp(magic, BINARY_MATRIX_MAGIC, BINARY_MATRIX_MAGIC_LEN)!=0)
+		||(fread(&sampleNum, sizeof(int), 1, fh)!=1)
+		||(fread(&recordNum, sizeof(int), 1, fh)!=1)
+		||(sampleNum<=0)||(recordNum<0))
+	{
+		fclose(fh);
+		return -1;
+	}
+	
+	if (AllocDataMatrix(matrix, sampleNum, recordNum)<=0)
+	{
+		fclose(fh);
+		return -1;
+	}
+	
+	isFailed = 0;
+	
+	for (i=0;i<sampleNum;i++)
+	{
+		isFailed |= (fread(matrix->sampleInfo[i].name, 1, MAX_WORD_SIZE, fh)!=MAX_WORD_SIZE);
+		matrix->sampleInfo[i].name[MAX_WORD_SIZE-1] = 0;
+		matrix->sampleInfo[i].flag = 0;
+	}
+	
+	for (i=0;i<recordNum;i++)
+	{
+		isFailed |= (fread(matrix->recordInfo[i].name, 1, MAX_WORD_SIZE, fh)!=MAX_WORD_SIZE);
+		matrix->recordInfo[i].name[MAX_WORD_SIZE-1] = 0;
+		matrix->recordInfo[i].flag = 0;
+	}
+	
+	isFailed |= (fread(matrix->matrix, sizeof(double), (size_t)sampleNum*recordNum, fh)!=(size_t)sampleNum*recordNum);
+	
+	fclose(fh);
+	
+	if (isFailed)
+	{
+		FreeDataMatrix(matrix);
+		return -1;
 	}
 	
 	return 1;
-}
\ No newline at end of file
+}
+
+//Check whether a file starts with BINARY_MATRIX_MAGIC. Return 1 if it does, 0 if not, -1 if the file cannot be opened
+int IsBinaryDataMatrix(char *fileName)
+{
+	FILE *fh;
+	char magic[BINARY_MATRIX_MAGIC_LEN];
+	int isBinary;
+	
+	fh = (FILE *)fopen(fileName, "rb");
+	
+	if (!fh)
+	{
+		return -1;
+	}
+	
+	isBinary = (fread(magic, 1, BINARY_MATRIX_MAGIC_LEN, fh)==BINARY_MATRIX_MAGIC_LEN)&&(memcmp(magic, BINARY_MATRIX_MAGIC, BINARY_MATRIX_MAGIC_LEN)==0);
+	
+	fclose(fh);
+	
+	return isBinary;
+}
+
+//Read a sparse data matrix. The header row is that of the text format. Each record row is the record ID followed by
+//column:value entries for its nonzeros, column being the 1-based sample index in the header. The names go to matrix, with
+//matrix->matrix NULL, and the values to rows. Return 1 if success, -1 if failure
+int ReadSparseDataMatrix(char *fileName, DATA_MATRIX_STRUCT *matrix, SPARSE_ROWS_STRUCT *rows)
+{
+	FILE *fh;
+	char **words = NULL;
+	int wordNum, wordCapacity = 0;
+	char *line = NULL;
+	size_t lineSize = 0;
+	char *end;
+	long long entryNum;
+	int sampleNum, recordNum, nonzeroNum;
+	int i, column, result;
+	double value;
+	
+	fh = (FILE *)fopen(fileName, "r");
+	
+	if (!fh)
+	{
+		return -1;
+	}
+	
+	//Read the header row to get the sample number, then count the records and the entries. Lines are read whole, so neither
+	//the samples nor the entries of a row are limited
+	sampleNum = ReadLineWords(fh, &line, &lineSize, &words, &wordCapacity)-1;
+	recordNum = 0;
+	entryNum = 0;
+	
+	while ((wordNum = ReadLineWords(fh, &line, &lineSize, &words, &wordCapacity))>=0)
+	{
+		if (wordNum>0)
+		{
+			recordNum++;
+			entryNum += wordNum-1;
+		}
+	}
+	
+	//a line that cannot be split, for a name longer than MAX_WORD_SIZE-1, ends the reading before the end of the file.
+	//The CSR offsets are ints
+	if ((!feof(fh))||(entryNum>INT_MAX))
+	{
+		fclose(fh);
+		free(line);
+		free(words);
+		return -1;
+	}
+	
+	nonzeroNum = (int)entryNum;
+	
+	matrix->recordInfo = (ID_INFO_STRUCT *)malloc((recordNum+1)*sizeof(ID_INFO_STRUCT));
+	matrix->sampleInfo = (ID_INFO_STRUCT *)malloc((sampleNum+1)*sizeof(ID_INFO_STRUCT));
+	matrix->matrix = NULL;
+	matrix->sampleNum = sampleNum;
+	matrix->recordNum = recordNum;
+	rows->rowStart = (int *)malloc((recordNum+1)*sizeof(int));
+	rows->columns = (int *)malloc((nonzeroNum+1)*sizeof(int));
+	rows->values = (double *)malloc((nonzeroNum+1)*sizeof(double));
+	
+	assert((matrix->recordInfo!=NULL)&&(matrix->sampleInfo!=NULL)&&(rows->rowStart!=NULL)&&(rows->columns!=NULL)&&(rows->values!=NULL));
+	
+	result = ((sampleNum>0)&&(matrix->recordInfo!=NULL)&&(matrix->sampleInfo!=NULL)
+			  &&(rows->rowStart!=NULL)&&(rows->columns!=NULL)&&(rows->values!=NULL))?1:-1;
+	
+	//read the file again to retrieve the names and the nonzeros
+	rewind(fh);
+	
+	if (result>0)
+	{
+		ReadLineWords(fh, &line, &lineSize, &words, &wordCapacity);
+		
+		for (i=0;i<sampleNum;i++)
+		{
+			strcpy(matrix->sampleInfo[i].name, words[i+1]);
+			matrix->sampleInfo[i].flag = 0;
+		}
+		
+		recordNum = 0;
+		nonzeroNum = 0;
+		rows->rowStart[0] = 0;
+	}
+	
+	while ((result>0)&&((wordNum = ReadLineWords(fh, &line, &lineSize, &words, &wordCapacity))>=0))
+	{
+		if (wordNum==0)
+		{
+			continue;
+		}
+		
+		strcpy(matrix->recordInfo[recordNum].name, words[0]);
+		matrix->recordInfo[recordNum].flag = 0;
+		
+		for (i=1;i<wordNum;i++)
+		{
+			column = (int)strtol(words[i], &end, 10);
+			
+			if ((*end!=':')||(column<1)||(column>sampleNum))
+			{
+				result = -1;
+				break;
+			}
+			
+			value = atof(end+1);
+			
+			if (value!=0)
+			{
+				rows->columns[nonzeroNum] = column-1;
+				rows->values[nonzeroNum] = value;
+				nonzeroNum++;
+			}
+		}
+		
+		recordNum++;
+		rows->rowStart[recordNum] = nonzeroNum;
+	}
+	
+	rows->nonzeroNum = nonzeroNum;
+	
+	fclose(fh);
+	free(line);
+	free(words);
+	
+	if (result<=0)
+	{
+		FreeDataMatrix(matrix);
+		FreeSparseRows(rows);
+		return -1;
+	}
+	
+	return 1;
+}
+
+//Free memory for sparse rows
+void FreeSparseRows(SPARSE_ROWS_STRUCT *rows)
+{
+	free(rows->rowStart);
+	free(rows->columns);
+	free(rows->values);
+	
+	rows->rowStart = NULL;
+	rows->columns = NULL;
+	rows->values = NULL;
+	rows->nonzeroNum = 0;
+}
+
+//Remove repeated rows of a data matrix in place, keeping the first of each set of identical rows with its record info. Rows are
+//hashed and compared bitwise. profiles[i] is set to the row that record i is kept as. Return the number of rows kept, -1 if failure
+int UniqueDataMatrixRows(DATA_MATRIX_STRUCT *matrix, int *profiles)
+{
+	int *table;
+	unsigned long long hash, mask;
+	unsigned char *bytes;
+	size_t rowSize = matrix->sampleNum*sizeof(double);
+	size_t tableSize, slot, k;
+	int i, uniqueNum;
+	
+	//open addressing over at least twice as many slots as rows
+	for (tableSize=1;tableSize<2*(size_t)matrix->recordNum;tableSize<<=1);
+	
+	mask = tableSize-1;
+	table = (int *)malloc(tableSize*sizeof(int));
+	
+	assert(table!=NULL);
+	
+	if (table==NULL)
+	{
+		return -1;
+	}
+	
+	memset(table, -1, tableSize*sizeof(int));
+	
+	uniqueNum = 0;
+	
+	for (i=0;i<matrix->recordNum;i++)
+	{
+		//FNV-1a
+		bytes = (unsigned char *)(matrix->matrix+(size_t)i*matrix->sampleNum);
+		hash = 14695981039346656037ULL;
+		
+		for (k=0;k<rowSize;k++)
+		{
+			hash = (hash^bytes[k])*1099511628211ULL;
+		}
+		
+		for (slot=hash&mask;table[slot]>=0;slot=(slot+1)&mask)
+		{
+			if (memcmp(matrix->matrix+(size_t)table[slot]*matrix->sampleNum, bytes, rowSize)==0)
+			{
+				break;
+			}
+		}
+		
+		if (table[slot]<0)
+		{
+			//a new profile, moved down to the first free row
+			if (uniqueNum<i)
+			{
+				memcpy(matrix->matrix+(size_t)uniqueNum*matrix->sampleNum, bytes, rowSize);
+				memcpy(&(matrix->recordInfo[uniqueNum]), &(matrix->recordInfo[i]), sizeof(ID_INFO_STRUCT));
+			}
+			
+			table[slot] = uniqueNum;
+			uniqueNum++;
+		}
+		
+		profiles[i] = table[slot];
+	}
+	
+	matrix->recordNum = uniqueNum;
+	
+	free(table);
+	
+	return uniqueNum;
+}
+
+//Read IDs, the first word of each line, into idNum ID info structures. Blank lines are skipped. Return 1 if the file has exactly
+//idNum IDs, -1 otherwise
+int ReadIDList(char *fileName, ID_INFO_STRUCT *ids, int idNum)
+{
+	FILE *fh;
+	char *line = NULL;
+	size_t lineSize = 0;
+	int num, len;
+	char *word;
+	
+	fh = (FILE *)fopen(fileName, "r");
+	
+	if (!fh)
+	{
+		return -1;
+	}
+	
+	num = 0;
+	
+	while (getline(&line, &lineSize, fh)>=0)
+	{
+		word = line+strspn(line, " \t\r\n\v\f");
+		len = (int)strcspn(word, " \t\r\n\v\f");
+		
+		if (len<=0)
+		{
+			continue;
+		}
+		
+		if (num>=idNum)
+		{
+			num++;
+			break;
+		}
+		
+		len = (len<MAX_WORD_SIZE-1)?len:MAX_WORD_SIZE-1;
+		memcpy(ids[num].name, word, len);
+		ids[num].name[len] = 0;
+		ids[num].flag = 0;
+		num++;
+	}
+	
+	free(line);
+	fclose(fh);
+	
+	return (num==idNum)?1:-1;
+}
+
+//Read a Matrix Market coordinate file (real, integer or pattern, general) into sparse rows, with the record IDs from
+//rowIDFileName and the sample IDs from sampleIDFileName, one per line as for 10x feature and barcode lists. The names go to
+//matrix, with matrix->matrix NULL, and the values to rows. Return 1 if success, -1 if failure
+int ReadMatrixMarket(char *fileName, char *rowIDFileName, char *sampleIDFileName, DATA_MATRIX_STRUCT *matrix, SPARSE_ROWS_STRUCT *rows)
+{
+	FILE *fh;
+	char *line = NULL;
+	size_t lineSize = 0;
+	char *end;
+	long long entryNum, k;
+	int rowNum, sampleNum, isPattern, row, column, i;
+	int *fill;
+	double value;
+	long dataStart;
+	
+	matrix->sampleInfo = NULL;
+	matrix->recordInfo = NULL;
+	matrix->matrix = NULL;
+	rows->rowStart = NULL;
+	rows->columns = NULL;
+	rows->values = NULL;
+	
+	fh = (FILE *)fopen(fileName, "r");
+	
+	if (!fh)
+	{
+		return -1;
+	}
+	
+	//banner, then comments, then the size line
+	if ((getline(&line, &lineSize, fh)<0)||(strncmp(line, "%%MatrixMarket matrix coordinate", 32)!=0)||(strstr(line, "general")==NULL)
+		||(strstr(line, "complex")!=NULL))
+	{
+		free(line);
+		fclose(fh);
+		return -1;
+	}
+	
+	isPattern = (strstr(line, "pattern")!=NULL);
+	
+	while ((getline(&line, &lineSize, fh)>=0)&&(line[0]=='%'));
+	
+	//the CSR offsets are ints, so larger matrices are refused rather than truncated
+	if ((sscanf(line, "%d %d %lld", &rowNum, &sampleNum, &entryNum)!=3)||(rowNum<1)||(sampleNum<1)||(entryNum<0)||(entryNum>INT_MAX))
+	{
+		free(line);
+		fclose(fh);
+		return -1;
+	}
+	
+	dataStart = ftell(fh);
+	
+	matrix->recordInfo = (ID_INFO_STRUCT *)malloc((rowNum+1)*sizeof(ID_INFO_STRUCT));
+	matrix->sampleInfo = (ID_INFO_STRUCT *)malloc((sampleNum+1)*sizeof(ID_INFO_STRUCT));
+	matrix->recordNum = rowNum;
+	matrix->sampleNum = sampleNum;
+	rows->rowStart = (int *)calloc(rowNum+1, sizeof(int));
+	fill = (int *)malloc((rowNum+1)*sizeof(int));
+	
+	assert((matrix->recordInfo!=NULL)&&(matrix->sampleInfo!=NULL)&&(rows->rowStart!=NULL)&&(fill!=NULL));
+	
+	if ((matrix->recordInfo==NULL)||(matrix->sampleInfo==NULL)||(rows->rowStart==NULL)||(fill==NULL)
+		||(ReadIDList(rowIDFileName, matrix->recordInfo, rowNum)<=0)||(ReadIDList(sampleIDFileName, matrix->sampleInfo, sampleNum)<=0))
+	{
+		free(line);
+		free(fill);
+		fclose(fh);
+		FreeDataMatrix(matrix);
+		FreeSparseRows(rows);
+		return -1;
+	}
+	
+	//the entries may come in any order: the first pass counts them per row, the second places them
+	for (k=0;(k<entryNum)&&(getline(&line, &lineSize, fh)>=0);k++)
+	{
+		row = (int)strtol(line, &end, 10);
+		
+		if ((row<1)||(row>rowNum))
+		{
+			break;
+		}
+		
+		rows->rowStart[row]++;
+	}
+	
+	if (k<entryNum)
+	{
+		free(line);
+		free(fill);
+		fclose(fh);
+		FreeDataMatrix(matrix);
+		FreeSparseRows(rows);
+		return -1;
+	}
+	
+	for (i=0;i<rowNum;i++)
+	{
+		rows->rowStart[i+1] += rows->rowStart[i];
+		fill[i] = rows->rowStart[i];
+	}
+	
+	rows->columns = (int *)malloc((entryNum+1)*sizeof(int));
+	rows->values = (double *)malloc((entryNum+1)*sizeof(double));
+	
+	assert((rows->columns!=NULL)&&(rows->values!=NULL));
+	
+	if ((rows->columns==NULL)||(rows->values==NULL)||(fseek(fh, dataStart, SEEK_SET)!=0))
+	{
+		free(line);
+		free(fill);
+		fclose(fh);
+		FreeDataMatrix(matrix);
+		FreeSparseRows(rows);
+		return -1;
+	}
+	
+	for (k=0;(k<entryNum)&&(getline(&line, &lineSize, fh)>=0);k++)
+	{
+		row = (int)strtol(line, &end, 10);
+		column = (int)strtol(end, &end, 10);
+		value = isPattern?1:strtod(end, &end);
+		
+		if ((column<1)||(column>sampleNum))
+		{
+			break;
+		}
+		
+		rows->columns[fill[row-1]] = column-1;
+		rows->values[fill[row-1]] = value;
+		fill[row-1]++;
+	}
+	
+	free(line);
+	free(fill);
+	fclose(fh);
+	
+	if (k<entryNum)
+	{
+		FreeDataMatrix(matrix);
+		FreeSparseRows(rows);
+		return -1;
+	}
+	
+	rows->nonzeroNum = (int)entryNum;
+	
+	return 1;
+}
+
+//Build a hash index of the names of idNum IDs. The first of repeated names is the one found. Return 1 if success, -1 if failure
+int BuildIDIndex(ID_INDEX_STRUCT *index, ID_INFO_STRUCT *ids, int idNum)
+{
+	size_t slot;
+	int i;
+	
+	for (index->slotNum=1;index->slotNum<2*(size_t)idNum;index->slotNum<<=1);
+	
+	index->ids = ids;
+	index->slots = (int *)malloc(index->slotNum*sizeof(int));
+	
+	assert(index->slots!=NULL);
+	
+	if (index->slots==NULL)
+	{
+		return -1;
+	}
+	
+	memset(index->slots, -1, index->slotNum*sizeof(int));
+	
+	for (i=0;i<idNum;i++)
+	{
+		for (slot=HashName(ids[i].name)&(index->slotNum-1);index->slots[slot]>=0;slot=(slot+1)&(index->slotNum-1))
+		{
+			if (!strcmp(ids[index->slots[slot]].name, ids[i].name))
+			{
+				break;
+			}
+		}
+		
+		if (index->slots[slot]<0)
+		{
+			index->slots[slot] = i;
+		}
+	}
+	
+	return 1;
+}
+
+//Return the position of name among the indexed IDs, -1 if it is not there
+int FindID(ID_INDEX_STRUCT *index, char *name)
+{
+	size_t slot;
+	
+	for (slot=HashName(name)&(index->slotNum-1);index->slots[slot]>=0;slot=(slot+1)&(index->slotNum-1))
+	{
+		if (!strcmp(index->ids[index->slots[slot]].name, name))
+		{
+			return index->slots[slot];
+		}
+	}
+	
+	return -1;
+}
+
+//Free the hash index
+void FreeIDIndex(ID_INDEX_STRUCT *index)
+{
+	free(index->slots);
+	index->slots = NULL;
+	index->slotNum = 0;
+}
+
+//Match the sample IDs of two matrices through a hash index. match[i] is set to the index in matrix2 of sample i of matrix1,
+//or -1. Return the number of matched samples, -1 if failure
+int MatchSampleIDs(DATA_MATRIX_STRUCT *matrix1, DATA_MATRIX_STRUCT *matrix2, int *match)
+{
+	ID_INDEX_STRUCT index;
+	int i, matchedNum;
+	
+	//the first of repeated IDs of matrix2 is the one matched, as in IntersectSampleIDs
+	if (BuildIDIndex(&index, matrix2->sampleInfo, matrix2->sampleNum)<=0)
+	{
+		return -1;
+	}
+	
+	matchedNum = 0;
+	
+	for (i=0;i<matrix1->sampleNum;i++)
+	{
+		match[i] = FindID(&index, matrix1->sampleInfo[i].name);
+		matchedNum += (match[i]>=0);
+	}
+	
+	FreeIDIndex(&index);
+	
+	return matchedNum;
+}
+
+//Keep the samples selected[0..selectedNum-1] of a matrix, in that order: the names, and the dense values or, when srcRows is
+//not NULL, the sparse rows. Return 1 if success, -1 if failure
+int SelectSamples(DATA_MATRIX_STRUCT *src, SPARSE_ROWS_STRUCT *srcRows, int *selected, int selectedNum, 
+				  DATA_MATRIX_STRUCT *dest, SPARSE_ROWS_STRUCT *destRows)
+{
+	int *newColumn;
+	int i, k, index;
+	
+	dest->recordInfo = (ID_INFO_STRUCT *)malloc((src->recordNum+1)*sizeof(ID_INFO_STRUCT));
+	dest->sampleInfo = (ID_INFO_STRUCT *)malloc((selectedNum+1)*sizeof(ID_INFO_STRUCT));
+	dest->matrix = (srcRows==NULL)?(double *)malloc(((size_t)src->recordNum*selectedNum+1)*sizeof(double)):NULL;
+	dest->recordNum = src->recordNum;
+	dest->sampleNum = selectedNum;
+	newColumn = (int *)malloc((src->sampleNum+1)*sizeof(int));
+	
+	assert((dest->recordInfo!=NULL)&&(dest->sampleInfo!=NULL)&&((srcRows!=NULL)||(dest->matrix!=NULL))&&(newColumn!=NULL));
+	
+	if ((dest->recordInfo==NULL)||(dest->sampleInfo==NULL)||((srcRows==NULL)&&(dest->matrix==NULL))||(newColumn==NULL))
+	{
+		free(newColumn);
+		FreeDataMatrix(dest);
+		return -1;
+	}
+	
+	memcpy(dest->recordInfo, src->recordInfo, src->recordNum*sizeof(ID_INFO_STRUCT));
+	
+	for (i=0;i<selectedNum;i++)
+	{
+		memcpy(&(dest->sampleInfo[i]), &(src->sampleInfo[selected[i]]), sizeof(ID_INFO_STRUCT));
+	}
+	
+	if (srcRows==NULL)
+	{
+		for (k=0;k<src->recordNum;k++)
+		{
+			for (i=0;i<selectedNum;i++)
+			{
+				dest->matrix[(size_t)k*selectedNum+i] = src->matrix[(size_t)k*src->sampleNum+selected[i]];
+			}
+		}
+		
+		free(newColumn);
+		
+		return 1;
+	}
+	
+	for (i=0;i<src->sampleNum;i++)
+	{
+		newColumn[i] = -1;
+	}
+	
+	for (i=0;i<selectedNum;i++)
+	{
+		newColumn[selected[i]] = i;
+	}
+	
+	destRows->rowStart = (int *)malloc((src->recordNum+1)*sizeof(int));
+	destRows->columns = (int *)malloc((srcRows->nonzeroNum+1)*sizeof(int));
+	destRows->values = (double *)malloc((srcRows->nonzeroNum+1)*sizeof(double));
+	
+	assert((destRows->rowStart!=NULL)&&(destRows->columns!=NULL)&&(destRows->values!=NULL));
+	
+	if ((destRows->rowStart==NULL)||(destRows->columns==NULL)||(destRows->values==NULL))
+	{
+		free(newColumn);
+		FreeDataMatrix(dest);
+		FreeSparseRows(destRows);
+		return -1;
+	}
+	
+	index = 0;
+	destRows->rowStart[0] = 0;
+	
+	for (i=0;i<src->recordNum;i++)
+	{
+		for (k=srcRows->rowStart[i];k<srcRows->rowStart[i+1];k++)
+		{
+			if (newColumn[srcRows->columns[k]]>=0)
+			{
+				destRows->columns[index] = newColumn[srcRows->columns[k]];
+				destRows->values[index] = srcRows->values[k];
+				index++;
+			}
+		}
+		
+		destRows->rowStart[i+1] = index;
+	}
+	
+	destRows->nonzeroNum = index;
+	
+	free(newColumn);
+	
+	return 1;
+}
+
+//Intersect two matrices by samples, in the sample order of matrix1, through MatchSampleIDs. A matrix whose rows argument is not
+//NULL is sparse: its values are in the rows, and its trimmed values go to the dest rows. Return 1 if success, -1 if failure
+int IntersectSampleIDsRows(DATA_MATRIX_STRUCT *srcMatrix1, SPARSE_ROWS_STRUCT *srcRows1, DATA_MATRIX_STRUCT *srcMatrix2, SPARSE_ROWS_STRUCT *srcRows2, 
+						   DATA_MATRIX_STRUCT *destMatrix1, SPARSE_ROWS_STRUCT *destRows1, DATA_MATRIX_STRUCT *destMatrix2, SPARSE_ROWS_STRUCT *destRows2)
+{
+	int *match, *selected1, *selected2;
+	int i, matchedNum, result;
+	
+	match = (int *)malloc((srcMatrix1->sampleNum+1)*sizeof(int));
+	selected1 = (int *)malloc((srcMatrix1->sampleNum+1)*sizeof(int));
+	selected2 = (int *)malloc((srcMatrix1->sampleNum+1)*sizeof(int));
+	
+	assert((match!=NULL)&&(selected1!=NULL)&&(selected2!=NULL));
+	
+	if ((match==NULL)||(selected1==NULL)||(selected2==NULL))
+	{
+		free(match);
+		free(selected1);
+		free(selected2);
+		return -1;
+	}
+	
+	matchedNum = 0;
+	
+	if (MatchSampleIDs(srcMatrix1, srcMatrix2, match)>0)
+	{
+		for (i=0;i<srcMatrix1->sampleNum;i++)
+		{
+			if (match[i]>=0)
+			{
+				selected1[matchedNum] = i;
+				selected2[matchedNum] = match[i];
+				matchedNum++;
+			}
+		}
+	}
+	
+	result = -1;
+	
+	if (matchedNum>0)
+	{
+		if (SelectSamples(srcMatrix1, srcRows1, selected1, matchedNum, destMatrix1, destRows1)>0)
+		{
+			if (SelectSamples(srcMatrix2, srcRows2, selected2, matchedNum, destMatrix2, destRows2)>0)
+			{
+				result = 1;
+			}
+			else
+			{
+				FreeDataMatrix(destMatrix1);
+				
+				if (srcRows1!=NULL)
+				{
+					FreeSparseRows(destRows1);
+				}
+			}
+		}
+	}
+	
+	free(match);
+	free(selected1);
+	free(selected2);
+	
+	return result;
+}
@@ -0,0 +1,536 @@
+/*
+ *  dcor.c
+ *  Fast distance correlation
+ *
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <assert.h>
+#include "math_api.h"
+#include "dcor.h"
+
+//Allocate a univariate distance structure for dim values
+int AllocUnivariateDist(UNIVARIATE_DIST_STRUCT *dist, int dim);
+
+//Free a univariate distance structure
+void FreeUnivariateDist(UNIVARIATE_DIST_STRUCT *dist);
+
+//Center the values, sort them and compute the distance row sums. O(dim*log(dim))
+void PrepareUnivariateDist(UNIVARIATE_DIST_STRUCT *dist, double *values, int dim, INDEXED_FLOAT *sortBuf);
+
+//Squared distance covariance of two prepared arrays. tree is workspace of 4*(dim+1) values
+double UnivariateDCov(UNIVARIATE_DIST_STRUCT *x, UNIVARIATE_DIST_STRUCT *y, int dim, double *tree);
+
+//Allocate a univariate distance structure for dim values
+int AllocUnivariateDist(UNIVARIATE_DIST_STRUCT *dist, int dim)
+{
+	dist->values = (double *)malloc(dim*sizeof(double));
+	dist->order = (int *)malloc(dim*sizeof(int));
+	dist->rank = (int *)malloc(dim*sizeof(int));
+	dist->rowSums = (double *)malloc(dim*sizeof(double));
+	
+	assert((dist->values!=NULL)&&(dist->order!=NULL)&&(dist->rank!=NULL)&&(dist->rowSums!=NULL));
+	
+	if ((dist->values==NULL)||(dist->order==NULL)||(dist->rank==NULL)||(dist->rowSums==NULL))
+	{
+		return -1;
+	}
+	
+	return 1;
+}
+
+//Free a univariate distance structure
+void FreeUnivariateDist(UNIVARIATE_DIST_STRUCT *dist)
+{
+	free(dist->values);
+	free(dist->order);
+	free(dist->rank);
+	free(dist->rowSums);
+}
+
+//Center the values, sort them and compute the distance row sums. O(dim*log(dim))
+void PrepareUnivariateDist(UNIVARIATE_DIST_STRUCT *dist, double *values, int dim, INDEXED_FLOAT *sortBuf)
+{
+	int i, k;
+	double mean, prefix, total;
+	
+	//distances are shift invariant; centering keeps the Fenwick sums of x*y small
+	mean = 0;
+	
+	for (i=0;i<dim;i++)
+	{
+		mean += values[i];
+	}
+	
+	mean /= dim;
+	
+	for (i=0;i<dim;i++)
+	{
+		dist->values[i] = values[i]-mean;
+		sortBuf[i].value = dist->values[i];
+		sortBuf[i].index = i;
+	}
+	
+	QuicksortIndexedArray(sortBuf, 0, dim-1);
+	
+	total = 0;
+	dist->rankNum = 0;
+	
+	for (k=0;k<dim;k++)
+	{
+		dist->order[k] = sortBuf[k].index;
+		
+		if ((k>0)&&(sortBuf[k].value>sortBuf[k-1].value))
+		{
+			dist->rankNum++;
+		}
+		
+		dist->rank[sortBuf[k].index] = dist->rankNum;
+		total += sortBuf[k].value;
+	}
+	
+	dist->rankNum++;
+	
+	//row sum of the k-th smallest value x: (2k-dim)*x + total - 2*(sum of the k smaller values). Ties contribute zero either way
+	prefix = 0;
+	dist->sum = 0;
+	
+	for (k=0;k<dim;k++)
+	{
+		i = dist->order[k];
+		dist->rowSums[i] = (2.0*k-dim)*dist->values[i]+total-2*prefix;
+		prefix += dist->values[i];
+		dist->sum += dist->rowSums[i];
+	}
+}
+
+//Squared distance covariance of two prepared arrays. tree is workspace of 4*(dim+1) values
+double UnivariateDCov(UNIVARIATE_DIST_STRUCT *x, UNIVARIATE_DIST_STRUCT *y, int dim, double *tree)
+{
+	int i, k, r, size;
+	double *cntTree, *xTree, *yTree, *xyTree;
+	double xi, yi;
+	double cL, sxL, syL, sxyL, cT, sxT, syT, sxyT;
+	double crossSum, rowProduct, dCov;
+	
+	size = y->rankNum;
+	cntTree = tree;
+	xTree = tree+(size+1);
+	yTree = tree+2*(size+1);
+	xyTree = tree+3*(size+1);
+	
+	memset(tree, 0, 4*(size+1)*sizeof(double));
+	
+	//visit the points in ascending x, so |x_i-x_j| = x_i-x_j for all earlier j. The sign of y_i-y_j comes from
+	//splitting the earlier points by y rank, with partial sums of 1, x, y and x*y in Fenwick trees over the y ranks
+	crossSum = 0;
+	cT = 0;
+	sxT = 0;
+	syT = 0;
+	sxyT = 0;
+	
+	for (k=0;k<dim;k++)
+	{
+		i = x->order[k];
+		xi = x->values[i];
+		yi = y->values[i];
+		
+		cL = 0;
+		sxL = 0;
+		syL = 0;
+		sxyL = 0;
+		
+		for (r=y->rank[i];r>0;r-=r&(-r))
+		{
+			cL += cntTree[r];
+			sxL += xTree[r];
+			syL += yTree[r];
+			sxyL += xyTree[r];
+		}
+		
+		crossSum += (cL*xi*yi-xi*syL-yi*sxL+sxyL)
+					-((cT-cL)*xi*yi-xi*(syT-syL)-yi*(sxT-sxL)+(sxyT-sxyL));
+		
+		for (r=y->rank[i]+1;r<=size;r+=r&(-r))
+		{
+			cntTree[r] += 1;
+			xTree[r] += xi;
+			yTree[r] += yi;
+			xyTree[r] += xi*yi;
+		}
+		
+		cT += 1;
+		sxT += xi;
+		syT += yi;
+		sxyT += xi*yi;
+	}
+	
+	crossSum *= 2;
+	
+	rowProduct = 0;
+	
+	for (i=0;i<dim;i++)
+	{
+		rowProduct += x->rowSums[i]*y->rowSums[i];
+	}
+	
+	dCov = crossSum/((double)dim*dim)-2*rowProduct/((double)dim*dim*dim)+x->sum*y->sum/((double)dim*dim*dim*dim);
+	
+	return (dCov>0)?dCov:0;
+}
+
+//Squared distance covariance (V-statistic) of two univariate arrays in O(dim*log(dim)), by sorting and Fenwick-tree partial sums
+double FastDistanceCovariance(double *x, double *y, int dim)
+{
+	UNIVARIATE_DIST_STRUCT xDist, yDist;
+	INDEXED_FLOAT *sortBuf;
+	double *tree;
+	double dCov;
+	
+	sortBuf = (INDEXED_FLOAT *)malloc(dim*sizeof(INDEXED_FLOAT));
+	tree = (double *)malloc(4*(dim+1)*sizeof(double));
+	
+	assert((sortBuf!=NULL)&&(tree!=NULL));
+	
+	AllocUnivariateDist(&xDist, dim);
+	AllocUnivariateDist(&yDist, dim);
+	
+	PrepareUnivariateDist(&xDist, x, dim, sortBuf);
+	PrepareUnivariateDist(&yDist, y, dim, sortBuf);
+	
+	dCov = UnivariateDCov(&xDist, &yDist, dim, tree);
+	
+	FreeUnivariateDist(&xDist);
+	FreeUnivariateDist(&yDist);
+	free(sortBuf);
+	free(tree);
+	
+	return dCov;
+}
+
+//Prepare the distance structure of a target array. isFast: O(dim) structure for EvalDistanceCorrelation's fast path, otherwise the O(dim^2) centered matrix.
+//Return 1 if success, -1 if failure
+int PrepareDistanceTarget(DCOR_TARGET_STRUCT *target, double *output, int dim, int isFast)
+{
+	int i,j;
+	double *rowMeans, *packed, *tree;
+	INDEXED_FLOAT *sortBuf;
+	double meanAll, d, dVar;
+	
+	target->dim = dim;
+	target->isFast = isFast;
+	target->centered = NULL;
+	target->dVar = 0;
+	
+	if (dim<2)
+	{
+		return -1;
+	}
+	
+	if (isFast)
+	{
+		sortBuf = (INDEXED_FLOAT *)malloc(dim*sizeof(INDEXED_FLOAT));
+		
+		assert(sortBuf!=NULL);
+		
+		if ((sortBuf==NULL)||(AllocUnivariateDist(&(target->dist), dim)<=0))
+		{
+			free(sortBuf);
+			return -1;
+		}
+		
+		PrepareUnivariateDist(&(target->dist), output, dim, sortBuf);
+		free(sortBuf);
+		
+		tree = (double *)malloc(4*(dim+1)*sizeof(double));
+		
+		assert(tree!=NULL);
+		
+		target->dVar = UnivariateDCov(&(target->dist), &(target->dist), dim, tree);
+		free(tree);
+		
+		return 1;
+	}
+	
+	rowMeans = (double *)malloc(dim*sizeof(double));
+	target->centered = (double *)malloc((size_t)dim*(dim-1)/2*sizeof(double));
+	
+	assert((rowMeans!=NULL)&&(target->centered!=NULL));
+	
+	if ((rowMeans==NULL)||(target->centered==NULL))
+	{
+		free(rowMeans);
+		free(target->centered);
+		target->centered = NULL;
+		return -1;
+	}
+	
+	memset(rowMeans, 0, dim*sizeof(double));
+	meanAll = 0;
+	
+	for (i=0;i<dim;i++)
+	{
+		for (j=i+1;j<dim;j++)
+		{
+			d = fabs(output[i]-output[j]);
+			rowMeans[i] += d;
+			rowMeans[j] += d;
+		}
+		
+		meanAll += rowMeans[i];
+	}
+	
+	for (i=0;i<dim;i++)
+	{
+		rowMeans[i] /= dim;
+	}
+	
+	meanAll /= ((double)dim*dim);
+	
+	//the diagonal of the centered matrix is only needed for the variance; the evaluation pairs it with zero input distances
+	packed = target->centered;
+	dVar = 0;
+	
+	for (i=0;i<dim;i++)
+	{
+		d = -2*rowMeans[i]+meanAll;
+		dVar += d*d;
+		
+		for (j=i+1;j<dim;j++)
+		{
+			d = fabs(output[i]-output[j])-rowMeans[i]-rowMeans[j]+meanAll;
+			*packed = d;
+			packed++;
+			dVar += 2*d*d;
+		}
+	}
+	
+	target->dVar = dVar/((double)dim*dim);
+	
+	free(rowMeans);
+	
+	return 1;
+}
+
+//Free a prepared target
+void FreeDistanceTarget(DCOR_TARGET_STRUCT *target)
+{
+	if (target->isFast)
+	{
+		FreeUnivariateDist(&(target->dist));
+	}
+	else
+	{
+		free(target->centered);
+		target->centered = NULL;
+	}
+}
+
+//Allocate the scratch space of EvalDistanceCorrelation. Return 1 if success, -1 if failure
+int AllocDCorWorkspace(DCOR_WORKSPACE_STRUCT *workspace, int dim)
+{
+	workspace->dim = dim;
+	workspace->rowSums = (double *)malloc(dim*sizeof(double));
+	workspace->proj = (double *)malloc(dim*sizeof(double));
+	workspace->tree = (double *)malloc(4*(dim+1)*sizeof(double));
+	workspace->sortBuf = (INDEXED_FLOAT *)malloc(dim*sizeof(INDEXED_FLOAT));
+	
+	assert((workspace->rowSums!=NULL)&&(workspace->proj!=NULL)&&(workspace->tree!=NULL)&&(workspace->sortBuf!=NULL));
+	
+	if ((workspace->rowSums==NULL)||(workspace->proj==NULL)||(workspace->tree==NULL)||(workspace->sortBuf==NULL))
+	{
+		return -1;
+	}
+	
+	if (AllocUnivariateDist(&(workspace->projDist), dim)<=0)
+	{
+		return -1;
+	}
+	
+	return 1;
+}
+
+//Free the scratch space
+void FreeDCorWorkspace(DCOR_WORKSPACE_STRUCT *workspace)
+{
+	free(workspace->rowSums);
+	free(workspace->proj);
+	free(workspace->tree);
+	free(workspace->sortBuf);
+	
+	FreeUnivariateDist(&(workspace->projDist));
+}
+
+//Distance correlation between an input (inputNum*dim values, as in ComputeDistanceCorrelation) and a prepared target.
+//Exact targets: one pass over the pairs i<j, without building the input distance matrix.
+//Fast targets: O(dim*log(dim)). One input variable is exact; with two, the input distances in dCov and in the distance row sums are
+//averaged from DCOR_PROJECTION_NUM equally spaced projections, which is within 0.33% of the Euclidean distance. More variables need an exact target
+double EvalDistanceCorrelation(DCOR_TARGET_STRUCT *target, double *input, int inputNum, DCOR_WORKSPACE_STRUCT *workspace)
+{
+	int dim = target->dim;
+	int i,j,k;
+	double *packed, *rowSums;
+	double a, d, sumSq, rowSq, total, dCov, dVar1, angle;
+	
+	assert(workspace->dim==dim);
+	
+	if (!target->isFast)
+	{
+		//B is double-centered, so sum(A*B) = sum(a*B) over the raw input distances a, and sum(A*A) follows from the
+		//raw sums: sum(a*a) - 2/dim*sum(rowSum^2) + total^2/dim^2. Each pair i<j is visited once
+		rowSums = workspace->rowSums;
+		memset(rowSums, 0, dim*sizeof(double));
+		packed = target->centered;
+		dCov = 0;
+		sumSq = 0;
+		
+		for (i=0;i<dim;i++)
+		{
+			for (j=i+1;j<dim;j++)
+			{
+				a = 0;
+				
+				for (k=0;k<inputNum;k++)
+				{
+					d = input[k*dim+i]-input[k*dim+j];
+					a += d*d;
+				}
+				
+				sumSq += a;
+				a = sqrt(a);
+				rowSums[i] += a;
+				rowSums[j] += a;
+				dCov += a*(*packed);
+				packed++;
+			}
+		}
+		
+		rowSq = 0;
+		total = 0;
+		
+		for (i=0;i<dim;i++)
+		{
+			rowSq += rowSums[i]*rowSums[i];
+			total += rowSums[i];
+		}
+		
+		dCov = 2*dCov/((double)dim*dim);
+		dVar1 = (2*sumSq-2*rowSq/dim+total*total/((double)dim*dim))/((double)dim*dim);
+	}
+	else
+	{
+		if ((inputNum>2)||(inputNum<1))
+		{
+			return 0;
+		}
+		
+		if (inputNum==1)
+		{
+			PrepareUnivariateDist(&(workspace->projDist), input, dim, workspace->sortBuf);
+			
+			dCov = UnivariateDCov(&(workspace->projDist), &(target->dist), dim, workspace->tree);
+			dVar1 = UnivariateDCov(&(workspace->projDist), &(workspace->projDist), dim, workspace->tree);
+		}
+		else
+		{
+			//The Euclidean distance is pi/2 times the mean absolute projection over all directions, approximated by
+			//DCOR_PROJECTION_NUM equally spaced directions. dCov is linear in the input distances, so it is the average of
+			//univariate terms. dVar needs the sum of squared distances, which is exact in O(dim), and the distance row sums,
+			//which are averaged over the projections like dCov
+			rowSums = workspace->rowSums;
+			memset(rowSums, 0, dim*sizeof(double));
+			dCov = 0;
+			
+			for (k=0;k<DCOR_PROJECTION_NUM;k++)
+			{
+				angle = M_PI*k/DCOR_PROJECTION_NUM;
+				
+				for (i=0;i<dim;i++)
+				{
+					workspace->proj[i] = cos(angle)*input[i]+sin(angle)*input[dim+i];
+				}
+				
+				PrepareUnivariateDist(&(workspace->projDist), workspace->proj, dim, workspace->sortBuf);
+				
+				dCov += UnivariateDCov(&(workspace->projDist), &(target->dist), dim, workspace->tree);
+				
+				for (i=0;i<dim;i++)
+				{
+					rowSums[i] += workspace->projDist.rowSums[i];
+				}
+			}
+			
+			dCov *= M_PI/2/DCOR_PROJECTION_NUM;
+			
+			rowSq = 0;
+			total = 0;
+			
+			for (i=0;i<dim;i++)
+			{
+				rowSums[i] *= M_PI/2/DCOR_PROJECTION_NUM;
+				rowSq += rowSums[i]*rowSums[i];
+				total += rowSums[i];
+			}
+			
+			//sum over all pairs of squared distances: 2*dim*(sum of squared deviations from the mean), for each variable
+			sumSq = 0;
+			
+			for (k=0;k<inputNum;k++)
+			{
+				a = 0;
+				
+				for (i=0;i<dim;i++)
+				{
+					a += input[k*dim+i];
+				}
+				
+				a /= dim;
+				
+				for (i=0;i<dim;i++)
+				{
+					sumSq += (input[k*dim+i]-a)*(input[k*dim+i]-a);
+				}
+			}
+			
+			sumSq *= 2*dim;
+			
+			dVar1 = (sumSq-2*rowSq/dim+total*total/((double)dim*dim))/((double)dim*dim);
+		}
+	}
+	
+	if ((dCov<=0)||(dVar1<=0)||(target->dVar<=0))
+	{
+		return 0;
+	}
+	
+	//same normalization as ComputeDistanceCorrelation: dCov/sqrt(dVar1*dVar2) on the square roots of the V-statistics
+	return sqrt(dCov)/sqrt(sqrt(dVar1)*sqrt(target->dVar));
+}
+
+//Compute distance correlation with the same arguments as ComputeDistanceCorrelation, through the fast path of EvalDistanceCorrelation.
+//More than two input variables fall back to ComputeDistanceCorrelation
+double ComputeDistanceCorrelationFast(double *input, double *output, int inputNum, int dim)
+{
+	DCOR_TARGET_STRUCT target;
+	DCOR_WORKSPACE_STRUCT workspace;
+	double score;
+	
+	if ((inputNum>2)||(inputNum<1))
+	{
+		return ComputeDistanceCorrelation(input, output, inputNum, dim);
+	}
+	
+	if ((PrepareDistanceTarget(&target, output, dim, 1)<=0)||(AllocDCorWorkspace(&workspace, dim)<=0))
+	{
+		return 0;
+	}
+	
+	score = EvalDistanceCorrelation(&target, input, inputNum, &workspace);
+	
+	FreeDistanceTarget(&target);
+	FreeDCorWorkspace(&workspace);
+	
+	return score;
+}
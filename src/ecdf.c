@@ -0,0 +1,171 @@
+/*
+ *  ecdf.c
+ *  Empirical CDF lookups against a sorted null distribution
+ *
+ */
+
+#include <stdlib.h>
+#include <assert.h>
+#include "math_api.h"
+#include "ecdf.h"
+
+//Batched lookups switch from one search per query to sort-and-merge when there are more queries than this fraction of the null size
+#define ECDF_MERGE_RATIO 0.05
+
+//Batched lookup shared by EcdfBatchCountLess and EcdfBatchCountLessEqual. inclusive: count items equal to the query as well
+int EcdfBatchCount(int *counts, double *queries, int queryNum, double *sorted, int size, int inclusive);
+
+//Count the items of a sorted array (ascending order) that are smaller than value. Iterative and branchless
+int EcdfCountLess(double value, double *sorted, int size)
+{
+	double *base = sorted;
+	int len = size;
+	int half;
+	
+	if (size<=0)
+	{
+		return 0;
+	}
+	
+	//the compiler turns the conditional move into cmov, so the loop has no data-dependent branch
+	while (len>1)
+	{
+		half = len/2;
+		base = (base[half]<value)?base+half:base;
+		len -= half;
+	}
+	
+	return (int)(base-sorted)+(*base<value);
+}
+
+//Count the items of a sorted array (ascending order) that are smaller than or equal to value. Iterative and branchless
+int EcdfCountLessEqual(double value, double *sorted, int size)
+{
+	double *base = sorted;
+	int len = size;
+	int half;
+	
+	if (size<=0)
+	{
+		return 0;
+	}
+	
+	while (len>1)
+	{
+		half = len/2;
+		base = (base[half]<=value)?base+half:base;
+		len -= half;
+	}
+	
+	return (int)(base-sorted)+(*base<=value);
+}
+
+//Batched lookup shared by EcdfBatchCountLess and EcdfBatchCountLessEqual. inclusive: count items equal to the query as well
+int EcdfBatchCount(int *counts, double *queries, int queryNum, double *sorted, int size, int inclusive)
+{
+	INDEXED_FLOAT *order;
+	int i, j;
+	
+	if (queryNum<=0)
+	{
+		return 1;
+	}
+	
+	//few queries against a large null: independent searches are cheaper than sorting the queries
+	if (queryNum<ECDF_MERGE_RATIO*size)
+	{
+		for (i=0;i<queryNum;i++)
+		{
+			counts[i] = inclusive?EcdfCountLessEqual(queries[i], sorted, size):EcdfCountLess(queries[i], sorted, size);
+		}
+		
+		return 1;
+	}
+	
+	order = (INDEXED_FLOAT *)malloc(queryNum*sizeof(INDEXED_FLOAT));
+	
+	assert(order!=NULL);
+	
+	if (order==NULL)
+	{
+		return -1;
+	}
+	
+	for (i=0;i<queryNum;i++)
+	{
+		order[i].value = queries[i];
+		order[i].index = i;
+	}
+	
+	QuicksortIndexedArray(order, 0, queryNum-1);
+	
+	//merge the sorted queries against the sorted null. j only moves forward, so ties are counted exactly once
+	j = 0;
+	
+	for (i=0;i<queryNum;i++)
+	{
+		if (inclusive)
+		{
+			while ((j<size)&&(sorted[j]<=order[i].value))
+			{
+				j++;
+			}
+		}
+		else
+		{
+			while ((j<size)&&(sorted[j]<order[i].value))
+			{
+				j++;
+			}
+		}
+		
+		counts[order[i].index] = j;
+	}
+	
+	free(order);
+	
+	return 1;
+}
+
+//Batched EcdfCountLess. counts[i] is the number of items in sorted smaller than queries[i]. Queries need not be sorted. Return 1 if success, -1 if failure
+int EcdfBatchCountLess(int *counts, double *queries, int queryNum, double *sorted, int size)
+{
+	return EcdfBatchCount(counts, queries, queryNum, sorted, size, 0);
+}
+
+//Batched EcdfCountLessEqual. counts[i] is the number of items in sorted smaller than or equal to queries[i]. Return 1 if success, -1 if failure
+int EcdfBatchCountLessEqual(int *counts, double *queries, int queryNum, double *sorted, int size)
+{
+	return EcdfBatchCount(counts, queries, queryNum, sorted, size, 1);
+}
+
+//Upper-tail permutation p-values, pValues[i] = #(null>=queries[i])/nullNum. The null has to be sorted in ascending order. Return 1 if success, -1 if failure
+int EcdfUpperTailP(double *pValues, double *queries, int queryNum, double *sortedNull, int nullNum)
+{
+	int *counts;
+	int i;
+	
+	if ((queryNum<=0)||(nullNum<=0))
+	{
+		return -1;
+	}
+	
+	counts = (int *)malloc(queryNum*sizeof(int));
+	
+	assert(counts!=NULL);
+	
+	if ((counts==NULL)||(EcdfBatchCountLess(counts, queries, queryNum, sortedNull, nullNum)<=0))
+	{
+		free(counts);
+		return -1;
+	}
+	
+	for (i=0;i<queryNum;i++)
+	{
+		pValues[i] = (double)(nullNum-counts[i])/nullNum;
+	}
+	
+	free(counts);
+	
+	return 1;
+}
@@ -0,0 +1,241 @@
+/*
+ *  format.c
+ *  Fast number formatting into large output buffers
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "format.h"
+
+#define FORMAT_MAX_SCALED 1e12			//value*10^precision below this is formatted in integer arithmetic (error of the product < 2^-12)
+#define FORMAT_ROUNDING_GUARD 1e-3		//products closer than this to a rounding boundary are left to snprintf
+
+double formatPowersOfTen[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+
+//Format a real value as printf("%.*f", precision, value) does, precision 0..9. dest needs FORMAT_MAX_WIDTH+1 chars.
+//Integer arithmetic for moderate values, snprintf for large values and for products too close to a rounding boundary.
+//Return the number of chars written, not counting the terminating 0
+int FormatFixed(char *dest, double value, int precision)
+{
+	double scaled, frac;
+	unsigned long long n, intPart, fracPart;
+	char digits[24];
+	int len, digitNum, i;
+	
+	assert((precision>=0)&&(precision<=9));
+	
+	scaled = fabs(value)*formatPowersOfTen[precision];
+	
+	//also catches NaN
+	if (!(scaled<FORMAT_MAX_SCALED))
+	{
+		return snprintf(dest, FORMAT_MAX_WIDTH+1, "%.*f", precision, value);
+	}
+	
+	n = (unsigned long long)scaled;
+	frac = scaled-(double)n;
+	
+	if (fabs(frac-0.5)<FORMAT_ROUNDING_GUARD)
+	{
+		return snprintf(dest, FORMAT_MAX_WIDTH+1, "%.*f", precision, value);
+	}
+	
+	if (frac>0.5)
+	{
+		n++;
+	}
+	
+	len = 0;
+	
+	//printf keeps the sign of negative values that round to zero, and of -0.0
+	if (signbit(value))
+	{
+		dest[len++] = '-';
+	}
+	
+	intPart = n/(unsigned long long)formatPowersOfTen[precision];
+	fracPart = n-intPart*(unsigned long long)formatPowersOfTen[precision];
+	
+	digitNum = 0;
+	
+	do
+	{
+		digits[digitNum++] = (char)('0'+intPart%10);
+		intPart /= 10;
+	}while (intPart>0);
+	
+	while (digitNum>0)
+	{
+		dest[len++] = digits[--digitNum];
+	}
+	
+	if (precision>0)
+	{
+		dest[len++] = '.';
+		
+		for (i=precision-1;i>=0;i--)
+		{
+			dest[len+i] = (char)('0'+fracPart%10);
+			fracPart /= 10;
+		}
+		
+		len += precision;
+	}
+	
+	dest[len] = 0;
+	
+	return len;
+}
+
+//Format an integer in decimal. dest needs 12 chars. Return the number of chars written, not counting the terminating 0
+int FormatInt(char *dest, int value)
+{
+	char digits[12];
+	unsigned int u;
+	int len, digitNum;
+	
+	len = 0;
+	
+	if (value<0)
+	{
+		dest[len++] = '-';
+		u = 0u-(unsigned int)value;
+	}
+	else
+	{
+		u = (unsigned int)value;
+	}
+	
+	digitNum = 0;
+	
+	do
+	{
+		digits[digitNum++] = (char)('0'+u%10);
+		u /= 10;
+	}while (u>0);
+	
+	while (digitNum>0)
+	{
+		dest[len++] = digits[--digitNum];
+	}
+	
+	dest[len] = 0;
+	
+	return len;
+}
+
+//Initialize a text buffer of size chars. fh: file to flush into, or NULL. Return 1 if success, -1 if failure
+int InitTextBuffer(TEXT_BUFFER_STRUCT *buf, FILE *fh, size_t size)
+{
+	buf->text = (char *)malloc(size);
+	buf->len = 0;
+	buf->size = (buf->text==NULL)?0:size;
+	buf->fh = fh;
+	buf->isFailed = (buf->text==NULL);
+	
+	assert(buf->text!=NULL);
+	
+	return buf->isFailed?-1:1;
+}
+
+//Free a text buffer. Does not flush it
+void FreeTextBuffer(TEXT_BUFFER_STRUCT *buf)
+{
+	free(buf->text);
+	buf->text = NULL;
+	buf->len = 0;
+	buf->size = 0;
+}
+
+//Write the buffered text into the file of the buffer and empty the buffer. Return 1 if success, -1 if failure
+int FlushTextBuffer(TEXT_BUFFER_STRUCT *buf)
+{
+	if ((buf->fh!=NULL)&&(buf->len>0))
+	{
+		if (fwrite(buf->text, 1, buf->len, buf->fh)!=buf->len)
+		{
+			buf->isFailed = 1;
+		}
+		
+		buf->len = 0;
+	}
+	
+	return buf->isFailed?-1:1;
+}
+
+//Make room for need more chars, by flushing into the file or else by growing. Return 1 if success, -1 if failure
+int ReserveTextBuffer(TEXT_BUFFER_STRUCT *buf, size_t need)
+{
+	char *text;
+	size_t size;
+	
+	if (buf->len+need<=buf->size)
+	{
+		return 1;
+	}
+	
+	FlushTextBuffer(buf);
+	
+	if (buf->len+need<=buf->size)
+	{
+		return 1;
+	}
+	
+	size = 2*buf->size;
+	
+	if (size<buf->len+need)
+	{
+		size = buf->len+need;
+	}
+	
+	text = (char *)realloc(buf->text, size);
+	
+	if (text==NULL)
+	{
+		buf->isFailed = 1;
+		return -1;
+	}
+	
+	buf->text = text;
+	buf->size = size;
+	
+	return 1;
+}
+
+//Append len chars
+void AppendChars(TEXT_BUFFER_STRUCT *buf, char *s, size_t len)
+{
+	if (ReserveTextBuffer(buf, len)>0)
+	{
+		memcpy(buf->text+buf->len, s, len);
+		buf->len += len;
+	}
+}
+
+//Append a 0-terminated string
+void AppendString(TEXT_BUFFER_STRUCT *buf, char *s)
+{
+	AppendChars(buf, s, strlen(s));
+}
+
+//Append an integer in decimal
+void AppendInt(TEXT_BUFFER_STRUCT *buf, int value)
+{
+	if (ReserveTextBuffer(buf, 12)>0)
+	{
+		buf->len += FormatInt(buf->text+buf->len, value);
+	}
+}
+
+//Append a real value as printf("%.*f", precision, value) does
+void AppendFixed(TEXT_BUFFER_STRUCT *buf, double value, int precision)
+{
+	if (ReserveTextBuffer(buf, FORMAT_MAX_WIDTH+1)>0)
+	{
+		buf->len += FormatFixed(buf->text+buf->len, value, precision);
+	}
+}
@@ -0,0 +1,1276 @@
+/*
+ *  gs2a.c
+ *  GS2A scoring engine on a prepared context
+ *
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <assert.h>
+#include <pthread.h>
+#include "math_api.h"
+#include "ecdf.h"
+#include "format.h"
+#include "gs2a.h"
+
+//Shared state of the GS2AScoreBatch and GS2APermute workers. Blocks of GS2A_BLOCK_NUM profiles or permutations are taken in turn
+typedef struct
+{
+	GS2A_CONTEXT_STRUCT *context;
+	int blockNum;
+	int nextBlock;
+	int isFailed;
+	char *error;					//the reason of the failure of a worker
+	pthread_mutex_t lock;
+	int *isTarget;					//GS2AScoreBatch: the targets, the candidates of each profile, and the scores
+	int *candidates;
+	int *memberStart;
+	int *members;
+	CANDIDATE_SCORE_STRUCT *scores;
+	long seed;						//GS2APermute: the permutations and their correlations
+	int first;
+	int permutationNum;
+	double *permutedCorr;
+}SCORE_ENGINE_STRUCT;
+
+//GS2A score, the mean shift of the targets in units of the standard deviation of the others, times sqrt(targets)
+double MeanShiftStatistic(GS2A_MOMENTS_STRUCT *moments);
+
+//Chi-square variance ratio, the mean squared deviation of the targets from the others in units of their variance, minus 0.5
+double ChiSquareStatistic(GS2A_MOMENTS_STRUCT *moments);
+
+//Scores of a correlation vector by every statistic of the context, into score[s]
+void ComputeStatistics(GS2A_CONTEXT_STRUCT *context, double *score, double *corr, int *isTarget, int maskedGene);
+
+//Correlations of featureNum features with all genes, corr[f*geneNum+g], by the correlation measure of the context.
+//Return 1 if success, -1 if failure
+int CorrelateFeatures(GS2A_CONTEXT_STRUCT *context, double *corr, double *features, int featureNum);
+
+//Correlations of featureNum bit-packed 0/1 features with all genes, corr[f*geneNum+g]. Return 1 if success, -1 if failure
+int CorrelatePackedFeatures(GS2A_CONTEXT_STRUCT *context, double *corr, unsigned long long *features, int featureNum);
+
+//Pearson correlations of the sparse features first..first+featureNum-1 with all genes, corr[f*geneNum+g]. Return 1 if success, -1 if failure
+int CorrelateSparseFeatures(GS2A_CONTEXT_STRUCT *context, double *corr, SPARSE_ROWS_STRUCT *features, int first, int featureNum);
+
+//Ordinal correlations, or eta-squared for eta, of featureNum categorical features with all genes, corr[f*geneNum+g].
+//Return 1 if success, -1 if failure
+int CorrelateCategoryFeatures(GS2A_CONTEXT_STRUCT *context, double *corr, unsigned char *codes, double *levels, int featureNum);
+
+//Pearson correlations of featureNum quantized features, as 16 bit codes with their sums and norms, with all genes of the quantized expression rows
+void CorrelateQuantFeatures(GS2A_CONTEXT_STRUCT *context, double *corr, short *features, double *sums, double *norms, int featureNum);
+
+//Correlations of the unique candidate rows first..first+featureNum-1 with all genes, in whichever form the candidates are kept.
+//quantBuffer holds GS2A_BLOCK_NUM rows of 16 bit codes. Return 1 if success, -1 if failure
+int CorrelateProfiles(GS2A_CONTEXT_STRUCT *context, double *corr, int first, int featureNum, short *quantBuffer);
+
+//Number of worker threads for blockNum blocks. Kendall tau runs its own threads per block
+int EngineThreadNum(GS2A_CONTEXT_STRUCT *context, int blockNum);
+
+//Run worker on threadNum threads, the calling thread included. Return 1 if no worker failed, -1 otherwise, with the reason in the error of the context
+int RunScoreEngine(SCORE_ENGINE_STRUCT *engine, int threadNum, void *(*worker)(void *));
+
+//Mark the engine as failed by a worker, for a reason
+void FailScoreEngine(SCORE_ENGINE_STRUCT *engine, char *error);
+
+//Worker thread of GS2AScoreBatch. Correlates blocks of profiles and scores their candidates
+void *ScoreBatchWorker(void *arg);
+
+//Worker thread of GS2APermute. Draws, permutes and correlates blocks of permutations
+void *PermuteWorker(void *arg);
+
+//registry of the statistics, by their enum
+GS2A_STATISTIC_STRUCT gs2aStatistics[GS2A_STATISTIC_NUM] = {{"mean", MeanShiftStatistic}, {"chisq", ChiSquareStatistic}};
+
+//Return the correlation measure of a name (pearson, spearman, bicor, kendall, mi or eta), -1 if none
+int ParseCorrelationMethod(char *name)
+{
+	if (strcmp(name, "pearson")==0)
+	{
+		return CORRELATION_PEARSON;
+	}
+	else if (strcmp(name, "spearman")==0)
+	{
+		return CORRELATION_SPEARMAN;
+	}
+	else if (strcmp(name, "bicor")==0)
+	{
+		return CORRELATION_BICOR;
+	}
+	else if (strcmp(name, "kendall")==0)
+	{
+		return CORRELATION_KENDALL;
+	}
+	else if (strcmp(name, "mi")==0)
+	{
+		return CORRELATION_MI;
+	}
+	else if (strcmp(name, "eta")==0)
+	{
+		return CORRELATION_ETA;
+	}
+
+	return -1;
+}
+
+//Return the name of a correlation measure
+char *CorrelationMethodName(int correlationMethod)
+{
+	switch (correlationMethod)
+	{
+		case CORRELATION_PEARSON:
+			return "pearson";
+		case CORRELATION_SPEARMAN:
+			return "spearman";
+		case CORRELATION_BICOR:
+			return "bicor";
+		case CORRELATION_KENDALL:
+			return "kendall";
+		case CORRELATION_MI:
+			return "mi";
+		case CORRELATION_ETA:
+			return "eta";
+	}
+
+	return "unknown";
+}
+
+//Parse a comma separated list of statistic names into statistics. Return the number of statistics, -1 if a name is unknown or repeated
+int ParseStatistics(char *names, int *statistics)
+{
+	int isUsed[GS2A_STATISTIC_NUM];
+	int statisticNum, len, s;
+	char *c;
+
+	memset(isUsed, 0, sizeof(isUsed));
+	statisticNum = 0;
+
+	for (c=names;*c!=0;c+=(c[len]==',')?len+1:len)
+	{
+		len = (int)strcspn(c, ",");
+
+		for (s=0;s<GS2A_STATISTIC_NUM;s++)
+		{
+			if ((strncmp(c, gs2aStatistics[s].name, len)==0)&&(gs2aStatistics[s].name[len]==0))
+			{
+				break;
+			}
+		}
+
+		if ((s>=GS2A_STATISTIC_NUM)||isUsed[s])
+		{
+			return -1;
+		}
+
+		isUsed[s] = 1;
+		statistics[statisticNum++] = s;
+	}
+
+	return (statisticNum>0)?statisticNum:-1;
+}
+
+//Start an empty context
+void InitGS2AContext(GS2A_CONTEXT_STRUCT *context, int correlationMethod, int threadNum, int quantBits)
+{
+	memset(context, 0, sizeof(GS2A_CONTEXT_STRUCT));
+
+	context->correlationMethod = correlationMethod;
+	context->threadNum = (threadNum>0)?threadNum:1;
+	context->quantBits = quantBits;
+	context->statistics[0] = GS2A_STAT_MEAN;
+	context->statisticNum = 1;
+	context->error = "";
+}
+
+//Prepare the data filled in a context: keep the IDs of the candidates, remove repeated candidate rows, and transform
+//the rows so that every correlation is a dot product or a prepared kernel. Return 1 if success, -1 if failure, with the reason in error
+int PrepareGS2AContext(GS2A_CONTEXT_STRUCT *context)
+{
+	DATA_MATRIX_STRUCT *expressions = &(context->expressions);
+	DATA_MATRIX_STRUCT *candidates = &(context->candidates);
+	ID_INDEX_STRUCT geneIndex;
+	int i, profileNum;
+
+	context->candidateNum = candidates->recordNum;
+	context->candidateInfo = (ID_INFO_STRUCT *)malloc((context->candidateNum+1)*sizeof(ID_INFO_STRUCT));
+	context->candidateProfiles = (int *)malloc((context->candidateNum+1)*sizeof(int));
+	context->candidateGenes = (int *)malloc((context->candidateNum+1)*sizeof(int));
+
+	assert((context->candidateInfo!=NULL)&&(context->candidateProfiles!=NULL)&&(context->candidateGenes!=NULL));
+
+	if ((context->candidateInfo==NULL)||(context->candidateProfiles==NULL)||(context->candidateGenes==NULL)
+		||(BuildIDIndex(&geneIndex, expressions->recordInfo, expressions->recordNum)<=0))
+	{
+		context->error = "cannot allocate memory for candidate profiles";
+		return -1;
+	}
+
+	//the gene of a candidate is looked up once, and left out of its score by position
+	memcpy(context->candidateInfo, candidates->recordInfo, context->candidateNum*sizeof(ID_INFO_STRUCT));
+
+	for (i=0;i<context->candidateNum;i++)
+	{
+		context->candidateGenes[i] = FindID(&geneIndex, candidates->recordInfo[i].name);
+	}
+
+	FreeIDIndex(&geneIndex);
+
+	//identical candidate rows, such as the genes of one copy-number segment, are kept once
+	if (candidates->matrix!=NULL)
+	{
+		profileNum = UniqueDataMatrixRows(candidates, context->candidateProfiles);
+	}
+	else
+	{
+		for (i=0;i<context->candidateNum;i++)
+		{
+			context->candidateProfiles[i] = i;
+		}
+
+		profileNum = context->candidateNum;
+	}
+
+	if (profileNum<0)
+	{
+		context->error = "cannot allocate memory for candidate profiles";
+		return -1;
+	}
+
+	//with controls, every row is replaced by its residual, so that the Pearson correlations below are partial correlations
+	if (context->controlNum>0)
+	{
+		if ((context->correlationMethod!=CORRELATION_PEARSON)||(expressions->matrix==NULL)||(candidates->matrix==NULL)||(context->quantBits>0))
+		{
+			context->error = "controls need pearson correlation of dense data";
+			return -1;
+		}
+
+		if (BuildControlBasis(&(context->controlBasis), context->controls, context->controlNum, expressions->sampleNum)<=0)
+		{
+			context->error = "cannot set up the controls";
+			return -1;
+		}
+
+		ProjectOutControls(&(context->controlBasis), expressions->matrix, expressions->recordNum);
+		ProjectOutControls(&(context->controlBasis), candidates->matrix, candidates->recordNum);
+	}
+
+	//Every row is transformed once here, so that every correlation is a dot product. Spearman correlation is the
+	//Pearson correlation of ranks, and bicor the dot product of the unit-norm biweight forms. Kendall tau ranks the
+	//expression rows once and keeps the candidate rows raw. Mutual information bins every row once
+	if (context->correlationMethod==CORRELATION_KENDALL)
+	{
+		if (PrepareKendallRows(&(context->kendallRows), expressions->matrix, expressions->recordNum, expressions->sampleNum)<=0)
+		{
+			context->error = "cannot allocate memory for Kendall tau";
+			return -1;
+		}
+	}
+	else if (context->correlationMethod==CORRELATION_MI)
+	{
+		if ((PrepareMutualInfoRows(&(context->mutualInfoRows), expressions->matrix, expressions->recordNum, expressions->sampleNum,
+								   MutualInfoBinNum(expressions->sampleNum))<=0)
+			||(DiscretizeMatrixRows(candidates->matrix, candidates->recordNum, candidates->sampleNum, MutualInfoBinNum(expressions->sampleNum))<=0))
+		{
+			context->error = "cannot allocate memory for mutual information";
+			return -1;
+		}
+	}
+	else if (context->correlationMethod==CORRELATION_BICOR)
+	{
+		BiweightMatrixRows(expressions->matrix, expressions->recordNum, expressions->sampleNum);
+		BiweightMatrixRows(candidates->matrix, candidates->recordNum, candidates->sampleNum);
+	}
+	else
+	{
+		//0/1 candidates, such as mutation calls, are kept bit-packed only. Ranking a 0/1 row is an affine map,
+		//so their Spearman correlation is the point-biserial correlation with the ranked rows
+		if ((context->sparseCandidates.rowStart==NULL)&&(context->sparseExpressions.rowStart==NULL)&&(context->correlationMethod!=CORRELATION_ETA)
+			&&(context->quantBits==0)&&(context->controlBasis.q==NULL)&&IsBinaryMatrixRows(candidates->matrix, candidates->recordNum, candidates->sampleNum))
+		{
+			if (PackBinaryRows(&(context->binaryCandidates), candidates->matrix, candidates->recordNum, candidates->sampleNum)<=0)
+			{
+				context->error = "cannot allocate memory for binary candidates";
+				return -1;
+			}
+
+			free(candidates->matrix);
+			candidates->matrix = NULL;
+		}
+
+		if (context->correlationMethod==CORRELATION_SPEARMAN)
+		{
+			RankMatrixRows(expressions->matrix, expressions->recordNum, expressions->sampleNum);
+		}
+
+		//sparse expression rows stay unstandardized: their means drop out against standardized candidates, and their norms
+		//are computed from the nonzeros once
+		if (context->sparseExpressions.rowStart!=NULL)
+		{
+			context->expressionNorms = (double *)malloc((expressions->recordNum+1)*sizeof(double));
+
+			assert(context->expressionNorms!=NULL);
+
+			if (context->expressionNorms==NULL)
+			{
+				context->error = "cannot allocate memory for sparse expression";
+				return -1;
+			}
+
+			SparseRowNorms(context->expressionNorms, context->sparseExpressions.rowStart, context->sparseExpressions.values,
+						   expressions->recordNum, expressions->sampleNum);
+		}
+		else
+		{
+			StandardizeMatrixRows(expressions->matrix, expressions->recordNum, expressions->sampleNum);
+		}
+
+		if (candidates->matrix!=NULL)
+		{
+			if (context->correlationMethod==CORRELATION_SPEARMAN)
+			{
+				RankMatrixRows(candidates->matrix, candidates->recordNum, candidates->sampleNum);
+			}
+
+			//quantized candidates are correlated with the expression rows quantized to 16 bits, and neither keeps its doubles
+			if (context->quantBits>0)
+			{
+				if ((QuantizeMatrixRows(&(context->quantCandidates), candidates->matrix, candidates->recordNum, candidates->sampleNum, context->quantBits)<=0)
+					||(QuantizeMatrixRows(&(context->quantExpressions), expressions->matrix, expressions->recordNum, expressions->sampleNum, 16)<=0))
+				{
+					context->error = "cannot allocate memory for quantized rows";
+					return -1;
+				}
+
+				free(candidates->matrix);
+				candidates->matrix = NULL;
+				free(expressions->matrix);
+				expressions->matrix = NULL;
+			}
+			//candidates of few distinct values, such as copy-number states or subtype labels, are kept as uint8 codes only.
+			//Ranks keep the number of distinct values, so Spearman correlation uses the ranks as levels
+			else if ((context->sparseExpressions.rowStart==NULL)&&(context->controlBasis.q==NULL)&&IsCategoricalMatrixRows(candidates->matrix, candidates->recordNum, candidates->sampleNum))
+			{
+				if (PackCategoryRows(&(context->categoryCandidates), candidates->matrix, candidates->recordNum, candidates->sampleNum)<=0)
+				{
+					context->error = "cannot allocate memory for categorical candidates";
+					return -1;
+				}
+
+				free(candidates->matrix);
+				candidates->matrix = NULL;
+			}
+			else if (context->correlationMethod==CORRELATION_ETA)
+			{
+				context->error = "eta needs candidates of few distinct values per row";
+				return -1;
+			}
+			else
+			{
+				StandardizeMatrixRows(candidates->matrix, candidates->recordNum, candidates->sampleNum);
+			}
+		}
+	}
+
+	return 1;
+}
+
+//Free all data of a context
+void FreeGS2AContext(GS2A_CONTEXT_STRUCT *context)
+{
+	FreeDataMatrix(&(context->expressions));
+	FreeDataMatrix(&(context->candidates));
+	FreeSparseRows(&(context->sparseExpressions));
+	FreeSparseRows(&(context->sparseCandidates));
+	free(context->candidateInfo);
+	free(context->candidateProfiles);
+	free(context->candidateGenes);
+	free(context->expressionNorms);
+	free(context->controls);
+
+	if (context->controlBasis.q!=NULL)
+	{
+		FreeControlBasis(&(context->controlBasis));
+	}
+
+	if (context->kendallRows.ranks!=NULL)
+	{
+		FreeKendallRows(&(context->kendallRows));
+	}
+
+	if (context->mutualInfoRows.codes!=NULL)
+	{
+		FreeMutualInfoRows(&(context->mutualInfoRows));
+	}
+
+	FreeBinaryRows(&(context->binaryCandidates));
+	FreeCategoryRows(&(context->categoryCandidates));
+	FreeQuantRows(&(context->quantCandidates));
+	FreeQuantRows(&(context->quantExpressions));
+
+	memset(context, 0, sizeof(GS2A_CONTEXT_STRUCT));
+	context->error = "";
+}
+
+//Moments of the correlations of a feature with the geneNum genes, the targets against the others. Gene maskedGene is left out,
+//if not -1. Return 1 if success, -1 if there are no targets, no other genes, or no spread among the others
+int ComputeGS2AMoments(GS2A_MOMENTS_STRUCT *moments, double *corr, int geneNum, int *isTarget, int maskedGene)
+{
+	int i;
+	double targetMean, nonTargetMean, nonTargetStdev, targetDeviation;
+
+	moments->targetNum = 0;
+	moments->nonTargetNum = 0;
+	targetMean = 0;
+	nonTargetMean = 0;
+
+	for (i=0;i<geneNum;i++)
+	{
+		if (i==maskedGene)
+		{
+			continue;
+		}
+
+		if (isTarget[i])
+		{
+			targetMean += corr[i];
+			moments->targetNum++;
+		}
+		else
+		{
+			nonTargetMean += corr[i];
+			moments->nonTargetNum++;
+		}
+	}
+
+	if (!((moments->targetNum>0)&&(moments->nonTargetNum>0)))
+	{
+		return -1;
+	}
+
+	targetMean /= moments->targetNum;
+	nonTargetMean /= moments->nonTargetNum;
+
+	//the deviations of the targets and of the others from the mean of the others, in one more pass
+	nonTargetStdev = 0;
+	targetDeviation = 0;
+
+	for (i=0;i<geneNum;i++)
+	{
+		if (i==maskedGene)
+		{
+			continue;
+		}
+
+		if (isTarget[i])
+		{
+			targetDeviation += (corr[i]-nonTargetMean)*(corr[i]-nonTargetMean);
+		}
+		else
+		{
+			nonTargetStdev += (corr[i]-nonTargetMean)*(corr[i]-nonTargetMean);
+		}
+	}
+
+	moments->targetMean = targetMean;
+	moments->targetDeviation = targetDeviation;
+	moments->nonTargetMean = nonTargetMean;
+	moments->nonTargetStdev = sqrt(nonTargetStdev/moments->nonTargetNum);
+
+	//no spread, such as a candidate that is all controls
+	if (moments->nonTargetStdev<0.000001)
+	{
+		return -1;
+	}
+
+	return 1;
+}
+
+//GS2A score, the mean shift of the targets in units of the standard deviation of the others, times sqrt(targets)
+double MeanShiftStatistic(GS2A_MOMENTS_STRUCT *moments)
+{
+	return (moments->targetMean-moments->nonTargetMean)/moments->nonTargetStdev*sqrt(moments->targetNum);
+}
+
+//Chi-square variance ratio, the mean squared deviation of the targets from the others in units of their variance, minus 0.5.
+//0 with a single target, which has no degrees of freedom
+double ChiSquareStatistic(GS2A_MOMENTS_STRUCT *moments)
+{
+	if (moments->targetNum<2)
+	{
+		return 0;
+	}
+	
+	return moments->targetDeviation/(moments->nonTargetStdev*moments->nonTargetStdev)/(moments->targetNum-1)-0.5;
+}
+
+//GS2A score from the correlations of a feature with the geneNum genes: the mean correlation of the targets above the others,
+//in units of the standard deviation of the others, times sqrt(targets). Gene maskedGene is left out, if not -1
+double ComputeGS2AScore(double *corr, int geneNum, int *isTarget, int maskedGene)
+{
+	GS2A_MOMENTS_STRUCT moments;
+
+	assert(geneNum>1);
+
+	if (!(geneNum>1))
+	{
+		return 1;
+	}
+
+	if (ComputeGS2AMoments(&moments, corr, geneNum, isTarget, maskedGene)<=0)
+	{
+		return 0;
+	}
+
+	return MeanShiftStatistic(&moments);
+}
+
+//Scores of a correlation vector by every statistic of the context, into score[s]
+void ComputeStatistics(GS2A_CONTEXT_STRUCT *context, double *score, double *corr, int *isTarget, int maskedGene)
+{
+	GS2A_MOMENTS_STRUCT moments;
+	int s;
+
+	//the moments are shared, so further statistics cost no pass over the genes
+	if (ComputeGS2AMoments(&moments, corr, context->expressions.recordNum, isTarget, maskedGene)<=0)
+	{
+		for (s=0;s<context->statisticNum;s++)
+		{
+			score[s] = 0;
+		}
+
+		return;
+	}
+
+	for (s=0;s<context->statisticNum;s++)
+	{
+		score[s] = gs2aStatistics[context->statistics[s]].compute(&moments);
+	}
+}
+
+//Correlations of featureNum features with all genes, corr[f*geneNum+g], by the correlation measure of the context.
+//Return 1 if success, -1 if failure
+int CorrelateFeatures(GS2A_CONTEXT_STRUCT *context, double *corr, double *features, int featureNum)
+{
+	DATA_MATRIX_STRUCT *expressions = &(context->expressions);
+
+	if (context->correlationMethod==CORRELATION_KENDALL)
+	{
+		//Kendall tau is computed on the raw rows, everything else on the transformed and standardized rows
+		return KendallBlock(corr, features, featureNum, &(context->kendallRows), context->threadNum);
+	}
+	else if (context->correlationMethod==CORRELATION_MI)
+	{
+		//candidate rows hold bin codes, and a permutation of codes is the code of the permutation
+		return MutualInfoBlock(corr, features, featureNum, &(context->mutualInfoRows));
+	}
+	else if (context->sparseExpressions.rowStart!=NULL)
+	{
+		return SparseRowsCorrelateBlock(corr, features, featureNum, context->sparseExpressions.rowStart, context->sparseExpressions.columns,
+										context->sparseExpressions.values, context->expressionNorms, expressions->recordNum, expressions->sampleNum);
+	}
+
+	CorrelateBlock(corr, features, featureNum, expressions->matrix, expressions->recordNum, expressions->sampleNum);
+
+	return 1;
+}
+
+//Correlations of featureNum bit-packed 0/1 features with all genes, corr[f*geneNum+g]. Return 1 if success, -1 if failure
+int CorrelatePackedFeatures(GS2A_CONTEXT_STRUCT *context, double *corr, unsigned long long *features, int featureNum)
+{
+	DATA_MATRIX_STRUCT *expressions = &(context->expressions);
+
+	return PointBiserialBlock(corr, features, featureNum, context->binaryCandidates.wordNum, expressions->matrix, expressions->recordNum, expressions->sampleNum);
+}
+
+//Pearson correlations of the sparse features first..first+featureNum-1 with all genes, corr[f*geneNum+g]. Return 1 if success, -1 if failure
+int CorrelateSparseFeatures(GS2A_CONTEXT_STRUCT *context, double *corr, SPARSE_ROWS_STRUCT *features, int first, int featureNum)
+{
+	DATA_MATRIX_STRUCT *expressions = &(context->expressions);
+	int sampleNum = expressions->sampleNum;
+	double *dense;
+	int f, k, result;
+
+	//with sparse expression as well, the smaller side, the block of candidates, is made dense and standardized
+	if (context->sparseExpressions.rowStart!=NULL)
+	{
+		dense = (double *)calloc((size_t)featureNum*sampleNum+1, sizeof(double));
+
+		assert(dense!=NULL);
+
+		if (dense==NULL)
+		{
+			return -1;
+		}
+
+		for (f=0;f<featureNum;f++)
+		{
+			for (k=features->rowStart[first+f];k<features->rowStart[first+f+1];k++)
+			{
+				dense[(size_t)f*sampleNum+features->columns[k]] = features->values[k];
+			}
+		}
+
+		StandardizeMatrixRows(dense, featureNum, sampleNum);
+		result = CorrelateFeatures(context, corr, dense, featureNum);
+
+		free(dense);
+
+		return result;
+	}
+
+	return SparseCorrelateBlock(corr, features->rowStart+first, features->columns, features->values, featureNum,
+								expressions->matrix, expressions->recordNum, sampleNum);
+}
+
+//Ordinal correlations, or eta-squared for eta, of featureNum categorical features with all genes, corr[f*geneNum+g].
+//Return 1 if success, -1 if failure
+int CorrelateCategoryFeatures(GS2A_CONTEXT_STRUCT *context, double *corr, unsigned char *codes, double *levels, int featureNum)
+{
+	DATA_MATRIX_STRUCT *expressions = &(context->expressions);
+	int sampleNum = expressions->sampleNum;
+	double *features;
+	int k;
+
+	if (context->correlationMethod==CORRELATION_ETA)
+	{
+		return CategoryCorrelateBlock(corr, codes, levels, featureNum, 1, expressions->matrix, expressions->recordNum, sampleNum);
+	}
+
+	//the ordinal correlation is a Pearson correlation of the levels, and the vectorized dot products of CorrelateBlock
+	//beat the gathers of the per-category sums, so the block is decoded and standardized
+	features = (double *)malloc((size_t)featureNum*sampleNum*sizeof(double));
+
+	assert(features!=NULL);
+
+	if (features==NULL)
+	{
+		return -1;
+	}
+
+	for (k=0;k<featureNum;k++)
+	{
+		DecodeCategoryRow(features+(size_t)k*sampleNum, codes+(size_t)k*sampleNum, levels+(size_t)k*CATEGORY_MAX_NUM, sampleNum);
+	}
+
+	StandardizeMatrixRows(features, featureNum, sampleNum);
+	CorrelateBlock(corr, features, featureNum, expressions->matrix, expressions->recordNum, sampleNum);
+
+	free(features);
+
+	return 1;
+}
+
+//Pearson correlations of featureNum quantized features, as 16 bit codes with their sums and norms, with all genes of the quantized expression rows
+void CorrelateQuantFeatures(GS2A_CONTEXT_STRUCT *context, double *corr, short *features, double *sums, double *norms, int featureNum)
+{
+	QuantCorrelateBlock(corr, features, sums, norms, featureNum, context->quantExpressions.codes16, context->quantExpressions.sums,
+						context->quantExpressions.norms, context->quantExpressions.rowNum, context->quantExpressions.dim);
+}
+
+//Correlations of the unique candidate rows first..first+featureNum-1 with all genes, in whichever form the candidates are kept.
+//quantBuffer holds GS2A_BLOCK_NUM rows of 16 bit codes. Return 1 if success, -1 if failure
+int CorrelateProfiles(GS2A_CONTEXT_STRUCT *context, double *corr, int first, int featureNum, short *quantBuffer)
+{
+	int sampleNum = context->candidates.sampleNum;
+
+	if (context->binaryCandidates.bits!=NULL)
+	{
+		return CorrelatePackedFeatures(context, corr, context->binaryCandidates.bits+(size_t)first*context->binaryCandidates.wordNum, featureNum);
+	}
+	else if (context->categoryCandidates.codes!=NULL)
+	{
+		return CorrelateCategoryFeatures(context, corr, context->categoryCandidates.codes+(size_t)first*sampleNum,
+										 context->categoryCandidates.levels+(size_t)first*CATEGORY_MAX_NUM, featureNum);
+	}
+	else if (context->quantCandidates.sums!=NULL)
+	{
+		CorrelateQuantFeatures(context, corr, QuantRowsAsInt16(&(context->quantCandidates), first, featureNum, quantBuffer),
+							   context->quantCandidates.sums+first, context->quantCandidates.norms+first, featureNum);
+		return 1;
+	}
+	else if (context->sparseCandidates.rowStart!=NULL)
+	{
+		return CorrelateSparseFeatures(context, corr, &(context->sparseCandidates), first, featureNum);
+	}
+	else
+	{
+		return CorrelateFeatures(context, corr, context->candidates.matrix+(size_t)first*sampleNum, featureNum);
+	}
+}
+
+//Number of worker threads for blockNum blocks. Kendall tau runs its own threads per block
+int EngineThreadNum(GS2A_CONTEXT_STRUCT *context, int blockNum)
+{
+	int threadNum = (context->correlationMethod==CORRELATION_KENDALL)?1:context->threadNum;
+
+	return (threadNum<blockNum)?threadNum:((blockNum>0)?blockNum:1);
+}
+
+//Run worker on threadNum threads, the calling thread included. Return 1 if no worker failed, -1 otherwise
+int RunScoreEngine(SCORE_ENGINE_STRUCT *engine, int threadNum, void *(*worker)(void *))
+{
+	pthread_t *threads;
+	int i;
+
+	threads = (pthread_t *)malloc(threadNum*sizeof(pthread_t));
+
+	assert(threads!=NULL);
+
+	if (threads==NULL)
+	{
+		engine->context->error = "cannot allocate memory for the threads";
+		return -1;
+	}
+
+	engine->nextBlock = 0;
+	engine->isFailed = 0;
+	engine->error = NULL;
+	pthread_mutex_init(&(engine->lock), NULL);
+
+	for (i=1;i<threadNum;i++)
+	{
+		pthread_create(threads+i, NULL, worker, engine);
+	}
+
+	worker(engine);
+
+	for (i=1;i<threadNum;i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	pthread_mutex_destroy(&(engine->lock));
+	free(threads);
+
+	if (engine->isFailed)
+	{
+		engine->context->error = engine->error;
+		return -1;
+	}
+
+	return 1;
+}
+
+//Mark the engine as failed by a worker, for a reason
+void FailScoreEngine(SCORE_ENGINE_STRUCT *engine, char *error)
+{
+	pthread_mutex_lock(&(engine->lock));
+	engine->isFailed = 1;
+	engine->error = error;
+	pthread_mutex_unlock(&(engine->lock));
+}
+
+//Worker thread of GS2AScoreBatch. Correlates blocks of profiles and scores their candidates
+void *ScoreBatchWorker(void *arg)
+{
+	SCORE_ENGINE_STRUCT *engine = (SCORE_ENGINE_STRUCT *)arg;
+	GS2A_CONTEXT_STRUCT *context = engine->context;
+	int geneNum = context->expressions.recordNum;
+	int profileNum = context->candidates.recordNum;
+	double *corr;
+	short *quantBuffer;
+	int block, first, featureNum, k, j, m, s, candidate;
+
+	corr = (double *)malloc((size_t)GS2A_BLOCK_NUM*geneNum*sizeof(double));
+	quantBuffer = (short *)malloc((size_t)GS2A_BLOCK_NUM*context->candidates.sampleNum*sizeof(short));
+
+	assert((corr!=NULL)&&(quantBuffer!=NULL));
+
+	if ((corr==NULL)||(quantBuffer==NULL))
+	{
+		free(corr);
+		free(quantBuffer);
+		FailScoreEngine(engine, "cannot allocate memory for the scores");
+		return NULL;
+	}
+
+	while (1)
+	{
+		pthread_mutex_lock(&(engine->lock));
+		block = engine->nextBlock++;
+		pthread_mutex_unlock(&(engine->lock));
+
+		if (block>=engine->blockNum)
+		{
+			break;
+		}
+
+		first = block*GS2A_BLOCK_NUM;
+		featureNum = (first+GS2A_BLOCK_NUM<=profileNum)?GS2A_BLOCK_NUM:profileNum-first;
+
+		//blocks of rows of no asked candidate are skipped
+		if (engine->memberStart[first]==engine->memberStart[first+featureNum])
+		{
+			continue;
+		}
+
+		if (CorrelateProfiles(context, corr, first, featureNum, quantBuffer)<=0)
+		{
+			FailScoreEngine(engine, "cannot allocate memory for the correlations");
+			break;
+		}
+
+		for (k=0;k<featureNum;k++)
+		{
+			for (j=engine->memberStart[first+k];j<engine->memberStart[first+k+1];j++)
+			{
+				m = engine->members[j];
+				candidate = (engine->candidates!=NULL)?engine->candidates[m]:m;
+
+				ComputeStatistics(context, engine->scores[m].score, corr+(size_t)k*geneNum, engine->isTarget, context->candidateGenes[candidate]);
+				engine->scores[m].id = context->candidateInfo+candidate;
+				engine->scores[m].isSignature = (context->candidateGenes[candidate]>=0)?engine->isTarget[context->candidateGenes[candidate]]:0;
+
+				for (s=0;s<context->statisticNum;s++)
+				{
+					engine->scores[m].pValue[s] = 1;
+				}
+			}
+		}
+	}
+
+	free(corr);
+	free(quantBuffer);
+
+	return NULL;
+}
+
+//Score candidates[0..candidateNum-1], positions among the candidates of the context, or all candidates if candidates is NULL,
+//against the genes with isTarget set. The pValue of the scores is set to 1. Return 1 if success, -1 if failure
+int GS2AScoreBatch(GS2A_CONTEXT_STRUCT *context, int *isTarget, int *candidates, int candidateNum, CANDIDATE_SCORE_STRUCT *scores)
+{
+	SCORE_ENGINE_STRUCT engine;
+	int profileNum = context->candidates.recordNum;
+	int i, m, result;
+
+	engine.memberStart = (int *)calloc(profileNum+1, sizeof(int));
+	engine.members = (int *)malloc((candidateNum+1)*sizeof(int));
+
+	assert((engine.memberStart!=NULL)&&(engine.members!=NULL));
+
+	if ((engine.memberStart==NULL)||(engine.members==NULL))
+	{
+		free(engine.memberStart);
+		free(engine.members);
+		context->error = "cannot allocate memory for the scores";
+		return -1;
+	}
+
+	//asked candidates of each unique row, in their order, by a counting sort. Each row is correlated once
+	for (m=0;m<candidateNum;m++)
+	{
+		engine.memberStart[context->candidateProfiles[(candidates!=NULL)?candidates[m]:m]+1]++;
+	}
+
+	for (i=0;i<profileNum;i++)
+	{
+		engine.memberStart[i+1] += engine.memberStart[i];
+	}
+
+	for (m=0;m<candidateNum;m++)
+	{
+		engine.members[engine.memberStart[context->candidateProfiles[(candidates!=NULL)?candidates[m]:m]]++] = m;
+	}
+
+	for (i=profileNum;i>0;i--)
+	{
+		engine.memberStart[i] = engine.memberStart[i-1];
+	}
+
+	engine.memberStart[0] = 0;
+
+	engine.context = context;
+	engine.blockNum = (profileNum+GS2A_BLOCK_NUM-1)/GS2A_BLOCK_NUM;
+	engine.isTarget = isTarget;
+	engine.candidates = candidates;
+	engine.scores = scores;
+
+	result = RunScoreEngine(&engine, EngineThreadNum(context, engine.blockNum), ScoreBatchWorker);
+
+	free(engine.memberStart);
+	free(engine.members);
+
+	return result;
+}
+
+//Worker thread of GS2APermute. Draws, permutes and correlates blocks of permutations
+void *PermuteWorker(void *arg)
+{
+	SCORE_ENGINE_STRUCT *engine = (SCORE_ENGINE_STRUCT *)arg;
+	GS2A_CONTEXT_STRUCT *context = engine->context;
+	int sampleNum = context->candidates.sampleNum;
+	int geneNum = context->expressions.recordNum;
+	int candidateNum = context->candidateNum;
+	int wordNum = context->binaryCandidates.wordNum;
+	RNG_STREAM_STRUCT rng;
+	double *tmpFeature;
+	unsigned long long *tmpBits;
+	SPARSE_ROWS_STRUCT tmpSparse;
+	unsigned char *tmpCodes;
+	double *tmpLevels;
+	short *tmpQuantCodes, *codes;
+	double tmpQuantSums[GS2A_BLOCK_NUM], tmpQuantNorms[GS2A_BLOCK_NUM];
+	double *corr;
+	int block, first, featureNum, tmpIndex, k, j, result;
+
+	tmpFeature = (double *)malloc((size_t)GS2A_BLOCK_NUM*sampleNum*sizeof(double));
+	tmpBits = (unsigned long long *)malloc((size_t)GS2A_BLOCK_NUM*(wordNum+1)*sizeof(unsigned long long));
+	tmpSparse.rowStart = (int *)malloc((GS2A_BLOCK_NUM+1)*sizeof(int));
+	tmpSparse.columns = (int *)malloc((size_t)GS2A_BLOCK_NUM*sampleNum*sizeof(int));
+	tmpSparse.values = (double *)malloc((size_t)GS2A_BLOCK_NUM*sampleNum*sizeof(double));
+	tmpCodes = (unsigned char *)malloc((size_t)GS2A_BLOCK_NUM*sampleNum);
+	tmpLevels = (double *)malloc(GS2A_BLOCK_NUM*CATEGORY_MAX_NUM*sizeof(double));
+	tmpQuantCodes = (short *)malloc((size_t)GS2A_BLOCK_NUM*sampleNum*sizeof(short));
+
+	assert((tmpFeature!=NULL)&&(tmpBits!=NULL));
+	assert((tmpSparse.rowStart!=NULL)&&(tmpSparse.columns!=NULL)&&(tmpSparse.values!=NULL)&&(tmpCodes!=NULL)&&(tmpLevels!=NULL));
+	assert(tmpQuantCodes!=NULL);
+
+	if ((tmpFeature==NULL)||(tmpBits==NULL)||(tmpSparse.rowStart==NULL)||(tmpSparse.columns==NULL)||(tmpSparse.values==NULL)
+		||(tmpCodes==NULL)||(tmpLevels==NULL)||(tmpQuantCodes==NULL))
+	{
+		FailScoreEngine(engine, "cannot allocate memory for the permutations");
+		block = engine->blockNum;
+	}
+	else
+	{
+		block = 0;
+	}
+
+	//a permutation of a standardized row is still standardized
+	while (block<engine->blockNum)
+	{
+		pthread_mutex_lock(&(engine->lock));
+		block = engine->nextBlock++;
+		pthread_mutex_unlock(&(engine->lock));
+
+		if (block>=engine->blockNum)
+		{
+			break;
+		}
+
+		first = block*GS2A_BLOCK_NUM;
+		featureNum = (first+GS2A_BLOCK_NUM<=engine->permutationNum)?GS2A_BLOCK_NUM:engine->permutationNum-first;
+		tmpSparse.rowStart[0] = 0;
+
+		for (k=0;k<featureNum;k++)
+		{
+			//each permutation has its own stream, and draws among all candidates, as without the unique rows
+			InitRngStream(&rng, engine->seed, engine->first+first+k);
+			tmpIndex = context->candidateProfiles[(int)EquilikelyStream(&rng, candidateNum)];
+
+			//packed candidates are permuted unpacked
+			if (context->binaryCandidates.bits!=NULL)
+			{
+				UnpackBinaryRow(tmpFeature+(size_t)k*sampleNum, context->binaryCandidates.bits+(size_t)tmpIndex*wordNum, sampleNum);
+				PermuteFloatArraysStream(tmpFeature+(size_t)k*sampleNum, sampleNum, &rng);
+				PackBinaryRow(tmpBits+(size_t)k*wordNum, tmpFeature+(size_t)k*sampleNum, sampleNum);
+			}
+			else if (context->categoryCandidates.codes!=NULL)
+			{
+				DecodeCategoryRow(tmpFeature+(size_t)k*sampleNum, context->categoryCandidates.codes+(size_t)tmpIndex*sampleNum,
+								  context->categoryCandidates.levels+(size_t)tmpIndex*CATEGORY_MAX_NUM, sampleNum);
+				PermuteFloatArraysStream(tmpFeature+(size_t)k*sampleNum, sampleNum, &rng);
+				EncodeCategoryRow(tmpCodes+(size_t)k*sampleNum, tmpLevels+k*CATEGORY_MAX_NUM, tmpFeature+(size_t)k*sampleNum, sampleNum);
+			}
+			else if (context->quantCandidates.sums!=NULL)
+			{
+				//the codes of a quantized candidate are permuted as values, keeping their sum and norm
+				codes = QuantRowsAsInt16(&(context->quantCandidates), tmpIndex, 1, tmpQuantCodes+(size_t)k*sampleNum);
+
+				for (j=0;j<sampleNum;j++)
+				{
+					tmpFeature[(size_t)k*sampleNum+j] = codes[j];
+				}
+
+				PermuteFloatArraysStream(tmpFeature+(size_t)k*sampleNum, sampleNum, &rng);
+
+				for (j=0;j<sampleNum;j++)
+				{
+					tmpQuantCodes[(size_t)k*sampleNum+j] = (short)tmpFeature[(size_t)k*sampleNum+j];
+				}
+
+				tmpQuantSums[k] = context->quantCandidates.sums[tmpIndex];
+				tmpQuantNorms[k] = context->quantCandidates.norms[tmpIndex];
+			}
+			else if (context->sparseCandidates.rowStart!=NULL)
+			{
+				//sparse candidates are scattered, permuted and gathered again
+				memset(tmpFeature+(size_t)k*sampleNum, 0, sampleNum*sizeof(double));
+
+				for (j=context->sparseCandidates.rowStart[tmpIndex];j<context->sparseCandidates.rowStart[tmpIndex+1];j++)
+				{
+					tmpFeature[(size_t)k*sampleNum+context->sparseCandidates.columns[j]] = context->sparseCandidates.values[j];
+				}
+
+				PermuteFloatArraysStream(tmpFeature+(size_t)k*sampleNum, sampleNum, &rng);
+
+				tmpSparse.rowStart[k+1] = tmpSparse.rowStart[k];
+
+				for (j=0;j<sampleNum;j++)
+				{
+					if (tmpFeature[(size_t)k*sampleNum+j]!=0)
+					{
+						tmpSparse.columns[tmpSparse.rowStart[k+1]] = j;
+						tmpSparse.values[tmpSparse.rowStart[k+1]] = tmpFeature[(size_t)k*sampleNum+j];
+						tmpSparse.rowStart[k+1]++;
+					}
+				}
+			}
+			else
+			{
+				memcpy(tmpFeature+(size_t)k*sampleNum, context->candidates.matrix+(size_t)tmpIndex*sampleNum, sampleNum*sizeof(double));
+				PermuteFloatArraysStream(tmpFeature+(size_t)k*sampleNum, sampleNum, &rng);
+
+				//a permuted residual is no longer free of the controls
+				if (context->controlBasis.q!=NULL)
+				{
+					ProjectOutControls(&(context->controlBasis), tmpFeature+(size_t)k*sampleNum, 1);
+					StandardizeArray(tmpFeature+(size_t)k*sampleNum, tmpFeature+(size_t)k*sampleNum, sampleNum);
+				}
+			}
+		}
+
+		corr = engine->permutedCorr+(size_t)first*geneNum;
+
+		if (context->binaryCandidates.bits!=NULL)
+		{
+			result = CorrelatePackedFeatures(context, corr, tmpBits, featureNum);
+		}
+		else if (context->categoryCandidates.codes!=NULL)
+		{
+			result = CorrelateCategoryFeatures(context, corr, tmpCodes, tmpLevels, featureNum);
+		}
+		else if (context->quantCandidates.sums!=NULL)
+		{
+			CorrelateQuantFeatures(context, corr, tmpQuantCodes, tmpQuantSums, tmpQuantNorms, featureNum);
+			result = 1;
+		}
+		else if (context->sparseCandidates.rowStart!=NULL)
+		{
+			result = CorrelateSparseFeatures(context, corr, &tmpSparse, 0, featureNum);
+		}
+		else
+		{
+			result = CorrelateFeatures(context, corr, tmpFeature, featureNum);
+		}
+
+		if (result<=0)
+		{
+			FailScoreEngine(engine, "cannot allocate memory for the correlations");
+			break;
+		}
+	}
+
+	free(tmpFeature);
+	free(tmpBits);
+	FreeSparseRows(&tmpSparse);
+	free(tmpCodes);
+	free(tmpLevels);
+	free(tmpQuantCodes);
+
+	return NULL;
+}
+
+//Correlate the permutations first..first+permutationNum-1 with all genes, into permutedCorr[k*geneNum]. Permutation p draws a
+//candidate and permutes it from its own random stream (seed, p), so the result depends neither on the threads nor on how the
+//permutations are split into calls. The correlations do not depend on the targets. Return 1 if success, -1 if failure
+int GS2APermute(GS2A_CONTEXT_STRUCT *context, long seed, int first, int permutationNum, double *permutedCorr)
+{
+	SCORE_ENGINE_STRUCT engine;
+
+	assert(context->expressions.sampleNum==context->candidates.sampleNum);
+
+	if ((context->expressions.sampleNum!=context->candidates.sampleNum)||(context->candidateNum<=0))
+	{
+		context->error = "no candidates to permute";
+		return -1;
+	}
+
+	engine.context = context;
+	engine.blockNum = (permutationNum+GS2A_BLOCK_NUM-1)/GS2A_BLOCK_NUM;
+	engine.seed = seed;
+	engine.first = first;
+	engine.permutationNum = permutationNum;
+	engine.permutedCorr = permutedCorr;
+
+	return RunScoreEngine(&engine, EngineThreadNum(context, engine.blockNum), PermuteWorker);
+}
+
+//Absolute scores of permutationNum permuted correlation vectors against the genes with isTarget set, randScores[s*permutationNum+k]
+//for statistic s of the context
+void GS2ANullScores(GS2A_CONTEXT_STRUCT *context, int *isTarget, double *permutedCorr, int permutationNum, double *randScores)
+{
+	int geneNum = context->expressions.recordNum;
+	double score[GS2A_STATISTIC_NUM];
+	int k, s;
+
+	for (k=0;k<permutationNum;k++)
+	{
+		ComputeStatistics(context, score, permutedCorr+(size_t)k*geneNum, isTarget, -1);
+
+		for (s=0;s<context->statisticNum;s++)
+		{
+			randScores[(size_t)s*permutationNum+k] = fabs(score[s]);
+		}
+	}
+}
+
+//Set the p-values of candidateNum scores from permutationNum random scores of each of statisticNum statistics, laid out as by
+//GS2ANullScores. The random scores are sorted. Return 1 if success, -1 if failure
+int AssignPermutationP(CANDIDATE_SCORE_STRUCT *scores, int candidateNum, double *randScores, int permutationNum, int statisticNum)
+{
+	double *absScore, *pValues;
+	int i, s, result;
+
+	//p-value is the fraction of random scores at or above the candidate score, looked up for all candidates in one batch
+	absScore = (double *)malloc((candidateNum+1)*sizeof(double));
+	pValues = (double *)malloc((candidateNum+1)*sizeof(double));
+
+	assert((absScore!=NULL)&&(pValues!=NULL));
+
+	if ((absScore==NULL)||(pValues==NULL))
+	{
+		free(absScore);
+		free(pValues);
+		return -1;
+	}
+
+	result = 1;
+
+	for (s=0;(s<statisticNum)&&(result>0);s++)
+	{
+		QuicksortF(randScores+(size_t)s*permutationNum, 0, permutationNum-1);
+
+		for (i=0;i<candidateNum;i++)
+		{
+			absScore[i] = fabs(scores[i].score[s]);
+		}
+
+		result = EcdfUpperTailP(pValues, absScore, candidateNum, randScores+(size_t)s*permutationNum, permutationNum);
+
+		for (i=0;(i<candidateNum)&&(result>0);i++)
+		{
+			scores[i].pValue[s] = pValues[i];
+		}
+	}
+
+	free(absScore);
+	free(pValues);
+	return result;
+}
+
+//Set the p-values of candidateNum scores from permutationNum permutations, correlated a few blocks at a time. Return 1 if success, -1 if failure
+int GS2APermutationP(GS2A_CONTEXT_STRUCT *context, int *isTarget, long seed, int permutationNum, CANDIDATE_SCORE_STRUCT *scores, int candidateNum)
+{
+	int geneNum = context->expressions.recordNum;
+	int chunkNum = EngineThreadNum(context, context->threadNum)*GS2A_BLOCK_NUM;
+	double *randScores, *chunkScores, *permutedCorr;
+	int first, num, result, s;
+
+	randScores = (double *)malloc(((size_t)context->statisticNum*permutationNum+1)*sizeof(double));
+	chunkScores = (double *)malloc((size_t)context->statisticNum*chunkNum*sizeof(double));
+	permutedCorr = (double *)malloc((size_t)chunkNum*geneNum*sizeof(double));
+
+	assert((randScores!=NULL)&&(chunkScores!=NULL)&&(permutedCorr!=NULL));
+
+	if ((randScores==NULL)||(chunkScores==NULL)||(permutedCorr==NULL))
+	{
+		free(randScores);
+		free(chunkScores);
+		free(permutedCorr);
+		context->error = "cannot allocate memory for the permutations";
+		return -1;
+	}
+
+	result = 1;
+
+	//a block per thread at a time, so the correlations held do not grow with the permutations
+	for (first=0;(first<permutationNum)&&(result>0);first+=chunkNum)
+	{
+		num = (first+chunkNum<=permutationNum)?chunkNum:permutationNum-first;
+		result = GS2APermute(context, seed, first, num, permutedCorr);
+
+		if (result<=0)
+		{
+			break;
+		}
+
+		GS2ANullScores(context, isTarget, permutedCorr, num, chunkScores);
+
+		for (s=0;s<context->statisticNum;s++)
+		{
+			memcpy(randScores+(size_t)s*permutationNum+first, chunkScores+(size_t)s*num, num*sizeof(double));
+		}
+	}
+
+	if ((result>0)&&(AssignPermutationP(scores, candidateNum, randScores, permutationNum, context->statisticNum)<=0))
+	{
+		context->error = "cannot compute the permutation p-values";
+		result = -1;
+	}
+
+	free(randScores);
+	free(chunkScores);
+	free(permutedCorr);
+
+	return result;
+}
+
+//Write the scores as a table to an open stream: ID, isSignature, and a score and a p-value column per statistic, named by the
+//statistic if there are several. Return 1 if success, 0 if failure
+int WriteGS2AScores(FILE *fh, CANDIDATE_SCORE_STRUCT *candidateScores, int candNum, int *statistics, int statisticNum)
+{
+	TEXT_BUFFER_STRUCT buf;
+	int i, s, result;
+	
+	if (InitTextBuffer(&buf, fh, OUTPUT_BUFFER_SIZE)<=0)
+	{
+		return 0;
+	}
+	
+	if (statisticNum==1)
+	{
+		AppendString(&buf, "ID\tisSignature\tscore\tpValue\n");
+	}
+	else
+	{
+		AppendString(&buf, "ID\tisSignature");
+		
+		for (s=0;s<statisticNum;s++)
+		{
+			AppendChars(&buf, "\t", 1);
+			AppendString(&buf, gs2aStatistics[statistics[s]].name);
+			AppendString(&buf, "_score\t");
+			AppendString(&buf, gs2aStatistics[statistics[s]].name);
+			AppendString(&buf, "_pValue");
+		}
+		
+		AppendChars(&buf, "\n", 1);
+	}
+	
+	for (i=0;i<candNum;i++)
+	{
+		AppendString(&buf, candidateScores[i].id->name);
+		AppendChars(&buf, "\t", 1);
+		AppendInt(&buf, candidateScores[i].isSignature);
+		
+		for (s=0;s<statisticNum;s++)
+		{
+			AppendChars(&buf, "\t", 1);
+			AppendFixed(&buf, candidateScores[i].score[s], 6);
+			AppendChars(&buf, "\t", 1);
+			AppendFixed(&buf, candidateScores[i].pValue[s], 6);
+		}
+		
+		AppendChars(&buf, "\n", 1);
+	}
+	
+	result = FlushTextBuffer(&buf);
+	FreeTextBuffer(&buf);
+	
+	return (result>0)?1:0;
+}
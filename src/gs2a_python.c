@@ -0,0 +1,400 @@
+/*
+ *  gs2a_python.c
+ *  Python extension module gs2a, scoring matrices given through the buffer protocol with the GS2A engine
+ *
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "gs2a.h"
+
+#define PERMUTATION_NUM 1000
+
+#define PERMUTATION_SEED 123456
+
+//Get a C-contiguous 2-dimensional buffer of doubles from an object. Return 1 if success, -1 with a Python exception set if not
+int GetMatrixBuffer(PyObject *object, Py_buffer *view, char *name);
+
+//Fill the record names of a matrix from a sequence of str, or with prefix and the row number if names is None. Return 1 if success, -1 with a Python exception set if not
+int FillRecordNames(DATA_MATRIX_STRUCT *matrix, PyObject *names, char *prefix, char *name);
+
+//Mark the target genes of a sequence of expression row numbers in isTarget. Return the number of targets, -1 with a Python exception set if failure
+int FillTargets(int *isTarget, int geneNum, PyObject *targets);
+
+//Memoryview of doubles over a new bytes object of rowNum rows of columnNum values, one dimension if columnNum is 1. values receives its storage
+PyObject *NewDoubleArray(int rowNum, int columnNum, double **values);
+
+//gs2a.score(expression, candidates, targets, genes=None, candidate_names=None, method="pearson", statistics="mean",
+//permutations=1000, threads=0, seed=123456): GS2A scores and permutation p-values of every candidate
+PyObject *ScoreCandidates(PyObject *self, PyObject *args, PyObject *keywords);
+
+//Get a C-contiguous 2-dimensional buffer of doubles from an object. Return 1 if success, -1 with a Python exception set if not
+int GetMatrixBuffer(PyObject *object, Py_buffer *view, char *name)
+{
+	if (PyObject_GetBuffer(object, view, PyBUF_C_CONTIGUOUS|PyBUF_FORMAT)<0)
+	{
+		return -1;
+	}
+
+	//native doubles only, so the rows are read as they are
+	if ((view->ndim!=2)||(view->itemsize!=sizeof(double))
+		||((view->format!=NULL)&&(strcmp(view->format, "d")!=0)&&(strcmp(view->format, "@d")!=0)&&(strcmp(view->format, "=d")!=0)))
+	{
+		PyErr_Format(PyExc_TypeError, "%s must be a 2-dimensional C-contiguous buffer of float64", name);
+		PyBuffer_Release(view);
+		return -1;
+	}
+
+	if ((view->shape[0]<1)||(view->shape[1]<3)||(view->shape[0]>INT_MAX)||(view->shape[1]>INT_MAX))
+	{
+		PyErr_Format(PyExc_ValueError, "%s must have at least 1 row and 3 columns", name);
+		PyBuffer_Release(view);
+		return -1;
+	}
+
+	return 1;
+}
+
+//Fill the record names of a matrix from a sequence of str, or with prefix and the row number if names is None. Return 1 if success, -1 with a Python exception set if not
+int FillRecordNames(DATA_MATRIX_STRUCT *matrix, PyObject *names, char *prefix, char *name)
+{
+	PyObject *item;
+	const char *value;
+	int i;
+
+	if (names==Py_None)
+	{
+		for (i=0;i<matrix->recordNum;i++)
+		{
+			snprintf(matrix->recordInfo[i].name, MAX_WORD_SIZE, "%s%d", prefix, i);
+			matrix->recordInfo[i].flag = 0;
+		}
+
+		return 1;
+	}
+
+	if ((!PySequence_Check(names))||(PySequence_Size(names)!=matrix->recordNum))
+	{
+		PyErr_Format(PyExc_ValueError, "%s must be a sequence of a str per row", name);
+		return -1;
+	}
+
+	for (i=0;i<matrix->recordNum;i++)
+	{
+		item = PySequence_GetItem(names, i);
+		value = (item!=NULL)?PyUnicode_AsUTF8(item):NULL;
+
+		if (value==NULL)
+		{
+			Py_XDECREF(item);
+			return -1;
+		}
+
+		strncpy(matrix->recordInfo[i].name, value, MAX_WORD_SIZE-1);
+		matrix->recordInfo[i].name[MAX_WORD_SIZE-1] = 0;
+		matrix->recordInfo[i].flag = 0;
+		Py_DECREF(item);
+	}
+
+	return 1;
+}
+
+//Mark the target genes of a sequence of expression row numbers in isTarget. Return the number of targets, -1 with a Python exception set if failure
+int FillTargets(int *isTarget, int geneNum, PyObject *targets)
+{
+	PyObject *item;
+	Py_ssize_t targetNum, i;
+	long row;
+	int matchedIDNum;
+
+	if (!PySequence_Check(targets))
+	{
+		PyErr_SetString(PyExc_TypeError, "targets must be a sequence of expression row numbers");
+		return -1;
+	}
+
+	targetNum = PySequence_Size(targets);
+	matchedIDNum = 0;
+
+	for (i=0;i<targetNum;i++)
+	{
+		item = PySequence_GetItem(targets, i);
+		row = (item!=NULL)?PyLong_AsLong(item):-1;
+		Py_XDECREF(item);
+
+		if (PyErr_Occurred())
+		{
+			return -1;
+		}
+
+		if ((row<0)||(row>=geneNum))
+		{
+			PyErr_Format(PyExc_IndexError, "target row %ld is out of the %d expression rows", row, geneNum);
+			return -1;
+		}
+
+		if (!isTarget[row])
+		{
+			isTarget[row] = 1;
+			matchedIDNum++;
+		}
+	}
+
+	return matchedIDNum;
+}
+
+//Memoryview of doubles over a new bytes object of rowNum rows of columnNum values, one dimension if columnNum is 1. values receives its storage
+PyObject *NewDoubleArray(int rowNum, int columnNum, double **values)
+{
+	PyObject *bytes, *view, *array;
+
+	bytes = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)rowNum*columnNum*sizeof(double));
+
+	if (bytes==NULL)
+	{
+		return NULL;
+	}
+
+	*values = (double *)PyBytes_AS_STRING(bytes);
+	view = PyMemoryView_FromObject(bytes);
+	Py_DECREF(bytes);
+
+	if (view==NULL)
+	{
+		return NULL;
+	}
+
+	if (columnNum==1)
+	{
+		array = PyObject_CallMethod(view, "cast", "s", "d");
+	}
+	else
+	{
+		array = PyObject_CallMethod(view, "cast", "s(ii)", "d", rowNum, columnNum);
+	}
+
+	Py_DECREF(view);
+
+	return array;
+}
+
+//gs2a.score(expression, candidates, targets, genes=None, candidate_names=None, method="pearson", statistics="mean",
+//permutations=1000, threads=0, seed=123456): GS2A scores and permutation p-values of every candidate
+PyObject *ScoreCandidates(PyObject *self, PyObject *args, PyObject *keywords)
+{
+	char *keywordNames[] = {"expression", "candidates", "targets", "genes", "candidate_names", "method", "statistics",
+						    "permutations", "threads", "seed", NULL};
+	PyObject *expressionObject, *candidateObject, *targets;
+	PyObject *genes = Py_None, *candidateNames = Py_None;
+	char *methodName = "pearson", *statisticNames = "mean";
+	int permutationNum = PERMUTATION_NUM, threadNum = 0;
+	long seed = PERMUTATION_SEED;
+	Py_buffer expressionView, candidateView;
+	GS2A_CONTEXT_STRUCT context;
+	CANDIDATE_SCORE_STRUCT *scores;
+	PyObject *scoreArray, *pValueArray, *result;
+	double *scoreValues, *pValueValues;
+	int *isTarget;
+	int correlationMethod, statisticNum, targetNum, geneNum, isFailed;
+	int i, s;
+
+	if (!PyArg_ParseTupleAndKeywords(args, keywords, "OOO|OOssiil", keywordNames, &expressionObject, &candidateObject, &targets,
+									 &genes, &candidateNames, &methodName, &statisticNames, &permutationNum, &threadNum, &seed))
+	{
+		return NULL;
+	}
+
+	correlationMethod = ParseCorrelationMethod(methodName);
+
+	if (correlationMethod<0)
+	{
+		PyErr_SetString(PyExc_ValueError, "method must be pearson, spearman, bicor, kendall, mi or eta");
+		return NULL;
+	}
+
+	if (permutationNum<=0)
+	{
+		PyErr_SetString(PyExc_ValueError, "permutations must be positive");
+		return NULL;
+	}
+
+	if (threadNum<=0)
+	{
+		threadNum = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	}
+
+	InitGS2AContext(&context, correlationMethod, threadNum, 0);
+
+	statisticNum = ParseStatistics(statisticNames, context.statistics);
+
+	if (statisticNum<=0)
+	{
+		PyErr_SetString(PyExc_ValueError, "statistics must be a comma separated list of mean and chisq");
+		return NULL;
+	}
+
+	context.statisticNum = statisticNum;
+
+	if (GetMatrixBuffer(expressionObject, &expressionView, "expression")<=0)
+	{
+		return NULL;
+	}
+
+	if (GetMatrixBuffer(candidateObject, &candidateView, "candidates")<=0)
+	{
+		PyBuffer_Release(&expressionView);
+		return NULL;
+	}
+
+	if (expressionView.shape[1]!=candidateView.shape[1])
+	{
+		PyErr_SetString(PyExc_ValueError, "expression and candidates must have the same samples as columns");
+		PyBuffer_Release(&expressionView);
+		PyBuffer_Release(&candidateView);
+		return NULL;
+	}
+
+	//the rows are read straight from the buffers into the working rows of the context, which the engine transforms in place
+	if ((AllocDataMatrix(&(context.expressions), (int)expressionView.shape[1], (int)expressionView.shape[0])<=0)
+		||(AllocDataMatrix(&(context.candidates), (int)candidateView.shape[1], (int)candidateView.shape[0])<=0))
+	{
+		PyBuffer_Release(&expressionView);
+		PyBuffer_Release(&candidateView);
+		FreeGS2AContext(&context);
+		return PyErr_NoMemory();
+	}
+
+	memcpy(context.expressions.matrix, expressionView.buf, expressionView.len);
+	memcpy(context.candidates.matrix, candidateView.buf, candidateView.len);
+	PyBuffer_Release(&expressionView);
+	PyBuffer_Release(&candidateView);
+
+	for (i=0;i<context.expressions.sampleNum;i++)
+	{
+		snprintf(context.expressions.sampleInfo[i].name, MAX_WORD_SIZE, "%d", i);
+		memcpy(&(context.candidates.sampleInfo[i]), &(context.expressions.sampleInfo[i]), sizeof(ID_INFO_STRUCT));
+	}
+
+	//a candidate named as a gene has that gene left out of its scores. Without names nothing is left out
+	geneNum = context.expressions.recordNum;
+	isTarget = (int *)calloc(geneNum+1, sizeof(int));
+
+	if ((isTarget==NULL)||(FillRecordNames(&(context.expressions), genes, "gene", "genes")<=0)
+		||(FillRecordNames(&(context.candidates), candidateNames, "candidate", "candidate_names")<=0)
+		||((targetNum=FillTargets(isTarget, geneNum, targets))<0))
+	{
+		free(isTarget);
+		FreeGS2AContext(&context);
+		return (PyErr_Occurred()!=NULL)?NULL:PyErr_NoMemory();
+	}
+
+	if ((targetNum<2)||(targetNum>geneNum-2))
+	{
+		PyErr_SetString(PyExc_ValueError, "at least 2 target genes and 2 other genes are needed in the expression data");
+		free(isTarget);
+		FreeGS2AContext(&context);
+		return NULL;
+	}
+
+	//the engine reads no Python object, so other Python threads run while it scores
+	isFailed = 0;
+	scores = NULL;
+
+	Py_BEGIN_ALLOW_THREADS
+
+	if (PrepareGS2AContext(&context)<=0)
+	{
+		isFailed = 1;
+	}
+	else
+	{
+		scores = (CANDIDATE_SCORE_STRUCT *)malloc(context.candidateNum*sizeof(CANDIDATE_SCORE_STRUCT));
+
+		if (scores==NULL)
+		{
+			context.error = "cannot allocate memory for scoring";
+			isFailed = 1;
+		}
+		else if ((GS2AScoreBatch(&context, isTarget, NULL, context.candidateNum, scores)<=0)
+				 ||(GS2APermutationP(&context, isTarget, seed, permutationNum, scores, context.candidateNum)<=0))
+		{
+			isFailed = 1;
+		}
+	}
+
+	Py_END_ALLOW_THREADS
+
+	if (isFailed)
+	{
+		PyErr_SetString(PyExc_RuntimeError, context.error);
+		free(scores);
+		free(isTarget);
+		FreeGS2AContext(&context);
+		return NULL;
+	}
+
+	scoreArray = NewDoubleArray(context.candidateNum, statisticNum, &scoreValues);
+	pValueArray = (scoreArray!=NULL)?NewDoubleArray(context.candidateNum, statisticNum, &pValueValues):NULL;
+
+	if (pValueArray!=NULL)
+	{
+		for (i=0;i<context.candidateNum;i++)
+		{
+			for (s=0;s<statisticNum;s++)
+			{
+				scoreValues[(size_t)i*statisticNum+s] = scores[i].score[s];
+				pValueValues[(size_t)i*statisticNum+s] = scores[i].pValue[s];
+			}
+		}
+
+		result = PyTuple_Pack(2, scoreArray, pValueArray);
+	}
+	else
+	{
+		result = NULL;
+	}
+
+	Py_XDECREF(scoreArray);
+	Py_XDECREF(pValueArray);
+	free(scores);
+	free(isTarget);
+	FreeGS2AContext(&context);
+
+	return result;
+}
+
+//functions of the module
+PyMethodDef gs2aMethods[] =
+{
+	{"score", (PyCFunction)(void (*)(void))ScoreCandidates, METH_VARARGS|METH_KEYWORDS,
+	 "score(expression, candidates, targets, genes=None, candidate_names=None, method='pearson', statistics='mean',\n"
+	 "      permutations=1000, threads=0, seed=123456) -> (scores, p_values)\n\n"
+	 "Score every candidate row against the target rows of the expression matrix. expression (genes x samples) and\n"
+	 "candidates (candidates x samples) are 2-dimensional C-contiguous float64 buffers, such as numpy arrays, with the\n"
+	 "same samples as columns. targets is a sequence of expression row numbers. A candidate named in candidate_names\n"
+	 "as a gene of genes has that gene left out of its scores. method is pearson, spearman, bicor, kendall, mi or eta, and\n"
+	 "statistics a comma separated list of mean and chisq. threads=0 uses every processor. The scores and p-values are\n"
+	 "float64 memoryviews, of one value per candidate, or of a row per candidate and a column per statistic."},
+	{NULL, NULL, 0, NULL}
+};
+
+//definition of the module
+struct PyModuleDef gs2aModule =
+{
+	PyModuleDef_HEAD_INIT,
+	"gs2a",
+	"Gene Signature Association Analysis scoring engine.",
+	-1,
+	gs2aMethods
+};
+
+//Module initialization
+PyMODINIT_FUNC PyInit_gs2a(void)
+{
+	return PyModule_Create(&gs2aModule);
+}
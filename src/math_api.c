@@ -10,122 +10,73 @@
 #include <math.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <assert.h>
 #include "math_api.h"
+#include "sort.h"
 #include "rvgs.h"
 
-// normalInv: from Ziegler's code
-double normalInv(double p);
-
 //compute Euclidean distance
 double EucliDist(double *a, double *b, int dim);
 
 //BTreeSearchingF: Searching value in array, which was organized in ascending order previously
 int  bTreeSearchingF(double value, double *a, int lo, int hi)
 {
-	if (value<=a[lo])
-	{
-		return lo;
-	}
+	int mid;
 	
-	if (value>=a[hi])
+	//iterative bisection, so that long arrays do not build up deep recursion
+	while (1)
 	{
-		return hi;
-	}
-	
-	if (hi-lo<=1)
-	{
-		if (fabs(a[hi]-value)>fabs(a[lo]-value))
+		if (value<=a[lo])
 		{
 			return lo;
 		}
-		else
+		
+		if (value>=a[hi])
 		{
 			return hi;
 		}
-	}
-	
-	if (value>=a[(lo+hi)/2])
-	{
-		return bTreeSearchingF(value, a, (lo+hi)/2, hi);
-	}
-	else
-	{
-		return bTreeSearchingF(value, a,  lo, (lo+hi)/2);
+		
+		if (hi-lo<=1)
+		{
+			if (fabs(a[hi]-value)>fabs(a[lo]-value))
+			{
+				return lo;
+			}
+			else
+			{
+				return hi;
+			}
+		}
+		
+		mid = (lo+hi)/2;
+		
+		if (value>=a[mid])
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid;
+		}
 	}
 }
 
-//Quicksort an array in real values, in ascending order
+//Quicksort an array in real values, in ascending order. Sorts a[lo..hi] with SortF
 void QuicksortF(double *a, int lo, int hi)
 {
-	int i=lo, j=hi;
-	double x=a[(lo+hi)/2];
-	double h;
-	
-	if (hi<lo)
+	if (hi>lo)
 	{
-		return;
+		SortF(a+lo, hi-lo+1);
 	}
-	
-    //  partition
-    while (i<=j)
-    {    
-		while ((a[i]<x)&&(i<=j))
-		{
-			i++;
-		}
-		while ((a[j]>x)&&(i<=j))
-		{
-			j--;
-		}
-        if (i<=j)
-        {
-			h = a[i];
-			a[i] = a[j];
-			a[j] = h;
-            i++; j--;
-        }
-    } 
-	
-    //  recursion
-    if (lo<j) QuicksortF(a, lo, j);
-    if (i<hi) QuicksortF(a, i, hi);
 }
 
-//Quicksort an indexed array, in ascending order 
+//Quicksort an indexed array, in ascending order. Sorts a[lo..hi] with SortIndexedArray
 void QuicksortIndexedArray(INDEXED_FLOAT *a, int lo, int hi)
 {
-	int i=lo, j=hi;
-	double x=a[(lo+hi)/2].value;
-	INDEXED_FLOAT h;
-	
-	if (hi<lo)
+	if (hi>lo)
 	{
-		return;
+		SortIndexedArray(a+lo, hi-lo+1);
 	}
-	
-    //  partition
-    while (i<=j)
-    {    
-		while ((a[i].value<x)&&(i<=j))
-		{
-			i++;
-		}
-		while ((a[j].value>x)&&(i<=j))
-		{
-			j--;
-		}
-        if (i<=j)
-        {
-			memcpy(&h, a+i, sizeof(INDEXED_FLOAT));
-			memcpy(a+i,a+j,sizeof(INDEXED_FLOAT));
-			memcpy(a+j, &h, sizeof(INDEXED_FLOAT));
-            i++; j--;
-        }
-    } 
-	
-    //  recursion
-    if (lo<j) QuicksortIndexedArray(a, lo, j);
-    if (i<hi) QuicksortIndexedArray(a, i, hi);
 }
 
 //Normal score transform
@@ -141,24 +92,65 @@ int NormalTransform(double *destA, int *rank, int sampleNum)
 	return 1;
 }
 
-//Rank the values in a float array and store the rank values in an integer array
+//Rank the values in a float array and store the rank values in an integer array. Tied values share the middle rank of their run, rounded down
 void Ranking(int *rank, double *values, int sampleNum)
 {
-	double *tmp;
+	INDEXED_FLOAT *sortBuf;
 	int i;
 	
-	tmp = (double *)malloc(sampleNum*sizeof(double));
+	sortBuf = (INDEXED_FLOAT *)malloc(sampleNum*sizeof(INDEXED_FLOAT));
 	
-	memcpy(tmp, values, sampleNum*sizeof(double));
+	assert(sortBuf!=NULL);
+	
+	DoubledRanking(rank, values, sortBuf, sampleNum);
+	
+	for (i=0;i<sampleNum;i++)
+	{
+		rank[i] /= 2;
+	}
 	
-	QuicksortF(tmp, 0, sampleNum-1);
+	free(sortBuf);
+}
+
+//Rank the values with one indexed sort. rank2 receives twice the 0-based average rank of each value (first+last position of its run of ties),
+//which is exact in integers. sortBuf: workspace of sampleNum items
+void DoubledRanking(int *rank2, double *values, INDEXED_FLOAT *sortBuf, int sampleNum)
+{
+	int i, first, last;
 	
 	for (i=0;i<sampleNum;i++)
 	{
-		rank[i] = (bTreeSearchingF(values[i]-0.0000001, tmp, 0, sampleNum-1)+bTreeSearchingF(values[i]+0.0000001, tmp, 0, sampleNum-1))/2;
+		sortBuf[i].value = values[i];
+		sortBuf[i].index = i;
 	}
 	
-	free(tmp);
+	QuicksortIndexedArray(sortBuf, 0, sampleNum-1);
+	
+	for (first=0;first<sampleNum;first=last+1)
+	{
+		for (last=first;(last+1<sampleNum)&&(sortBuf[last+1].value==sortBuf[first].value);last++)
+		{
+		}
+		
+		for (i=first;i<=last;i++)
+		{
+			rank2[sortBuf[i].index] = first+last;
+		}
+	}
+}
+
+//Rank the values with one indexed sort. Tied values share the average of their 0-based ranks. rank can be values.
+//sortBuf and rank2: workspace of sampleNum items
+void AverageRanking(double *rank, double *values, INDEXED_FLOAT *sortBuf, int *rank2, int sampleNum)
+{
+	int i;
+	
+	DoubledRanking(rank2, values, sortBuf, sampleNum);
+	
+	for (i=0;i<sampleNum;i++)
+	{
+		rank[i] = 0.5*rank2[i];
+	}
 }
 
 // normalInv: from Ziegler's code
@@ -193,7 +185,7 @@ double normalInv(double p)
 	
 	double p_low =  0.02425;
 	double p_high = 1 - p_low;
-	double q, x, r;
+	double q, x = 0, r;
 	
 	//Rational approximation for lower region.
 	
@@ -339,6 +331,23 @@ void PermuteFloatArrays(double *a, int size)
 	}	
 }
 
+//Randomly permute an array of float values, drawing from a reentrant stream
+void PermuteFloatArraysStream(double *a, int size, RNG_STREAM_STRUCT *rng)
+{
+	int i;
+	double tmp;
+	int index;
+
+	for (i=0;i<size-1;i++)
+	{
+		index = i+(int)EquilikelyStream(rng, size-i);
+		
+		tmp = a[i];
+		a[i] = a[index];
+		a[index] = tmp;
+	}	
+}
+
 //Pearson correlation
 double PearsonCorrel(double *a, double *b, int dim)
 {
@@ -382,3 +391,56 @@ double PartialCorrel(double *a, double *b, double *control, int dim)
 	
 	return (corAB-corAC*corBC)/(sqrt(1-corAC*corAC)*sqrt(1-corBC*corBC)+0.00000000001);
 }
+
+//Center an array and scale it to unit norm, so that the Pearson correlation of two standardized arrays is their dot product. Return the norm of the centered array. An array with zero variance is set to zeros
+double StandardizeArray(double *destA, double *srcA, int dim)
+{
+	int i;
+	double mean, norm;
+	
+	mean = 0;
+	
+	for (i=0;i<dim;i++)
+	{
+		mean += srcA[i];
+	}
+	
+	mean /= dim;
+	
+	norm = 0;
+	
+	for (i=0;i<dim;i++)
+	{
+		destA[i] = srcA[i]-mean;
+		norm += destA[i]*destA[i];
+	}
+	
+	norm = sqrt(norm);
+	
+	if (norm<0.00000000001)
+	{
+		memset(destA, 0, dim*sizeof(double));
+		return 0;
+	}
+	
+	for (i=0;i<dim;i++)
+	{
+		destA[i] /= norm;
+	}
+	
+	return norm;
+}
+
+//Dot product of two arrays
+double DotProduct(double *a, double *b, int dim)
+{
+	int i;
+	double sum = 0;
+	
+	for (i=0;i<dim;i++)
+	{
+		sum += a[i]*b[i];
+	}
+	
+	return sum;
+}
@@ -0,0 +1,577 @@
+/*
+ *  nst.c
+ *  Table-driven, multithreaded Normal Score Transform
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "math_api.h"
+#include "nst.h"
+#include "format.h"
+
+#define NST_ROW_CHUNK 16		//number of rows a worker takes at a time
+#define NST_SLOTS_PER_THREAD 4	//rows in flight per worker thread in NSTNormStream
+#define NST_FIELD_DELIM " \t\r\n\v\f"
+#define NST_MAX_VALUE_WIDTH 16	//upper bound of the printed width of one normal score, tab included
+
+//Shared state of the NSTNormMatrix workers
+typedef struct
+{
+	double *data;
+	int geneNum;
+	int sampleNum;
+	double *table;
+	int nextRow;
+	int isFailed;		//a worker could not allocate its workspace
+	pthread_mutex_t lock;
+}NST_ENGINE_STRUCT;
+
+//One row in flight in NSTNormStream. Row r of the file uses slot r%slotNum
+typedef struct
+{
+	char *line;			//input line, owned by the reader until the slot is NST_SLOT_READ
+	size_t lineSize;
+	char *out;			//formatted output line, owned by the worker until the slot is NST_SLOT_DONE
+	size_t outSize;
+	int isValid;		//the line has a name and sampleNum values
+	int state;
+}NST_STREAM_SLOT_STRUCT;
+
+enum {NST_SLOT_FREE, NST_SLOT_READ, NST_SLOT_DONE};
+
+//Shared state of the NSTNormStream reader, workers and writer
+typedef struct
+{
+	FILE *in;
+	int sampleNum;
+	double *table;
+	NST_STREAM_SLOT_STRUCT *slots;
+	int slotNum;
+	long readNum;		//rows handed over by the reader
+	long nextRow;		//next row for the workers
+	long writtenNum;	//rows written, or dropped after a malformed row
+	int readerDone;
+	int stop;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+}NST_STREAM_STRUCT;
+
+//Worker thread of NSTNormMatrix. Takes chunks of rows until none are left
+void *NSTWorker(void *arg);
+
+//Reader thread of NSTNormStream. Reads lines into free slots, at most slotNum rows ahead of the writer
+void *NSTStreamReader(void *arg);
+
+//Worker thread of NSTNormStream. Parses, transforms and formats rows in any order
+void *NSTStreamWorker(void *arg);
+
+//Parse and transform one input line into its output line. Return 1 if the line has a name and sampleNum values, -1 if not.
+//values, sortBuf and rankBuf: workspace of sampleNum items
+int NSTStreamRow(NST_STREAM_SLOT_STRUCT *slot, int sampleNum, double *table, double *values, INDEXED_FLOAT *sortBuf, int *rankBuf);
+
+//Build the half-rank normal score table of a row length: table[k] = normalInv((k/2+0.5)/sampleNum), k = 0..2*sampleNum-2,
+//where k is twice the average rank. Return 1 if success, -1 if failure
+int BuildNormalScoreTable(double *table, int sampleNum)
+{
+	int i;
+	
+	if (sampleNum<=0)
+	{
+		return -1;
+	}
+	
+	for (i=0;i<2*sampleNum-1;i++)
+	{
+		table[i] = normalInv(((double)i+1.0)/(2.0*sampleNum));
+	}
+	
+	return 1;
+}
+
+//Normal score transform of one row with a prebuilt half-rank table. The row is ranked by one indexed sort, and tied values
+//share the normal score of their average rank. destA can be srcA. sortBuf and rankBuf: workspace of sampleNum items
+void NSTNormRow(double *destA, double *srcA, int sampleNum, double *table, INDEXED_FLOAT *sortBuf, int *rankBuf)
+{
+	int i;
+	
+	DoubledRanking(rankBuf, srcA, sortBuf, sampleNum);
+	
+	for (i=0;i<sampleNum;i++)
+	{
+		destA[i] = table[rankBuf[i]];
+	}
+}
+
+//Worker thread of NSTNormMatrix. Takes chunks of rows until none are left
+void *NSTWorker(void *arg)
+{
+	NST_ENGINE_STRUCT *engine = (NST_ENGINE_STRUCT *)arg;
+	INDEXED_FLOAT *sortBuf;
+	int *rankBuf;
+	int first, last, i;
+	
+	sortBuf = (INDEXED_FLOAT *)malloc(engine->sampleNum*sizeof(INDEXED_FLOAT));
+	rankBuf = (int *)malloc(engine->sampleNum*sizeof(int));
+	
+	assert((sortBuf!=NULL)&&(rankBuf!=NULL));
+	
+	if ((sortBuf==NULL)||(rankBuf==NULL))
+	{
+		free(sortBuf);
+		free(rankBuf);
+		
+		pthread_mutex_lock(&(engine->lock));
+		engine->isFailed = 1;
+		pthread_mutex_unlock(&(engine->lock));
+		
+		return NULL;
+	}
+	
+	while (1)
+	{
+		pthread_mutex_lock(&(engine->lock));
+		first = engine->nextRow;
+		engine->nextRow += NST_ROW_CHUNK;
+		pthread_mutex_unlock(&(engine->lock));
+		
+		if (first>=engine->geneNum)
+		{
+			break;
+		}
+		
+		last = (first+NST_ROW_CHUNK<engine->geneNum)?first+NST_ROW_CHUNK:engine->geneNum;
+		
+		for (i=first;i<last;i++)
+		{
+			NSTNormRow(engine->data+(size_t)i*engine->sampleNum, engine->data+(size_t)i*engine->sampleNum, engine->sampleNum, engine->table, sortBuf, rankBuf);
+		}
+	}
+	
+	free(sortBuf);
+	free(rankBuf);
+	
+	return NULL;
+}
+
+//Normal score transform of every row of a geneNum*sampleNum matrix in place, with threadNum threads. Return 1 if success, -1 if failure
+int NSTNormMatrix(double *data, int geneNum, int sampleNum, int threadNum)
+{
+	NST_ENGINE_STRUCT engine;
+	pthread_t *threads;
+	int i;
+	
+	if ((sampleNum<=0)||(threadNum<=0))
+	{
+		return -1;
+	}
+	
+	//only 2*sampleNum-1 distinct average ranks exist for a row length, so normalInv is evaluated that many times in total
+	engine.table = (double *)malloc((2*sampleNum-1)*sizeof(double));
+	threads = (pthread_t *)malloc(threadNum*sizeof(pthread_t));
+	
+	assert((engine.table!=NULL)&&(threads!=NULL));
+	
+	if ((engine.table==NULL)||(threads==NULL))
+	{
+		free(engine.table);
+		free(threads);
+		return -1;
+	}
+	
+	BuildNormalScoreTable(engine.table, sampleNum);
+	
+	engine.data = data;
+	engine.geneNum = geneNum;
+	engine.sampleNum = sampleNum;
+	engine.nextRow = 0;
+	engine.isFailed = 0;
+	pthread_mutex_init(&(engine.lock), NULL);
+	
+	for (i=1;i<threadNum;i++)
+	{
+		pthread_create(threads+i, NULL, NSTWorker, &engine);
+	}
+	
+	NSTWorker(&engine);
+	
+	for (i=1;i<threadNum;i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	
+	pthread_mutex_destroy(&(engine.lock));
+	
+	free(engine.table);
+	free(threads);
+	
+	if (engine.isFailed)
+	{
+		return -1;
+	}
+	
+	return 1;
+}
+
+//Parse and transform one input line into its output line. Return 1 if the line has a name and sampleNum values, -1 if not.
+//values, sortBuf and rankBuf: workspace of sampleNum items
+int NSTStreamRow(NST_STREAM_SLOT_STRUCT *slot, int sampleNum, double *table, double *values, INDEXED_FLOAT *sortBuf, int *rankBuf)
+{
+	char *p, *name;
+	size_t nameLen, need, len;
+	int i;
+	
+	p = slot->line+strspn(slot->line, NST_FIELD_DELIM);
+	name = p;
+	nameLen = strcspn(p, NST_FIELD_DELIM);
+	p += nameLen;
+	
+	if (nameLen==0)
+	{
+		return -1;
+	}
+	
+	for (i=0;i<sampleNum;i++)
+	{
+		p += strspn(p, NST_FIELD_DELIM);
+		
+		len = strcspn(p, NST_FIELD_DELIM);
+		
+		if (len==0)
+		{
+			return -1;
+		}
+		
+		values[i] = atof(p);
+		p += len;
+	}
+	
+	if (p[strspn(p, NST_FIELD_DELIM)]!=0)
+	{
+		return -1;
+	}
+	
+	NSTNormRow(values, values, sampleNum, table, sortBuf, rankBuf);
+	
+	need = nameLen+(size_t)sampleNum*NST_MAX_VALUE_WIDTH+2;
+	
+	if (slot->outSize<need)
+	{
+		free(slot->out);
+		slot->out = (char *)malloc(need);
+		slot->outSize = (slot->out==NULL)?0:need;
+		
+		assert(slot->out!=NULL);
+		
+		if (slot->out==NULL)
+		{
+			return -1;
+		}
+	}
+	
+	memcpy(slot->out, name, nameLen);
+	len = nameLen;
+	
+	for (i=0;i<sampleNum;i++)
+	{
+		slot->out[len++] = '\t';
+		len += FormatFixed(slot->out+len, values[i], 6);
+	}
+	
+	slot->out[len] = '\n';
+	slot->out[len+1] = 0;
+	
+	return 1;
+}
+
+//Reader thread of NSTNormStream. Reads lines into free slots, at most slotNum rows ahead of the writer
+void *NSTStreamReader(void *arg)
+{
+	NST_STREAM_STRUCT *stream = (NST_STREAM_STRUCT *)arg;
+	NST_STREAM_SLOT_STRUCT *slot;
+	
+	while (1)
+	{
+		pthread_mutex_lock(&(stream->lock));
+		
+		while ((!stream->stop)&&(stream->readNum-stream->writtenNum>=stream->slotNum))
+		{
+			pthread_cond_wait(&(stream->changed), &(stream->lock));
+		}
+		
+		slot = stream->slots+stream->readNum%stream->slotNum;
+		
+		if (stream->stop)
+		{
+			stream->readerDone = 1;
+			pthread_cond_broadcast(&(stream->changed));
+			pthread_mutex_unlock(&(stream->lock));
+			break;
+		}
+		
+		pthread_mutex_unlock(&(stream->lock));
+		
+		//the slot is free, so only the reader touches it here
+		if (getline(&(slot->line), &(slot->lineSize), stream->in)<0)
+		{
+			pthread_mutex_lock(&(stream->lock));
+			stream->readerDone = 1;
+			pthread_cond_broadcast(&(stream->changed));
+			pthread_mutex_unlock(&(stream->lock));
+			break;
+		}
+		
+		pthread_mutex_lock(&(stream->lock));
+		slot->state = NST_SLOT_READ;
+		stream->readNum++;
+		pthread_cond_broadcast(&(stream->changed));
+		pthread_mutex_unlock(&(stream->lock));
+	}
+	
+	return NULL;
+}
+
+//Worker thread of NSTNormStream. Parses, transforms and formats rows in any order
+void *NSTStreamWorker(void *arg)
+{
+	NST_STREAM_STRUCT *stream = (NST_STREAM_STRUCT *)arg;
+	NST_STREAM_SLOT_STRUCT *slot;
+	double *values;
+	INDEXED_FLOAT *sortBuf;
+	int *rankBuf;
+	int isValid;
+	
+	values = (double *)malloc(stream->sampleNum*sizeof(double));
+	sortBuf = (INDEXED_FLOAT *)malloc(stream->sampleNum*sizeof(INDEXED_FLOAT));
+	rankBuf = (int *)malloc(stream->sampleNum*sizeof(int));
+	
+	assert((values!=NULL)&&(sortBuf!=NULL)&&(rankBuf!=NULL));
+	
+	while (1)
+	{
+		pthread_mutex_lock(&(stream->lock));
+		
+		while ((!stream->stop)&&(!stream->readerDone)&&(stream->nextRow==stream->readNum))
+		{
+			pthread_cond_wait(&(stream->changed), &(stream->lock));
+		}
+		
+		if ((stream->stop)||(stream->nextRow==stream->readNum))
+		{
+			pthread_mutex_unlock(&(stream->lock));
+			break;
+		}
+		
+		slot = stream->slots+stream->nextRow%stream->slotNum;
+		stream->nextRow++;
+		pthread_mutex_unlock(&(stream->lock));
+		
+		if ((values==NULL)||(sortBuf==NULL)||(rankBuf==NULL))
+		{
+			isValid = -1;
+		}
+		else
+		{
+			isValid = NSTStreamRow(slot, stream->sampleNum, stream->table, values, sortBuf, rankBuf);
+		}
+		
+		pthread_mutex_lock(&(stream->lock));
+		slot->isValid = isValid;
+		slot->state = NST_SLOT_DONE;
+		pthread_cond_broadcast(&(stream->changed));
+		pthread_mutex_unlock(&(stream->lock));
+	}
+	
+	free(values);
+	free(sortBuf);
+	free(rankBuf);
+	
+	return NULL;
+}
+
+//Normal score transform of a data matrix file (header row of sample names, then one record per row) into another,
+//without loading the matrix. A reader thread, threadNum worker threads and the calling thread as the ordered writer
+//share a ring of rows, so memory depends on the sample number but not the record number. Like ReadDataMatrix, reading
+//stops at the first row without sampleNum values. Return the number of records, or -1 if failure
+int NSTNormStream(char *inputFileName, char *outputFileName, int threadNum, int *pSampleNum)
+{
+	NST_STREAM_STRUCT stream;
+	NST_STREAM_SLOT_STRUCT *slot;
+	FILE *out;
+	pthread_t reader;
+	pthread_t *workers;
+	char *header = NULL;
+	size_t headerSize = 0;
+	char *p;
+	size_t len;
+	int sampleNum, i;
+	int result;
+	
+	if (threadNum<=0)
+	{
+		return -1;
+	}
+	
+	stream.in = (FILE *)fopen(inputFileName, "r");
+	
+	if (stream.in==NULL)
+	{
+		return -1;
+	}
+	
+	//the header row gives the sample number
+	if (getline(&header, &headerSize, stream.in)<0)
+	{
+		free(header);
+		fclose(stream.in);
+		return -1;
+	}
+	
+	sampleNum = -1;
+	
+	for (p=header+strspn(header, NST_FIELD_DELIM);*p!=0;p+=strspn(p, NST_FIELD_DELIM))
+	{
+		p += strcspn(p, NST_FIELD_DELIM);
+		sampleNum++;
+	}
+	
+	out = (FILE *)fopen(outputFileName, "w");
+	
+	if ((sampleNum<=0)||(out==NULL))
+	{
+		if (out!=NULL)
+		{
+			fclose(out);
+		}
+		free(header);
+		fclose(stream.in);
+		return -1;
+	}
+	
+	//write the sample names the way SaveDataMatrix does
+	fprintf(out, "#");
+	
+	p = header+strspn(header, NST_FIELD_DELIM);
+	p += strcspn(p, NST_FIELD_DELIM);
+	
+	for (i=0;i<sampleNum;i++)
+	{
+		p += strspn(p, NST_FIELD_DELIM);
+		len = strcspn(p, NST_FIELD_DELIM);
+		fprintf(out, "\t%.*s", (int)len, p);
+		p += len;
+	}
+	
+	fprintf(out, "\n");
+	
+	free(header);
+	
+	stream.sampleNum = sampleNum;
+	stream.slotNum = NST_SLOTS_PER_THREAD*threadNum;
+	stream.table = (double *)malloc((2*sampleNum-1)*sizeof(double));
+	stream.slots = (NST_STREAM_SLOT_STRUCT *)calloc(stream.slotNum, sizeof(NST_STREAM_SLOT_STRUCT));
+	workers = (pthread_t *)malloc(threadNum*sizeof(pthread_t));
+	
+	assert((stream.table!=NULL)&&(stream.slots!=NULL)&&(workers!=NULL));
+	
+	if ((stream.table==NULL)||(stream.slots==NULL)||(workers==NULL))
+	{
+		free(stream.table);
+		free(stream.slots);
+		free(workers);
+		fclose(out);
+		fclose(stream.in);
+		return -1;
+	}
+	
+	BuildNormalScoreTable(stream.table, sampleNum);
+	
+	stream.readNum = 0;
+	stream.nextRow = 0;
+	stream.writtenNum = 0;
+	stream.readerDone = 0;
+	stream.stop = 0;
+	pthread_mutex_init(&(stream.lock), NULL);
+	pthread_cond_init(&(stream.changed), NULL);
+	
+	pthread_create(&reader, NULL, NSTStreamReader, &stream);
+	
+	for (i=0;i<threadNum;i++)
+	{
+		pthread_create(workers+i, NULL, NSTStreamWorker, &stream);
+	}
+	
+	result = 0;
+	
+	//write the rows in file order as they are finished
+	while (1)
+	{
+		pthread_mutex_lock(&(stream.lock));
+		
+		slot = stream.slots+stream.writtenNum%stream.slotNum;
+		
+		while ((slot->state!=NST_SLOT_DONE)&&(!((stream.readerDone)&&(stream.writtenNum==stream.readNum))))
+		{
+			pthread_cond_wait(&(stream.changed), &(stream.lock));
+		}
+		
+		if (slot->state!=NST_SLOT_DONE)
+		{
+			pthread_mutex_unlock(&(stream.lock));
+			break;
+		}
+		
+		pthread_mutex_unlock(&(stream.lock));
+		
+		if (slot->isValid<=0)
+		{
+			pthread_mutex_lock(&(stream.lock));
+			stream.stop = 1;
+			pthread_cond_broadcast(&(stream.changed));
+			pthread_mutex_unlock(&(stream.lock));
+			break;
+		}
+		
+		fputs(slot->out, out);
+		result++;
+		
+		pthread_mutex_lock(&(stream.lock));
+		slot->state = NST_SLOT_FREE;
+		stream.writtenNum++;
+		pthread_cond_broadcast(&(stream.changed));
+		pthread_mutex_unlock(&(stream.lock));
+	}
+	
+	pthread_join(reader, NULL);
+	
+	for (i=0;i<threadNum;i++)
+	{
+		pthread_join(workers[i], NULL);
+	}
+	
+	pthread_mutex_destroy(&(stream.lock));
+	pthread_cond_destroy(&(stream.changed));
+	
+	for (i=0;i<stream.slotNum;i++)
+	{
+		free(stream.slots[i].line);
+		free(stream.slots[i].out);
+	}
+	
+	if (fclose(out)!=0)
+	{
+		result = -1;
+	}
+	
+	fclose(stream.in);
+	free(stream.table);
+	free(stream.slots);
+	free(workers);
+	
+	*pSampleNum = sampleNum;
+	
+	return result;
+}
@@ -0,0 +1,46 @@
+/*
+ *  rng_stream.c
+ *  Reentrant random number streams for multithreaded code
+ *
+ *  The generator is SplitMix64 (Steele, Lea & Flood, "Fast splittable pseudorandom number generators", OOPSLA 2014).
+ *  Streams are started at hashed (seed, index) positions of its 2^64 period.
+ *
+ */
+
+#include "rng_stream.h"
+
+#define GOLDEN_GAMMA 0x9E3779B97F4A7C15ULL
+
+//SplitMix64 output function
+unsigned long long MixBits(unsigned long long z);
+
+//SplitMix64 output function
+unsigned long long MixBits(unsigned long long z)
+{
+	z = (z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+	z = (z^(z>>27))*0x94D049BB133111EBULL;
+	return z^(z>>31);
+}
+
+//Seed a stream from a base seed and a stream index. The same (seed, index) always gives the same sequence, and different indices give independent sequences
+void InitRngStream(RNG_STREAM_STRUCT *rng, long seed, long index)
+{
+	rng->state = MixBits(MixBits((unsigned long long)seed)+GOLDEN_GAMMA*((unsigned long long)index+1));
+}
+
+//Return a pseudo-random real number uniformly distributed between 0.0 and 1.0 (both excluded)
+double RandomStream(RNG_STREAM_STRUCT *rng)
+{
+	rng->state += GOLDEN_GAMMA;
+	
+	//upper 53 bits, shifted by half a step to stay clear of 0
+	return ((MixBits(rng->state)>>11)+0.5)*(1.0/9007199254740992.0);
+}
+
+//Return a pseudo-random integer uniformly distributed between 0 and n-1
+long EquilikelyStream(RNG_STREAM_STRUCT *rng, long n)
+{
+	long k = (long)(RandomStream(rng)*n);
+	
+	return (k<n)?k:n-1;
+}
@@ -0,0 +1,646 @@
+/*
+ *  sort.c
+ *  Introsort and LSD radix sort for real values and indexed real values
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "math_api.h"
+#include "sort.h"
+
+#define INSERTION_SORT_MAX_NUM 16	//ranges up to this length are finished with insertion sort
+#define RADIX_SORT_MIN_NUM 512		//SortF and SortIndexedArray use radix sort from this length on
+#define RADIX_BITS 8
+#define RADIX_BUCKET_NUM (1<<RADIX_BITS)
+#define RADIX_PASS_NUM (64/RADIX_BITS)
+
+//Key and payload moved by the radix sort passes
+typedef struct
+{
+	unsigned long long key;
+	int index;
+}RADIX_ITEM_STRUCT;
+
+//Introsort a range of a real array. depth: levels left before the range is heapsorted
+void IntroSortRangeF(double *a, int lo, int hi, int depth);
+
+//Heapsort a range of a real array
+void HeapSortF(double *a, int lo, int hi);
+
+//Sift the item at parent down a max-heap of num items
+void SiftDownF(double *h, int parent, int num);
+
+//Insertion sort a range of a real array
+void InsertionSortF(double *a, int lo, int hi);
+
+//Introsort a range of an indexed array. depth: levels left before the range is heapsorted
+void IntroSortRangeIndexed(INDEXED_FLOAT *a, int lo, int hi, int depth);
+
+//Heapsort a range of an indexed array
+void HeapSortIndexed(INDEXED_FLOAT *a, int lo, int hi);
+
+//Sift the item at parent down a max-heap of num items
+void SiftDownIndexed(INDEXED_FLOAT *h, int parent, int num);
+
+//Insertion sort a range of an indexed array
+void InsertionSortIndexed(INDEXED_FLOAT *a, int lo, int hi);
+
+//Depth limit of introsort for num items: 2*floor(log2(num))
+int IntroSortDepth(int num);
+
+//Map a real value to an unsigned key with the same order: flip all bits of negative values and the sign bit of the others
+unsigned long long RealToRadixKey(double value);
+
+//Inverse of RealToRadixKey
+double RadixKeyToReal(unsigned long long key);
+
+//LSD radix sort of the items by key. tmp: workspace of num items. Return the array that holds the sorted items (items or tmp)
+RADIX_ITEM_STRUCT *RadixSortItems(RADIX_ITEM_STRUCT *items, RADIX_ITEM_STRUCT *tmp, int num);
+
+//Depth limit of introsort for num items: 2*floor(log2(num))
+int IntroSortDepth(int num)
+{
+	int depth = 0;
+	
+	while (num>1)
+	{
+		num >>= 1;
+		depth++;
+	}
+	
+	return 2*depth;
+}
+
+//Insertion sort a range of a real array
+void InsertionSortF(double *a, int lo, int hi)
+{
+	int i, j;
+	double x;
+	
+	for (i=lo+1;i<=hi;i++)
+	{
+		x = a[i];
+		
+		for (j=i-1;(j>=lo)&&(a[j]>x);j--)
+		{
+			a[j+1] = a[j];
+		}
+		
+		a[j+1] = x;
+	}
+}
+
+//Sift the item at parent down a max-heap of num items
+void SiftDownF(double *h, int parent, int num)
+{
+	int child;
+	double x = h[parent];
+	
+	for (child=2*parent+1;child<num;child=2*parent+1)
+	{
+		if ((child+1<num)&&(h[child+1]>h[child]))
+		{
+			child++;
+		}
+		
+		if (h[child]<=x)
+		{
+			break;
+		}
+		
+		h[parent] = h[child];
+		parent = child;
+	}
+	
+	h[parent] = x;
+}
+
+//Heapsort a range of a real array
+void HeapSortF(double *a, int lo, int hi)
+{
+	int num = hi-lo+1;
+	int i;
+	double x;
+	double *h = a+lo;
+	
+	for (i=num/2-1;i>=0;i--)
+	{
+		SiftDownF(h, i, num);
+	}
+	
+	for (i=num-1;i>0;i--)
+	{
+		x = h[0];
+		h[0] = h[i];
+		h[i] = x;
+		SiftDownF(h, 0, i);
+	}
+}
+
+//Introsort a range of a real array. depth: levels left before the range is heapsorted
+void IntroSortRangeF(double *a, int lo, int hi, int depth)
+{
+	int i, j, mid;
+	double x, h;
+	
+	while (hi-lo+1>INSERTION_SORT_MAX_NUM)
+	{
+		if (depth==0)
+		{
+			HeapSortF(a, lo, hi);
+			return;
+		}
+		
+		depth--;
+		
+		//median of three
+		mid = lo+(hi-lo)/2;
+		
+		if (a[mid]<a[lo])
+		{
+			h = a[mid]; a[mid] = a[lo]; a[lo] = h;
+		}
+		if (a[hi]<a[lo])
+		{
+			h = a[hi]; a[hi] = a[lo]; a[lo] = h;
+		}
+		if (a[hi]<a[mid])
+		{
+			h = a[hi]; a[hi] = a[mid]; a[mid] = h;
+		}
+		
+		x = a[mid];
+		i = lo;
+		j = hi;
+		
+		//Hoare partition. Both scans stop on items equal to the pivot, so runs of ties are split evenly
+		while (i<=j)
+		{
+			while (a[i]<x)
+			{
+				i++;
+			}
+			while (a[j]>x)
+			{
+				j--;
+			}
+			if (i<=j)
+			{
+				h = a[i];
+				a[i] = a[j];
+				a[j] = h;
+				i++; j--;
+			}
+		}
+		
+		//recurse into the shorter part and loop on the longer one, so the stack stays O(log(num))
+		if (j-lo<hi-i)
+		{
+			IntroSortRangeF(a, lo, j, depth);
+			lo = i;
+		}
+		else
+		{
+			IntroSortRangeF(a, i, hi, depth);
+			hi = j;
+		}
+	}
+	
+	InsertionSortF(a, lo, hi);
+}
+
+//Introsort a real array in ascending order: median-of-three quicksort that falls back to heapsort past 2*log2(num) levels,
+//and finishes short ranges with insertion sort. O(num*log(num)) in the worst case, including sorted and tie-heavy input
+void IntroSortF(double *a, int num)
+{
+	if (num>1)
+	{
+		IntroSortRangeF(a, 0, num-1, IntroSortDepth(num));
+	}
+}
+
+//Insertion sort a range of an indexed array
+void InsertionSortIndexed(INDEXED_FLOAT *a, int lo, int hi)
+{
+	int i, j;
+	INDEXED_FLOAT x;
+	
+	for (i=lo+1;i<=hi;i++)
+	{
+		x = a[i];
+		
+		for (j=i-1;(j>=lo)&&(a[j].value>x.value);j--)
+		{
+			a[j+1] = a[j];
+		}
+		
+		a[j+1] = x;
+	}
+}
+
+//Sift the item at parent down a max-heap of num items
+void SiftDownIndexed(INDEXED_FLOAT *h, int parent, int num)
+{
+	int child;
+	INDEXED_FLOAT x = h[parent];
+	
+	for (child=2*parent+1;child<num;child=2*parent+1)
+	{
+		if ((child+1<num)&&(h[child+1].value>h[child].value))
+		{
+			child++;
+		}
+		
+		if (h[child].value<=x.value)
+		{
+			break;
+		}
+		
+		h[parent] = h[child];
+		parent = child;
+	}
+	
+	h[parent] = x;
+}
+
+//Heapsort a range of an indexed array
+void HeapSortIndexed(INDEXED_FLOAT *a, int lo, int hi)
+{
+	int num = hi-lo+1;
+	int i;
+	INDEXED_FLOAT x;
+	INDEXED_FLOAT *h = a+lo;
+	
+	for (i=num/2-1;i>=0;i--)
+	{
+		SiftDownIndexed(h, i, num);
+	}
+	
+	for (i=num-1;i>0;i--)
+	{
+		x = h[0];
+		h[0] = h[i];
+		h[i] = x;
+		SiftDownIndexed(h, 0, i);
+	}
+}
+
+//Introsort a range of an indexed array. depth: levels left before the range is heapsorted
+void IntroSortRangeIndexed(INDEXED_FLOAT *a, int lo, int hi, int depth)
+{
+	int i, j, mid;
+	double x;
+	INDEXED_FLOAT h;
+	
+	while (hi-lo+1>INSERTION_SORT_MAX_NUM)
+	{
+		if (depth==0)
+		{
+			HeapSortIndexed(a, lo, hi);
+			return;
+		}
+		
+		depth--;
+		
+		//median of three
+		mid = lo+(hi-lo)/2;
+		
+		if (a[mid].value<a[lo].value)
+		{
+			h = a[mid]; a[mid] = a[lo]; a[lo] = h;
+		}
+		if (a[hi].value<a[lo].value)
+		{
+			h = a[hi]; a[hi] = a[lo]; a[lo] = h;
+		}
+		if (a[hi].value<a[mid].value)
+		{
+			h = a[hi]; a[hi] = a[mid]; a[mid] = h;
+		}
+		
+		x = a[mid].value;
+		i = lo;
+		j = hi;
+		
+		//Hoare partition. Both scans stop on items equal to the pivot, so runs of ties are split evenly
+		while (i<=j)
+		{
+			while (a[i].value<x)
+			{
+				i++;
+			}
+			while (a[j].value>x)
+			{
+				j--;
+			}
+			if (i<=j)
+			{
+				h = a[i];
+				a[i] = a[j];
+				a[j] = h;
+				i++; j--;
+			}
+		}
+		
+		//recurse into the shorter part and loop on the longer one, so the stack stays O(log(num))
+		if (j-lo<hi-i)
+		{
+			IntroSortRangeIndexed(a, lo, j, depth);
+			lo = i;
+		}
+		else
+		{
+			IntroSortRangeIndexed(a, i, hi, depth);
+			hi = j;
+		}
+	}
+	
+	InsertionSortIndexed(a, lo, hi);
+}
+
+//Introsort an indexed array by value in ascending order
+void IntroSortIndexedArray(INDEXED_FLOAT *a, int num)
+{
+	if (num>1)
+	{
+		IntroSortRangeIndexed(a, 0, num-1, IntroSortDepth(num));
+	}
+}
+
+//Map a real value to an unsigned key with the same order: flip all bits of negative values and the sign bit of the others
+unsigned long long RealToRadixKey(double value)
+{
+	unsigned long long key;
+	
+	memcpy(&key, &value, sizeof(key));
+	
+	return (key>>63) ? ~key : key|0x8000000000000000ULL;
+}
+
+//Inverse of RealToRadixKey
+double RadixKeyToReal(unsigned long long key)
+{
+	double value;
+	
+	key = (key>>63) ? key&0x7fffffffffffffffULL : ~key;
+	
+	memcpy(&value, &key, sizeof(value));
+	
+	return value;
+}
+
+//LSD radix sort of the items by key. tmp: workspace of num items. Return the array that holds the sorted items (items or tmp)
+RADIX_ITEM_STRUCT *RadixSortItems(RADIX_ITEM_STRUCT *items, RADIX_ITEM_STRUCT *tmp, int num)
+{
+	int counts[RADIX_PASS_NUM][RADIX_BUCKET_NUM];
+	int pass, i, digit, sum, c;
+	RADIX_ITEM_STRUCT *src = items;
+	RADIX_ITEM_STRUCT *dest = tmp;
+	RADIX_ITEM_STRUCT *h;
+	
+	//histograms of all passes in one read of the keys
+	memset(counts, 0, sizeof(counts));
+	
+	for (i=0;i<num;i++)
+	{
+		for (pass=0;pass<RADIX_PASS_NUM;pass++)
+		{
+			counts[pass][(items[i].key>>(pass*RADIX_BITS))&(RADIX_BUCKET_NUM-1)]++;
+		}
+	}
+	
+	for (pass=0;pass<RADIX_PASS_NUM;pass++)
+	{
+		digit = (src[0].key>>(pass*RADIX_BITS))&(RADIX_BUCKET_NUM-1);
+		
+		//all keys share this digit, the pass would not move anything
+		if (counts[pass][digit]==num)
+		{
+			continue;
+		}
+		
+		sum = 0;
+		
+		for (i=0;i<RADIX_BUCKET_NUM;i++)
+		{
+			c = counts[pass][i];
+			counts[pass][i] = sum;
+			sum += c;
+		}
+		
+		for (i=0;i<num;i++)
+		{
+			dest[counts[pass][(src[i].key>>(pass*RADIX_BITS))&(RADIX_BUCKET_NUM-1)]++] = src[i];
+		}
+		
+		h = src;
+		src = dest;
+		dest = h;
+	}
+	
+	return src;
+}
+
+//LSD radix sort of a real array in ascending order, 8 bits per pass on the order-preserving bit pattern of the values.
+//Passes in which all keys share one digit are skipped. Return 1 if success, -1 if failure
+int RadixSortF(double *a, int num)
+{
+	RADIX_ITEM_STRUCT *items, *sorted;
+	int i;
+	
+	if (num<=1)
+	{
+		return 1;
+	}
+	
+	items = (RADIX_ITEM_STRUCT *)malloc(2*(size_t)num*sizeof(RADIX_ITEM_STRUCT));
+	
+	assert(items!=NULL);
+	
+	if (items==NULL)
+	{
+		return -1;
+	}
+	
+	for (i=0;i<num;i++)
+	{
+		items[i].key = RealToRadixKey(a[i]);
+	}
+	
+	sorted = RadixSortItems(items, items+num, num);
+	
+	for (i=0;i<num;i++)
+	{
+		a[i] = RadixKeyToReal(sorted[i].key);
+	}
+	
+	free(items);
+	
+	return 1;
+}
+
+//LSD radix sort of an indexed array by value in ascending order. Stable. Return 1 if success, -1 if failure
+int RadixSortIndexedArray(INDEXED_FLOAT *a, int num)
+{
+	RADIX_ITEM_STRUCT *items, *sorted;
+	int i;
+	
+	if (num<=1)
+	{
+		return 1;
+	}
+	
+	items = (RADIX_ITEM_STRUCT *)malloc(2*(size_t)num*sizeof(RADIX_ITEM_STRUCT));
+	
+	assert(items!=NULL);
+	
+	if (items==NULL)
+	{
+		return -1;
+	}
+	
+	for (i=0;i<num;i++)
+	{
+		items[i].key = RealToRadixKey(a[i].value);
+		items[i].index = a[i].index;
+	}
+	
+	sorted = RadixSortItems(items, items+num, num);
+	
+	for (i=0;i<num;i++)
+	{
+		a[i].value = RadixKeyToReal(sorted[i].key);
+		a[i].index = sorted[i].index;
+	}
+	
+	free(items);
+	
+	return 1;
+}
+
+//Rearrange a real array so that a[k] is the value a sorted array would hold there, no larger values before it and no
+//smaller values after it. Quickselect with median-of-three pivots, introsort past 2*log2(num) levels. Return a[k]
+double SelectF(double *a, int num, int k)
+{
+	int lo = 0, hi = num-1;
+	int i, j, mid;
+	int depth = IntroSortDepth(num);
+	double x, h;
+	
+	assert((k>=0)&&(k<num));
+	
+	while (hi-lo+1>INSERTION_SORT_MAX_NUM)
+	{
+		if (depth==0)
+		{
+			IntroSortF(a+lo, hi-lo+1);
+			return a[k];
+		}
+		
+		depth--;
+		
+		//median of three
+		mid = lo+(hi-lo)/2;
+		
+		if (a[mid]<a[lo])
+		{
+			h = a[mid]; a[mid] = a[lo]; a[lo] = h;
+		}
+		if (a[hi]<a[lo])
+		{
+			h = a[hi]; a[hi] = a[lo]; a[lo] = h;
+		}
+		if (a[hi]<a[mid])
+		{
+			h = a[hi]; a[hi] = a[mid]; a[mid] = h;
+		}
+		
+		x = a[mid];
+		i = lo;
+		j = hi;
+		
+		while (i<=j)
+		{
+			while (a[i]<x)
+			{
+				i++;
+			}
+			while (a[j]>x)
+			{
+				j--;
+			}
+			if (i<=j)
+			{
+				h = a[i];
+				a[i] = a[j];
+				a[j] = h;
+				i++; j--;
+			}
+		}
+		
+		//a[lo..j] <= x <= a[i..hi], and items between j and i equal x
+		if (k<=j)
+		{
+			hi = j;
+		}
+		else if (k>=i)
+		{
+			lo = i;
+		}
+		else
+		{
+			return a[k];
+		}
+	}
+	
+	InsertionSortF(a, lo, hi);
+	
+	return a[k];
+}
+
+//Median of a real array, the mean of the two middle values for an even length. The array is rearranged
+double MedianF(double *a, int num)
+{
+	int i;
+	double upper, lower;
+	
+	upper = SelectF(a, num, num/2);
+	
+	if (num%2)
+	{
+		return upper;
+	}
+	
+	//the lower middle value is the largest of the items before num/2
+	lower = a[0];
+	
+	for (i=1;i<num/2;i++)
+	{
+		if (a[i]>lower)
+		{
+			lower = a[i];
+		}
+	}
+	
+	return 0.5*(lower+upper);
+}
+
+//Sort a real array in ascending order, with radix sort for long arrays and introsort otherwise
+void SortF(double *a, int num)
+{
+	if ((num<RADIX_SORT_MIN_NUM)||(RadixSortF(a, num)<=0))
+	{
+		IntroSortF(a, num);
+	}
+}
+
+//Sort an indexed array by value in ascending order, with radix sort for long arrays and introsort otherwise
+void SortIndexedArray(INDEXED_FLOAT *a, int num)
+{
+	if ((num<RADIX_SORT_MIN_NUM)||(RadixSortIndexedArray(a, num)<=0))
+	{
+		IntroSortIndexedArray(a, num);
+	}
+}